@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Byte_Swap.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief encoding of a register block (FC 3/4 reply)
+ *
+ * args: kernel (see Modbus::PDU::Byte_Swap::isa_t), number of registers
+ */
+static void BM_Byte_Swap(benchmark::State &state) {
+    const auto isa = static_cast<Modbus::PDU::Byte_Swap::isa_t>(state.range(0));
+    if (!Modbus::PDU::Byte_Swap::is_supported(isa)) {
+        state.SkipWithError("kernel not supported by the cpu");
+        return;
+    }
+
+    const auto                 nb = static_cast<std::size_t>(state.range(1));
+    std::vector<std::uint16_t> registers(nb, 0x1234);
+    std::vector<std::uint8_t>  wire(2 * nb + 1);
+
+    for (auto _ : state) {
+        // odd destination address: the position of the register data in a reply
+        Modbus::PDU::Byte_Swap::to_wire(isa, registers.data(), nb, wire.data() + 1);
+        benchmark::DoNotOptimize(wire.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    state.SetBytesProcessed(state.iterations() * state.range(1) * 2);
+}
+
+BENCHMARK(BM_Byte_Swap)->ArgNames({"isa", "registers"})->ArgsProduct({{0, 1, 2, 3}, {8, 64, 123, 125}});
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "PDU_Engine.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+//! number of coils of the benchmark tables
+constexpr std::size_t NB_COILS = 0x10000;
+
+/**
+ * @brief register storage with either one coil per byte or 8 coils per byte
+ */
+struct Coil_Tables {
+    std::vector<std::uint8_t> bits;
+    modbus_mapping_t          mapping {};
+    Modbus::Register_Tables   tables;
+
+    explicit Coil_Tables(bool packed) : bits(packed ? NB_COILS / 8 : NB_COILS, 0) {
+        mapping.nb_bits        = static_cast<int>(NB_COILS);
+        mapping.tab_bits       = bits.data();
+        mapping.nb_input_bits  = static_cast<int>(NB_COILS);
+        mapping.tab_input_bits = bits.data();
+        tables.mapping         = &mapping;
+        tables.packed_bits     = packed;
+    }
+};
+
+/**
+ * @brief create a coil request
+ * @param function_code function code (1, 2 or 15)
+ * @param address start address
+ * @param nb number of coils
+ * @return request (MBAP header + PDU)
+ */
+std::vector<std::uint8_t> coil_request(std::uint8_t function_code, int address, int nb) {
+    std::vector<std::uint8_t> request = {0x00,
+                                         0x01,
+                                         0x00,
+                                         0x00,
+                                         0x00,
+                                         0x06,
+                                         0x01,
+                                         function_code,
+                                         static_cast<std::uint8_t>(address >> 8),
+                                         static_cast<std::uint8_t>(address),
+                                         static_cast<std::uint8_t>(nb >> 8),
+                                         static_cast<std::uint8_t>(nb)};
+
+    if (function_code == MODBUS_FC_WRITE_MULTIPLE_COILS) {
+        const auto nb_bytes = static_cast<std::size_t>((nb + 7) / 8);
+        request.push_back(static_cast<std::uint8_t>(nb_bytes));
+        for (std::size_t i = 0; i < nb_bytes; ++i)
+            request.push_back(static_cast<std::uint8_t>(0xA5 ^ i));
+
+        const auto length = request.size() - 6;
+        request[4]        = static_cast<std::uint8_t>(length >> 8);
+        request[5]        = static_cast<std::uint8_t>(length);
+    }
+
+    return request;
+}
+
+}  // namespace
+
+/**
+ * @brief execution of FC 1 requests
+ *
+ * args: layout (0: one coil per byte, 1: packed), number of coils, start address
+ */
+static void BM_Read_Coils(benchmark::State &state) {
+    Coil_Tables tables(state.range(0) != 0);
+    const auto  nb      = static_cast<int>(state.range(1));
+    const auto  request = coil_request(MODBUS_FC_READ_COILS, static_cast<int>(state.range(2)), nb);
+
+    std::vector<std::uint8_t> reply;
+    reply.reserve(MODBUS_TCP_MAX_ADU_LENGTH);
+    for (auto _ : state) {
+        reply.clear();
+        Modbus::PDU::execute(request, tables.tables, reply);
+        benchmark::DoNotOptimize(reply.data());
+    }
+    state.SetItemsProcessed(state.iterations() * nb);
+}
+
+/**
+ * @brief execution of FC 15 requests
+ *
+ * args: layout (0: one coil per byte, 1: packed), number of coils, start address
+ */
+static void BM_Write_Coils(benchmark::State &state) {
+    Coil_Tables tables(state.range(0) != 0);
+    const auto  nb      = static_cast<int>(state.range(1));
+    const auto  request = coil_request(MODBUS_FC_WRITE_MULTIPLE_COILS, static_cast<int>(state.range(2)), nb);
+
+    std::vector<std::uint8_t> reply;
+    reply.reserve(MODBUS_TCP_MAX_ADU_LENGTH);
+    for (auto _ : state) {
+        reply.clear();
+        Modbus::PDU::execute(request, tables.tables, reply);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * nb);
+}
+
+BENCHMARK(BM_Read_Coils)
+        ->ArgNames({"packed", "coils", "address"})
+        ->ArgsProduct({{0, 1}, {16, 256, MODBUS_MAX_READ_BITS}, {0, 3}});
+BENCHMARK(BM_Write_Coils)
+        ->ArgNames({"packed", "coils", "address"})
+        ->ArgsProduct({{0, 1}, {16, 256, MODBUS_MAX_WRITE_BITS}, {0, 3}});
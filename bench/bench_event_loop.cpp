@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Modbus_TCP_Client_poll.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+//! FC 3 request: transaction id 1, unit id 1, read 10 holding registers starting at address 0
+constexpr std::array<std::uint8_t, 12> READ_REQUEST = {
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+
+//! size of the response to READ_REQUEST (MBAP header + function code + byte count + 10 registers)
+constexpr std::size_t READ_RESPONSE_SIZE = 7 + 2 + 2 * 10;
+
+/**
+ * @brief get the port a socket is bound to
+ * @param socket socket
+ * @return port in host byte order
+ */
+std::uint16_t get_port(int socket) {
+    struct sockaddr_storage addr {};
+    socklen_t               len = sizeof(addr);
+    if (getsockname(socket, reinterpret_cast<struct sockaddr *>(&addr), &len) == -1)  // NOLINT
+        throw std::system_error(errno, std::generic_category(), "getsockname failed");
+
+    // the port entries have the same offset and size in sockaddr_in and sockaddr_in6
+    return ntohs(reinterpret_cast<const struct sockaddr_in *>(&addr)->sin_port);  // NOLINT
+}
+
+/**
+ * @brief open a tcp connection to the loopback interface
+ * @param port port to connect to
+ * @return connected socket
+ */
+int connect_loopback(std::uint16_t port) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) throw std::system_error(errno, std::generic_category(), "socket failed");
+
+    struct sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr)) == -1)  // NOLINT
+        throw std::system_error(errno, std::generic_category(), "connect failed");
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
+
+}  // namespace
+
+/**
+ * @brief cost of a single request/response round trip while a number of idle connections is open
+ *
+ * args: backend (0: poll, 1: epoll), number of idle connections
+ */
+static void BM_Event_Loop(benchmark::State &state) {
+    const auto backend = state.range(0) ? Modbus::TCP::Client_Poll::backend_t::epoll
+                                        : Modbus::TCP::Client_Poll::backend_t::poll;
+    const auto idle    = static_cast<std::size_t>(state.range(1));
+
+    // never signaled
+    const int signal_fd = eventfd(0, EFD_CLOEXEC);
+
+    Modbus::TCP::Client_Poll server("127.0.0.1", "0", nullptr, 0, idle + 1);
+    server.set_backend(backend);
+    const auto port = get_port(server.get_socket());
+
+    std::vector<int> clients;
+    for (std::size_t i = 0; i <= idle; ++i) {
+        clients.push_back(connect_loopback(port));
+        server.run(signal_fd, true, -1);  // accept
+    }
+    const int active = clients.back();
+
+    std::array<std::uint8_t, READ_RESPONSE_SIZE> response {};
+    for (auto _ : state) {
+        send(active, READ_REQUEST.data(), READ_REQUEST.size(), 0);
+        server.run(signal_fd, true, -1);
+        const auto received = recv(active, response.data(), response.size(), MSG_WAITALL);
+        if (received != static_cast<ssize_t>(response.size())) {
+            state.SkipWithError("invalid response");
+            break;
+        }
+        benchmark::DoNotOptimize(response);
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    for (const auto fd : clients)
+        close(fd);
+    close(signal_fd);
+}
+
+/**
+ * @brief Client_Poll::run with clients that are connected via socketpair (no TCP/IP stack)
+ *
+ * Each iteration: every client sends one request and run is called until all replies are received.
+ *
+ * args: backend (see Modbus::TCP::Client_Poll::backend_t), number of clients
+ */
+static void BM_Event_Loop_Socketpair(benchmark::State &state) {
+    const auto backend = static_cast<Modbus::TCP::Client_Poll::backend_t>(state.range(0));
+    const auto nb      = static_cast<std::size_t>(state.range(1));
+
+    // never signaled
+    const int signal_fd = eventfd(0, EFD_CLOEXEC);
+
+    Modbus::TCP::Client_Poll server("127.0.0.1", "0", nullptr, 0, nb);
+    server.set_backend(backend);
+
+    std::vector<int> clients;
+    for (std::size_t i = 0; i < nb; ++i) {
+        std::array<int, 2> fds {};
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data()) == -1)
+            throw std::system_error(errno, std::generic_category(), "socketpair failed");
+        server.add_client(fds[0]);
+        clients.push_back(fds[1]);
+    }
+
+    std::array<std::uint8_t, READ_RESPONSE_SIZE> response {};
+    std::vector<std::size_t>                     received(nb);
+    for (auto _ : state) {
+        for (const auto fd : clients)
+            send(fd, READ_REQUEST.data(), READ_REQUEST.size(), 0);
+        std::fill(received.begin(), received.end(), 0);
+
+        std::size_t complete = 0;
+        while (complete < nb) {
+            server.run(signal_fd, true, -1);
+            for (std::size_t i = 0; i < nb; ++i) {
+                if (received[i] == response.size()) continue;
+
+                const auto ret = recv(clients[i], response.data(), response.size() - received[i], MSG_DONTWAIT);
+                if (ret > 0) received[i] += static_cast<std::size_t>(ret);
+                if (received[i] == response.size()) ++complete;
+            }
+        }
+        benchmark::DoNotOptimize(response);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+
+    for (const auto fd : clients)
+        close(fd);
+    close(signal_fd);
+}
+
+BENCHMARK(BM_Event_Loop)->ArgNames({"epoll", "idle"})->ArgsProduct({{0, 1}, {0, 16, 64, 256, 512}});
+#ifdef IO_URING_ENABLED
+BENCHMARK(BM_Event_Loop_Socketpair)->ArgNames({"backend", "clients"})->ArgsProduct({{0, 1, 2}, {1, 16, 64}});
+#else
+BENCHMARK(BM_Event_Loop_Socketpair)->ArgNames({"backend", "clients"})->ArgsProduct({{0, 1}, {1, 16, 64}});
+#endif
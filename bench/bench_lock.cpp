@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Shm_Lock.hpp"
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cxxsemaphore.hpp>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+//! timeout of the lock operations (never reached: the locks are not contended)
+constexpr struct timespec TIMEOUT = {1, 0};
+
+}  // namespace
+
+/**
+ * @brief acquisition and release of the semaphore (--semaphore), as done for each request (batch)
+ *
+ * @details the process local mutex serializes the threads of this process (see Client_Poll::acquire_global_lock)
+ */
+static void BM_Semaphore_Lock(benchmark::State &state) {
+    cxxsemaphore::Semaphore semaphore("bench_semaphore_" + std::to_string(getpid()), 1, true);
+    std::timed_mutex        mutex;
+
+    for (auto _ : state) {
+        std::unique_lock<std::timed_mutex> lock(mutex, std::defer_lock);
+        if (!lock.try_lock_for(std::chrono::seconds(1)) || !semaphore.wait(TIMEOUT)) {
+            state.SkipWithError("failed to acquire the semaphore");
+            break;
+        }
+        semaphore.post();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * @brief acquisition and release of the robust shared memory mutex (--lock)
+ */
+static void BM_Shm_Lock(benchmark::State &state) {
+    Modbus::shm::Shm_Lock lock("bench_lock_" + std::to_string(getpid()), true, 0600);
+    std::uint32_t         spins = 0;
+
+    for (auto _ : state) {
+        const auto result = lock.lock(&TIMEOUT, spins);
+        if (result == Modbus::shm::lock::result_t::timeout || result == Modbus::shm::lock::result_t::error) {
+            state.SkipWithError("failed to acquire the lock");
+            break;
+        }
+        lock.unlock();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_Semaphore_Lock);
+BENCHMARK(BM_Shm_Lock);
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "PDU_Engine.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+//! number of registers of each benchmark table
+constexpr std::size_t NB_REGS = 0x10000;
+
+/**
+ * @brief register storage with the maximum number of registers (one coil per byte)
+ */
+struct Tables {
+    std::vector<std::uint8_t>  bits;
+    std::vector<std::uint8_t>  input_bits;
+    std::vector<std::uint16_t> registers;
+    std::vector<std::uint16_t> input_registers;
+    modbus_mapping_t           mapping {};
+    Modbus::Register_Tables    tables;
+
+    Tables()
+        : bits(NB_REGS, 0),
+          input_bits(NB_REGS, 1),
+          registers(NB_REGS, 0x1234),
+          input_registers(NB_REGS, 0x5678) {
+        mapping.nb_bits             = static_cast<int>(NB_REGS);
+        mapping.tab_bits            = bits.data();
+        mapping.nb_input_bits       = static_cast<int>(NB_REGS);
+        mapping.tab_input_bits      = input_bits.data();
+        mapping.nb_registers        = static_cast<int>(NB_REGS);
+        mapping.tab_registers       = registers.data();
+        mapping.nb_input_registers  = static_cast<int>(NB_REGS);
+        mapping.tab_input_registers = input_registers.data();
+        tables.mapping              = &mapping;
+    }
+};
+
+/**
+ * @brief append a 16 bit value in big endian byte order
+ */
+void append16(std::vector<std::uint8_t> &out, unsigned value) {
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+/**
+ * @brief create a request with the maximum number of registers of a function code
+ * @param function_code function code
+ * @return request (MBAP header + PDU)
+ */
+std::vector<std::uint8_t> max_request(std::uint8_t function_code) {
+    std::vector<std::uint8_t> request = {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, function_code};
+
+    switch (function_code) {
+        case MODBUS_FC_READ_COILS:
+        case MODBUS_FC_READ_DISCRETE_INPUTS:
+            append16(request, 0);
+            append16(request, MODBUS_MAX_READ_BITS);
+            break;
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+            append16(request, 0);
+            append16(request, MODBUS_MAX_READ_REGISTERS);
+            break;
+        case MODBUS_FC_WRITE_SINGLE_COIL:
+            append16(request, 0);
+            append16(request, 0xFF00);
+            break;
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+            append16(request, 0);
+            append16(request, 0xABCD);
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_COILS:
+            append16(request, 0);
+            append16(request, MODBUS_MAX_WRITE_BITS);
+            request.push_back(static_cast<std::uint8_t>((MODBUS_MAX_WRITE_BITS + 7) / 8));
+            request.insert(request.end(), (MODBUS_MAX_WRITE_BITS + 7) / 8, 0xA5);
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+            append16(request, 0);
+            append16(request, MODBUS_MAX_WRITE_REGISTERS);
+            request.push_back(static_cast<std::uint8_t>(MODBUS_MAX_WRITE_REGISTERS * 2));
+            request.insert(request.end(), MODBUS_MAX_WRITE_REGISTERS * 2, 0x5A);
+            break;
+        case MODBUS_FC_MASK_WRITE_REGISTER:
+            append16(request, 0);
+            append16(request, 0xF0F0);
+            append16(request, 0x0A0A);
+            break;
+        case MODBUS_FC_WRITE_AND_READ_REGISTERS:
+            append16(request, 0);
+            append16(request, MODBUS_MAX_WR_READ_REGISTERS);
+            append16(request, 0);
+            append16(request, MODBUS_MAX_WR_WRITE_REGISTERS);
+            request.push_back(static_cast<std::uint8_t>(MODBUS_MAX_WR_WRITE_REGISTERS * 2));
+            request.insert(request.end(), MODBUS_MAX_WR_WRITE_REGISTERS * 2, 0x5A);
+            break;
+        default:  // MODBUS_FC_REPORT_SLAVE_ID: no data
+            break;
+    }
+
+    const auto length = request.size() - 6;
+    request[4]        = static_cast<std::uint8_t>(length >> 8);
+    request[5]        = static_cast<std::uint8_t>(length);
+    return request;
+}
+
+}  // namespace
+
+/**
+ * @brief decoding of a request, execution and encoding of the reply (built-in PDU engine)
+ *
+ * args: function code (maximum number of registers)
+ */
+static void BM_PDU_Execute(benchmark::State &state) {
+    Tables     tables;
+    const auto request = max_request(static_cast<std::uint8_t>(state.range(0)));
+
+    std::vector<std::uint8_t> reply;
+    reply.reserve(MODBUS_TCP_MAX_ADU_LENGTH);
+    for (auto _ : state) {
+        reply.clear();
+        Modbus::PDU::execute(request, tables.tables, reply);
+        benchmark::DoNotOptimize(reply.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(request.size() + reply.size()));
+}
+
+/**
+ * @brief encoding of an exception response
+ */
+static void BM_PDU_Exception(benchmark::State &state) {
+    const auto request = max_request(MODBUS_FC_READ_HOLDING_REGISTERS);
+
+    std::vector<std::uint8_t> reply;
+    reply.reserve(MODBUS_TCP_MAX_ADU_LENGTH);
+    for (auto _ : state) {
+        reply.clear();
+        Modbus::PDU::reply_exception(request, MODBUS_EXCEPTION_SLAVE_OR_SERVER_BUSY, reply);
+        benchmark::DoNotOptimize(reply.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_PDU_Execute)
+        ->ArgName("function")
+        ->Arg(MODBUS_FC_READ_COILS)
+        ->Arg(MODBUS_FC_READ_DISCRETE_INPUTS)
+        ->Arg(MODBUS_FC_READ_HOLDING_REGISTERS)
+        ->Arg(MODBUS_FC_READ_INPUT_REGISTERS)
+        ->Arg(MODBUS_FC_WRITE_SINGLE_COIL)
+        ->Arg(MODBUS_FC_WRITE_SINGLE_REGISTER)
+        ->Arg(MODBUS_FC_WRITE_MULTIPLE_COILS)
+        ->Arg(MODBUS_FC_WRITE_MULTIPLE_REGISTERS)
+        ->Arg(MODBUS_FC_REPORT_SLAVE_ID)
+        ->Arg(MODBUS_FC_MASK_WRITE_REGISTER)
+        ->Arg(MODBUS_FC_WRITE_AND_READ_REGISTERS);
+BENCHMARK(BM_PDU_Exception);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "modbus_shm.hpp"
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+//! number of registers of each table (default of the command line options)
+constexpr std::size_t NB_REGS = 0x10000;
+
+//! permissions of the benchmark shared memories
+constexpr mode_t PERMISSIONS = 0600;
+
+//! all features of the control object
+constexpr std::uint32_t ALL_FEATURES = Modbus::shm::control::FEATURE_SEQLOCK | Modbus::shm::control::FEATURE_DIRTY |
+                                       Modbus::shm::control::FEATURE_NOTIFY |
+                                       Modbus::shm::control::FEATURE_TABLE_LOCKS;
+
+}  // namespace
+
+/**
+ * @brief creation and destruction of the shared memories (startup and termination)
+ *
+ * args: number of mappings (1: default, 256: --separate-all), control object (0: disabled, 1: all features)
+ */
+static void BM_Shm_Mapping(benchmark::State &state) {
+    const auto mappings = static_cast<std::size_t>(state.range(0));
+    const auto features = state.range(1) ? ALL_FEATURES : 0U;
+
+    std::vector<std::unique_ptr<Modbus::shm::Shm_Mapping>> objects;
+    objects.reserve(mappings);
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < mappings; ++i) {
+            objects.emplace_back(std::make_unique<Modbus::shm::Shm_Mapping>(NB_REGS,
+                                                                            NB_REGS,
+                                                                            NB_REGS,
+                                                                            NB_REGS,
+                                                                            "bench_" + std::to_string(i) + '_',
+                                                                            true,
+                                                                            PERMISSIONS,
+                                                                            false,
+                                                                            features));
+        }
+        objects.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_Shm_Mapping)
+        ->ArgNames({"mappings", "control"})
+        ->ArgsProduct({{1, 256}, {0, 1}})
+        ->Unit(benchmark::kMillisecond);
@@ -25,6 +25,7 @@ endif()
 # add executable
 add_executable(${Target})
 install(TARGETS ${Target})
+install(FILES src/Shm_Control_Layout.hpp src/Shm_Lock_Layout.hpp src/Shm_Arena_Layout.hpp DESTINATION include/${Target})
 
 # set source and libraries directory
 add_subdirectory("src")
@@ -62,6 +63,7 @@ if (ENABLE_MULTITHREADING)
     set(THREADS_PREFER_PTHREAD_FLAG ON)
     find_package(Threads REQUIRED)
     target_link_libraries(${Target} PRIVATE Threads::Threads)
+    target_compile_definitions(${Target} PUBLIC "MULTITHREADING_ENABLED")
 endif ()
 
 # lto
@@ -132,6 +134,16 @@ if(ENABLE_TEST)
     add_subdirectory("test")
 endif()
 
+# add benchmark targets
+if(ENABLE_BENCHMARK)
+    add_subdirectory("bench")
+endif()
+
+# add load generator target
+if(ENABLE_LOAD_GENERATOR)
+    add_subdirectory("loadgen")
+endif()
+
 # generate version_info.cpp
 # output is not the acutal generated file --> command is always executed
 add_custom_command(
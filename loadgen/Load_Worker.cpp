@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Load_Worker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace Modbus::Load {
+
+//* size of the receive buffer of one recv call
+static constexpr std::size_t RECV_SIZE = 0x4000;
+
+//* nanoseconds per second
+static constexpr std::chrono::nanoseconds::rep NS_PER_S = 1000000000;
+
+//* maximum size of a Modbus TCP ADU
+static constexpr std::size_t MAX_ADU_SIZE = 260;
+
+/**
+ * @brief get the index of a function code in Request_Mix::FUNCTION_CODES
+ */
+static std::size_t function_index(std::uint8_t function) noexcept {
+    const auto &codes = Request_Mix::FUNCTION_CODES;
+    return static_cast<std::size_t>(std::find(codes.begin(), codes.end(), function) - codes.begin());
+}
+
+/**
+ * @brief get the interval between two requests of a connection
+ *
+ * @param connections number of connections
+ * @param rate requests per second of all connections (0: closed loop)
+ */
+static Load_Worker::clock_t::duration send_interval(std::size_t connections, double rate) {
+    if (rate <= 0) return Load_Worker::clock_t::duration::zero();
+    return std::chrono::duration_cast<Load_Worker::clock_t::duration>(
+            std::chrono::duration<double>(static_cast<double>(connections) / rate));
+}
+
+Load_Worker::Load_Worker(const std::string &host,
+                         const std::string &service,
+                         std::size_t        connections,
+                         std::size_t        pipeline,
+                         double             rate,
+                         const Request_Mix &mix,
+                         std::uint64_t      seed)
+    : mix(mix),
+      pipeline(std::max<std::size_t>(pipeline, 1)),
+      interval(send_interval(connections, rate)),
+      random(seed) {
+    struct addrinfo hints {};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *info = nullptr;
+    const auto       ret  = getaddrinfo(host.c_str(), service.c_str(), &hints, &info);
+    if (ret != 0) throw std::runtime_error("failed to resolve " + host + ':' + service + ": " + gai_strerror(ret));
+    const std::unique_ptr<struct addrinfo, decltype(&freeaddrinfo)> info_guard(info, &freeaddrinfo);
+
+    this->connections.resize(connections);
+    try {
+        for (auto &con : this->connections) {
+            con.fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+            if (con.fd == -1) throw std::system_error(errno, std::generic_category(), "Failed to create socket");
+
+            if (connect(con.fd, info->ai_addr, info->ai_addrlen) == -1)
+                throw std::system_error(errno, std::generic_category(), "Failed to connect to " + host + ':' + service);
+
+            int nodelay = 1;
+            if (setsockopt(con.fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1)
+                throw std::system_error(errno, std::generic_category(), "Failed to set TCP_NODELAY");
+
+            const auto flags = fcntl(con.fd, F_GETFL);
+            if (flags == -1 || fcntl(con.fd, F_SETFL, flags | O_NONBLOCK) == -1)  // NOLINT
+                throw std::system_error(errno, std::generic_category(), "Failed to set O_NONBLOCK");
+        }
+    } catch (...) {
+        for (const auto &con : this->connections)
+            if (con.fd != -1) close(con.fd);
+        throw;
+    }
+}
+
+Load_Worker::~Load_Worker() {
+    for (const auto &con : connections)
+        close(con.fd);
+}
+
+void Load_Worker::run(time_point_t start, time_point_t measure, time_point_t end) {
+    const bool open_loop = interval != clock_t::duration::zero();
+
+    // spread the requests of the connections over the interval
+    for (std::size_t i = 0; i < connections.size(); ++i)
+        connections[i].next_send = start + interval * i / connections.size();
+
+    std::vector<struct pollfd> fds(connections.size());
+    while (true) {
+        auto now = clock_t::now();
+        if (now >= end) break;
+
+        auto wakeup = end;
+        for (std::size_t i = 0; i < connections.size(); ++i) {
+            auto &con = connections[i];
+            if (open_loop) {
+                while (con.pending.size() < pipeline && con.next_send <= now) {
+                    send_request(con, con.next_send);
+                    con.next_send += interval;
+                }
+                if (con.pending.size() < pipeline) wakeup = std::min(wakeup, con.next_send);
+            } else {
+                while (con.pending.size() < pipeline)
+                    send_request(con, now);
+            }
+            flush(con);
+
+            fds[i].fd     = con.fd;
+            fds[i].events = con.tx_offset < con.tx_buffer.size() ? POLLIN | POLLOUT : POLLIN;
+        }
+
+        const auto      wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(wakeup - now, {}));
+        struct timespec timeout {};
+        timeout.tv_sec  = wait.count() / NS_PER_S;
+        timeout.tv_nsec = wait.count() % NS_PER_S;
+        if (ppoll(fds.data(), fds.size(), &timeout, nullptr) == -1) {
+            if (errno == EINTR) continue;
+            throw std::system_error(errno, std::generic_category(), "ppoll failed");
+        }
+
+        for (std::size_t i = 0; i < connections.size(); ++i)
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) receive(connections[i], measure);
+    }
+
+    // requests without response (including the requests that could not be sent in time)
+    for (const auto &con : connections) {
+        result.outstanding += con.pending.size();
+        if (open_loop && con.next_send < end)
+            result.outstanding += static_cast<std::uint64_t>((end - con.next_send) / interval) + 1;
+    }
+}
+
+void Load_Worker::send_request(connection_t &con, time_point_t scheduled) {
+    const auto request        = mix.next(random);
+    const auto transaction_id = con.next_id++;
+    Request_Mix::encode(request, transaction_id, con.tx_buffer);
+    con.pending.push_back({request, transaction_id, scheduled});
+}
+
+void Load_Worker::flush(connection_t &con) {
+    while (con.tx_offset < con.tx_buffer.size()) {
+        const auto ret =
+                send(con.fd, con.tx_buffer.data() + con.tx_offset, con.tx_buffer.size() - con.tx_offset, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            throw std::system_error(errno, std::generic_category(), "send failed");
+        }
+        con.tx_offset += static_cast<std::size_t>(ret);
+    }
+
+    con.tx_buffer.clear();
+    con.tx_offset = 0;
+}
+
+void Load_Worker::receive(connection_t &con, time_point_t measure) {
+    while (true) {
+        const auto size = con.rx_buffer.size();
+        con.rx_buffer.resize(size + RECV_SIZE);
+        const auto ret = recv(con.fd, con.rx_buffer.data() + size, RECV_SIZE, 0);
+        con.rx_buffer.resize(size + static_cast<std::size_t>(std::max<ssize_t>(ret, 0)));
+
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            throw std::system_error(errno, std::generic_category(), "recv failed");
+        }
+        if (ret == 0) throw std::runtime_error("connection closed by the server");
+        if (static_cast<std::size_t>(ret) < RECV_SIZE) break;
+    }
+
+    const auto now    = clock_t::now();
+    const bool record = now >= measure;
+
+    // handle all complete ADUs
+    std::size_t offset = 0;
+    while (con.rx_buffer.size() - offset >= Request_Mix::MBAP_SIZE) {
+        const auto length = static_cast<std::size_t>(con.rx_buffer[offset + 4] << 8 | con.rx_buffer[offset + 5]);
+        const auto size   = Request_Mix::MBAP_SIZE - 1 + length;
+        if (length < 2 || size > MAX_ADU_SIZE) throw std::runtime_error("invalid Modbus TCP response (length field)");
+        if (con.rx_buffer.size() - offset < size) break;
+
+        handle_response(con, std::span(con.rx_buffer).subspan(offset, size), now, record);
+        offset += size;
+    }
+    con.rx_buffer.erase(con.rx_buffer.begin(), con.rx_buffer.begin() + static_cast<std::ptrdiff_t>(offset));
+}
+
+void Load_Worker::handle_response(connection_t                 &con,
+                                  std::span<const std::uint8_t> adu,
+                                  time_point_t                  now,
+                                  bool                          record) {
+    const auto transaction_id = static_cast<std::uint16_t>(adu[0] << 8 | adu[1]);
+
+    // the responses of a connection are usually received in the order of the requests
+    const auto pending = std::find_if(con.pending.begin(), con.pending.end(), [transaction_id](const pending_t &p) {
+        return p.transaction_id == transaction_id;
+    });
+    if (pending == con.pending.end()) {
+        if (record) ++result.invalid;
+        return;
+    }
+
+    const auto request = pending->request;
+    const auto start   = pending->start;
+    con.pending.erase(pending);
+    if (!record) return;
+
+    const auto check = Request_Mix::check(request, adu);
+    if (check == Request_Mix::result_t::invalid) {
+        ++result.invalid;
+        return;
+    }
+    if (check == Request_Mix::result_t::exception) ++result.exceptions;
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+    const auto latency = static_cast<std::uint64_t>(elapsed);
+    result.latency.record(latency);
+    result.functions[function_index(request.function)].record(latency);  // NOLINT
+}
+
+}  // namespace Modbus::Load
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Histogram.hpp"
+#include "Request_Mix.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Modbus::Load {
+
+/*! \brief connections of one load generator thread
+ *
+ * Closed loop (rate 0): each connection keeps pipeline requests in flight and sends the next request as soon as a
+ * response is received. The latency is the time between sending the request and receiving the response.
+ *
+ * Open loop (rate > 0): each connection sends requests at fixed intervals, independent of the responses.
+ * The latency is measured from the time the request was scheduled, not from the time it was sent. If the server is too
+ * slow and pipeline requests are in flight, the following requests are sent late and their latency includes the delay
+ * (no coordinated omission).
+ */
+class Load_Worker final {
+public:
+    using clock_t      = std::chrono::steady_clock;
+    using time_point_t = clock_t::time_point;
+
+    //! results of the worker (only valid after run returned)
+    struct result_t {
+        Histogram latency;  //!< latency of all requests (ns)
+
+        //! latency per function code (index: Request_Mix::FUNCTION_CODES)
+        std::array<Histogram, Request_Mix::FUNCTION_CODES.size()> functions;
+
+        std::uint64_t exceptions  = 0;  //!< exception responses
+        std::uint64_t invalid     = 0;  //!< responses that do not match the request
+        std::uint64_t outstanding = 0;  //!< requests that were scheduled but not answered at the end
+    };
+
+private:
+    struct pending_t {
+        Request_Mix::request_t request;         //!< parameters of the request
+        std::uint16_t          transaction_id;  //!< transaction id of the request
+        time_point_t           start;           //!< time the request was sent (open loop: scheduled)
+    };
+
+    struct connection_t {
+        int                       fd = -1;        //!< connected socket
+        std::vector<std::uint8_t> rx_buffer;      //!< received data that is not handled yet
+        std::vector<std::uint8_t> tx_buffer;      //!< requests that are not sent yet
+        std::size_t               tx_offset = 0;  //!< already sent bytes of tx_buffer
+        std::deque<pending_t>     pending;        //!< requests without response (in send order)
+        std::uint16_t             next_id = 0;    //!< next transaction id
+        time_point_t              next_send {};   //!< open loop: time the next request is scheduled
+    };
+
+    const Request_Mix &mix;
+    std::size_t        pipeline;  //!< maximum number of requests in flight per connection
+    clock_t::duration  interval;  //!< open loop: interval between two requests of a connection (0: closed loop)
+
+    std::vector<connection_t> connections;
+    std::mt19937_64           random;
+
+    result_t result;
+
+public:
+    /**
+     * @brief connect to the server
+     *
+     * @param host host of the server
+     * @param service port of the server
+     * @param connections number of connections of this worker
+     * @param pipeline maximum number of requests in flight per connection
+     * @param rate open loop: requests per second of this worker (0: closed loop)
+     * @param mix request generator
+     * @param seed seed of the random number generator
+     *
+     * @exception std::system_error failed to connect
+     */
+    Load_Worker(const std::string &host,
+                const std::string &service,
+                std::size_t        connections,
+                std::size_t        pipeline,
+                double             rate,
+                const Request_Mix &mix,
+                std::uint64_t      seed);
+
+    ~Load_Worker();
+
+    Load_Worker(const Load_Worker &other)            = delete;
+    Load_Worker(Load_Worker &&other)                 = delete;
+    Load_Worker &operator=(const Load_Worker &other) = delete;
+    Load_Worker &operator=(Load_Worker &&other)      = delete;
+
+    /**
+     * @brief generate load until end
+     *
+     * @param start start of the load
+     * @param measure responses that are received before this time are not recorded (warmup)
+     * @param end end of the load
+     *
+     * @exception std::runtime_error connection closed by the server
+     * @exception std::system_error network error
+     */
+    void run(time_point_t start, time_point_t measure, time_point_t end);
+
+    [[nodiscard]] const result_t &get_result() const noexcept { return result; }
+
+private:
+    void send_request(connection_t &con, time_point_t scheduled);
+
+    void flush(connection_t &con);
+
+    void receive(connection_t &con, time_point_t measure);
+
+    void handle_response(connection_t &con, std::span<const std::uint8_t> adu, time_point_t now, bool record);
+};
+
+}  // namespace Modbus::Load
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Request_Mix.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace Modbus::Load {
+
+//* flag of the function code of an exception response
+static constexpr std::uint8_t EXCEPTION_FLAG = 0x80;
+
+//* size of an exception response (MBAP header + function code + exception code)
+static constexpr std::size_t EXCEPTION_SIZE = Request_Mix::MBAP_SIZE + 2;
+
+/**
+ * @brief parse an unsigned integer in the range min .. max
+ */
+static unsigned parse_value(const std::string &str, unsigned min, unsigned max, const char *name) {
+    std::size_t   end   = 0;
+    unsigned long value = 0;
+    try {
+        value = std::stoul(str, &end, 0);
+    } catch (const std::exception &) {
+        throw std::invalid_argument(std::string("invalid ") + name + " '" + str + '\'');
+    }
+    if (end != str.size()) throw std::invalid_argument(std::string("invalid ") + name + " '" + str + '\'');
+    if (value < min || value > max) {
+        throw std::invalid_argument(std::string(name) + " '" + str + "' out of range (" + std::to_string(min) + ".." +
+                                    std::to_string(max) + ')');
+    }
+    return static_cast<unsigned>(value);
+}
+
+/**
+ * @brief parse a value ("5") or a range ("1-10")
+ */
+static std::pair<unsigned, unsigned>
+        parse_range(const std::string &str, unsigned min, unsigned max, const char *name) {
+    const auto separator = str.find('-');
+    if (separator == std::string::npos) {
+        const auto value = parse_value(str, min, max, name);
+        return {value, value};
+    }
+
+    const auto first = parse_value(str.substr(0, separator), min, max, name);
+    const auto last  = parse_value(str.substr(separator + 1), min, max, name);
+    if (first > last) throw std::invalid_argument(std::string("invalid ") + name + " range '" + str + '\'');
+    return {first, last};
+}
+
+/**
+ * @brief append a 16 bit value in big endian byte order
+ */
+static void append16(std::vector<std::uint8_t> &out, unsigned value) {
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+Request_Mix::Request_Mix(const std::string &mix,
+                         const std::string &units,
+                         const std::string &counts,
+                         std::uint16_t      address)
+    : address(address) {
+    std::istringstream stream(mix);
+    std::string        item;
+    while (std::getline(stream, item, ',')) {
+        const auto separator = item.find(':');
+        const auto function  = parse_value(item.substr(0, separator), 1, 0x7F, "function code");
+        const auto weight    = separator == std::string::npos
+                                       ? 1u
+                                       : parse_value(item.substr(separator + 1), 1, 1000000, "function code weight");
+
+        if (std::find(FUNCTION_CODES.begin(), FUNCTION_CODES.end(), function) == FUNCTION_CODES.end())
+            throw std::invalid_argument("function code " + std::to_string(function) + " is not supported");
+
+        entries.push_back({static_cast<std::uint8_t>(function), weight});
+        total_weight += weight;
+    }
+    if (entries.empty()) throw std::invalid_argument("no function code");
+
+    const auto [first_unit, last_unit] = parse_range(units, 0, 0xFF, "unit id");
+    unit_min                           = static_cast<std::uint8_t>(first_unit);
+    unit_max                           = static_cast<std::uint8_t>(last_unit);
+
+    const auto [first_count, last_count] = parse_range(counts, 1, 2000, "register count");
+    count_min                            = static_cast<std::uint16_t>(first_count);
+    count_max                            = static_cast<std::uint16_t>(last_count);
+
+    if (address + count_max > 0x10000)
+        throw std::invalid_argument("start address + register count exceeds the address range");
+}
+
+Request_Mix::request_t Request_Mix::next(std::mt19937_64 &random) const {
+    request_t request;
+
+    // function code
+    auto pick = std::uniform_int_distribution<unsigned>(0, total_weight - 1)(random);
+    for (const auto &entry : entries) {
+        if (pick < entry.weight) {
+            request.function = entry.function;
+            break;
+        }
+        pick -= entry.weight;
+    }
+
+    request.unit    = static_cast<std::uint8_t>(std::uniform_int_distribution<unsigned>(unit_min, unit_max)(random));
+    request.address = address;
+
+    const auto count = std::uniform_int_distribution<unsigned>(count_min, count_max)(random);
+    request.count    = std::min(static_cast<std::uint16_t>(count), max_count(request.function));
+    return request;
+}
+
+void Request_Mix::encode(const request_t &request, std::uint16_t transaction_id, std::vector<std::uint8_t> &out) {
+    const auto start = out.size();
+
+    // MBAP header (length is set after the PDU is complete)
+    append16(out, transaction_id);
+    append16(out, 0);
+    append16(out, 0);
+    out.push_back(request.unit);
+
+    out.push_back(request.function);
+    append16(out, request.address);
+    append16(out, request.count);
+
+    if (request.function == 0x17) {
+        // write the same registers that are read
+        append16(out, request.address);
+        append16(out, request.count);
+    }
+
+    if (request.function == 0x10 || request.function == 0x17) {
+        out.push_back(static_cast<std::uint8_t>(request.count * 2));
+        out.insert(out.end(), static_cast<std::size_t>(request.count) * 2, 0);
+    }
+
+    const auto length = out.size() - start - (MBAP_SIZE - 1);
+    out[start + 4]    = static_cast<std::uint8_t>(length >> 8);
+    out[start + 5]    = static_cast<std::uint8_t>(length);
+}
+
+Request_Mix::result_t Request_Mix::check(const request_t &request, std::span<const std::uint8_t> adu) noexcept {
+    if (adu.size() <= MBAP_SIZE || adu[6] != request.unit) return result_t::invalid;
+
+    const auto function = adu[MBAP_SIZE];
+    if (function == (request.function | EXCEPTION_FLAG))
+        return adu.size() == EXCEPTION_SIZE ? result_t::exception : result_t::invalid;
+    if (function != request.function) return result_t::invalid;
+
+    std::size_t expected = 0;
+    switch (request.function) {
+        case 0x01:
+        case 0x02: expected = MBAP_SIZE + 2 + (request.count + 7u) / 8; break;
+        case 0x03:
+        case 0x04:
+        case 0x17: expected = MBAP_SIZE + 2 + request.count * 2u; break;
+        case 0x10: expected = MBAP_SIZE + 5; break;
+        default: return result_t::invalid;
+    }
+
+    return adu.size() == expected ? result_t::ok : result_t::invalid;
+}
+
+std::uint16_t Request_Mix::max_count(std::uint8_t function) noexcept {
+    switch (function) {
+        case 0x01:
+        case 0x02: return 2000;
+        case 0x03:
+        case 0x04: return 125;
+        case 0x10: return 123;
+        case 0x17: return 121;
+        default: return 0;
+    }
+}
+
+std::string Request_Mix::describe() const {
+    std::ostringstream out;
+    for (const auto &entry : entries) {
+        if (&entry != &entries.front()) out << ", ";
+        out << "FC " << static_cast<unsigned>(entry.function) << " ("
+            << static_cast<double>(entry.weight) * 100.0 / static_cast<double>(total_weight) << "%)";
+    }
+
+    out << "; unit id " << static_cast<unsigned>(unit_min);
+    if (unit_max != unit_min) out << '-' << static_cast<unsigned>(unit_max);
+    out << "; " << count_min;
+    if (count_max != count_min) out << '-' << count_max;
+    out << " registers at address " << address;
+    return out.str();
+}
+
+}  // namespace Modbus::Load
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Modbus::Load {
+
+/*! \brief generates the requests of the load generator (function code mix, unit ids and register counts)
+ *
+ * The mix is a comma separated list of function codes with optional weights (e.g. "3:70,4:10,1:10,16:5,23:5").
+ * Unit ids and register counts are either a single value or a range ("1-10") of which a value is picked uniformly.
+ * Register counts are limited to the maximum of the function code.
+ */
+class Request_Mix final {
+public:
+    //! supported function codes
+    static constexpr std::array<std::uint8_t, 6> FUNCTION_CODES = {0x01, 0x02, 0x03, 0x04, 0x10, 0x17};
+
+    //! size of the MBAP header
+    static constexpr std::size_t MBAP_SIZE = 7;
+
+    //! parameters of one request
+    struct request_t {
+        std::uint8_t  function = 0;  //!< function code
+        std::uint8_t  unit     = 0;  //!< unit id
+        std::uint16_t address  = 0;  //!< start address
+        std::uint16_t count    = 0;  //!< number of coils/registers
+    };
+
+    //! result of the response check
+    enum class result_t { ok, exception, invalid };
+
+private:
+    struct entry_t {
+        std::uint8_t function;  //!< function code
+        unsigned     weight;    //!< relative weight
+    };
+
+    std::vector<entry_t> entries;           //!< function codes of the mix
+    unsigned             total_weight = 0;  //!< sum of all weights
+
+    std::uint8_t  unit_min;   //!< smallest unit id
+    std::uint8_t  unit_max;   //!< largest unit id
+    std::uint16_t count_min;  //!< smallest number of coils/registers
+    std::uint16_t count_max;  //!< largest number of coils/registers
+    std::uint16_t address;    //!< start address of all requests
+
+public:
+    /**
+     * @brief parse the request settings
+     *
+     * @param mix function codes with optional weights (e.g. "3:70,16:30")
+     * @param units unit id or unit id range (e.g. "1-10")
+     * @param counts number of coils/registers or range (e.g. "1-125")
+     * @param address start address of all requests
+     *
+     * @exception std::invalid_argument invalid setting
+     */
+    Request_Mix(const std::string &mix, const std::string &units, const std::string &counts, std::uint16_t address);
+
+    /**
+     * @brief pick the parameters of the next request
+     */
+    [[nodiscard]] request_t next(std::mt19937_64 &random) const;
+
+    /**
+     * @brief append the ADU of a request
+     *
+     * @param request request parameters
+     * @param transaction_id transaction id of the MBAP header
+     * @param out buffer the ADU is appended to
+     */
+    static void encode(const request_t &request, std::uint16_t transaction_id, std::vector<std::uint8_t> &out);
+
+    /**
+     * @brief check a response ADU
+     *
+     * @param request parameters of the request
+     * @param adu complete response ADU (including the MBAP header)
+     */
+    [[nodiscard]] static result_t check(const request_t &request, std::span<const std::uint8_t> adu) noexcept;
+
+    /**
+     * @brief get the maximum number of coils/registers of a function code
+     */
+    [[nodiscard]] static std::uint16_t max_count(std::uint8_t function) noexcept;
+
+    /**
+     * @brief get a human readable description of the requests (e.g. for the output of the results)
+     */
+    [[nodiscard]] std::string describe() const;
+};
+
+}  // namespace Modbus::Load
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Load_Worker.hpp"
+#include "Print_Time.hpp"
+#include "Request_Mix.hpp"
+
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sys/ioctl.h>
+#include <sysexits.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifdef COMPILER_CLANG
+#    pragma clang diagnostic push
+#    pragma clang diagnostic ignored "-Weverything"
+#elif defined(COMPILER_GCC)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wall"
+#endif
+
+#include <cxxopts.hpp>
+
+#ifdef COMPILER_CLANG
+#    pragma clang diagnostic pop
+#elif defined(COMPILER_GCC)
+#    pragma GCC diagnostic pop
+#endif
+
+//* time between the creation of the threads and the start of the load
+static constexpr auto START_DELAY = std::chrono::milliseconds(10);
+
+/**
+ * @brief print p50, p99, p99.9 and max of a latency histogram (ns) in microseconds
+ */
+static void print_latency(std::ostream &out, const Modbus::Histogram &histogram) {
+    static constexpr double NS_PER_US = 1000.0;
+    out << std::fixed << std::setprecision(1);
+    out << "p50 " << std::setw(9) << static_cast<double>(histogram.percentile(0.5)) / NS_PER_US << "us  p99 "
+        << std::setw(9) << static_cast<double>(histogram.percentile(0.99)) / NS_PER_US << "us  p99.9 " << std::setw(9)
+        << static_cast<double>(histogram.percentile(0.999)) / NS_PER_US << "us  max " << std::setw(9)
+        << static_cast<double>(histogram.max()) / NS_PER_US << "us";
+}
+
+/*! \brief main function
+ *
+ * @param argc number of arguments
+ * @param argv arguments as char* array
+ * @return exit code
+ */
+int main(int argc, char **argv) {
+    const std::string exe_name = std::filesystem::path(argv[0]).filename().string();  // NOLINT
+    cxxopts::Options  options(exe_name, "Modbus/TCP load generator (throughput and latency of a Modbus/TCP server)");
+
+    auto exit_usage = [&exe_name]() {
+        std::cerr << "Use '" << exe_name << " --help' for more information.\n";
+        return EX_USAGE;
+    };
+
+    options.add_options("network")(
+            "i,host", "host of the Modbus/TCP server", cxxopts::value<std::string>()->default_value("127.0.0.1"));
+    options.add_options("network")("p,service",
+                                   "service or port of the Modbus/TCP server",
+                                   cxxopts::value<std::string>()->default_value("502"));
+    options.add_options("network")(
+            "c,connections", "number of simultaneous connections", cxxopts::value<std::size_t>()->default_value("1"));
+    options.add_options("network")("threads",
+                                   "number of threads. The connections are distributed between the threads.",
+                                   cxxopts::value<std::size_t>()->default_value("1"));
+    options.add_options("load")("pipeline",
+                                "maximum number of requests in flight per connection",
+                                cxxopts::value<std::size_t>()->default_value("1"));
+    options.add_options("load")("rate",
+                                "open loop: requests per second of all connections. The requests are sent at fixed "
+                                "intervals and the latency is measured from the scheduled time (no coordinated "
+                                "omission). 0: closed loop (the next request is sent as soon as a response is "
+                                "received)",
+                                cxxopts::value<double>()->default_value("0"));
+    options.add_options("load")(
+            "d,duration", "duration of the measurement in seconds", cxxopts::value<double>()->default_value("10"));
+    options.add_options("load")("warmup",
+                                "load in seconds before the measurement starts (not recorded)",
+                                cxxopts::value<double>()->default_value("1"));
+    options.add_options("load")(
+            "seed", "seed of the random request generator", cxxopts::value<std::uint64_t>()->default_value("1"));
+    options.add_options("requests")("f,functions",
+                                    "function codes with optional weights. Supported: 1, 2, 3, 4, 16 and 23 "
+                                    "(e.g. 3:70,4:10,1:10,16:5,23:5)",
+                                    cxxopts::value<std::string>()->default_value("3"));
+    options.add_options("requests")("u,unit-ids",
+                                    "unit id or range of unit ids (e.g. 1-10). Each request uses a random unit id.",
+                                    cxxopts::value<std::string>()->default_value("1"));
+    options.add_options("requests")("registers",
+                                    "number of coils/registers per request or range (e.g. 1-125). Limited to the "
+                                    "maximum of the function code.",
+                                    cxxopts::value<std::string>()->default_value("10"));
+    options.add_options("requests")("address",
+                                    "start address of all requests. FC 16 and 23 write zeros to the registers!",
+                                    cxxopts::value<std::uint16_t>()->default_value("0"));
+    options.add_options("other")("h,help", "print usage");
+    options.add_options("other")("version", "print version and exit");
+
+    // parse arguments
+    cxxopts::ParseResult args;
+    try {
+        args = options.parse(argc, argv);
+    } catch (cxxopts::exceptions::parsing::exception &e) {
+        std::cerr << Print_Time::iso << " ERROR: Failed to parse arguments: " << e.what() << ".'\n";
+        return exit_usage();
+    }
+
+    // print usage
+    if (args.count("help")) {
+        static constexpr std::size_t MIN_HELP_SIZE = 80;
+        if (isatty(STDIN_FILENO)) {
+            struct winsize w {};
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != -1) {  // NOLINT
+                options.set_width(std::max(static_cast<decltype(w.ws_col)>(MIN_HELP_SIZE), w.ws_col));
+            }
+        } else {
+            options.set_width(MIN_HELP_SIZE);
+        }
+
+        std::cout << options.help() << '\n';
+        std::cout << "The load generator reports the throughput and the latency (p50, p99, p99.9 and max) of all "
+                     "requests and per function code.\n";
+        std::cout << "Use a closed loop (--rate 0) to measure the maximum throughput and an open loop (--rate) to "
+                     "measure the latency at a given load.\n";
+        return EX_OK;
+    }
+
+    if (args.count("version")) {
+        std::cout << PROJECT_VERSION << '\n';
+        return EX_OK;
+    }
+
+    const auto CONNECTIONS = args["connections"].as<std::size_t>();
+    const auto THREADS     = std::min(args["threads"].as<std::size_t>(), CONNECTIONS);
+    const auto PIPELINE    = args["pipeline"].as<std::size_t>();
+    const auto RATE        = args["rate"].as<double>();
+    const auto DURATION    = args["duration"].as<double>();
+    const auto WARMUP      = args["warmup"].as<double>();
+    if (CONNECTIONS == 0 || THREADS == 0 || PIPELINE == 0) {
+        std::cerr << Print_Time::iso << " ERROR: --connections, --threads and --pipeline must not be 0" << '\n';
+        return exit_usage();
+    }
+    if (RATE < 0 || DURATION <= 0 || WARMUP < 0) {
+        std::cerr << Print_Time::iso << " ERROR: invalid --rate, --duration or --warmup" << '\n';
+        return exit_usage();
+    }
+
+    std::unique_ptr<Modbus::Load::Request_Mix> mix;
+    try {
+        mix = std::make_unique<Modbus::Load::Request_Mix>(args["functions"].as<std::string>(),
+                                                          args["unit-ids"].as<std::string>(),
+                                                          args["registers"].as<std::string>(),
+                                                          args["address"].as<std::uint16_t>());
+    } catch (const std::invalid_argument &e) {
+        std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+        return exit_usage();
+    }
+
+    // connect (the connections and the rate are distributed between the threads)
+    std::vector<std::unique_ptr<Modbus::Load::Load_Worker>> workers;
+    try {
+        for (std::size_t i = 0; i < THREADS; ++i) {
+            const auto connections = CONNECTIONS / THREADS + (i < CONNECTIONS % THREADS ? 1 : 0);
+            workers.emplace_back(std::make_unique<Modbus::Load::Load_Worker>(
+                    args["host"].as<std::string>(),
+                    args["service"].as<std::string>(),
+                    connections,
+                    PIPELINE,
+                    RATE * static_cast<double>(connections) / static_cast<double>(CONNECTIONS),
+                    *mix,
+                    args["seed"].as<std::uint64_t>() + i));
+        }
+    } catch (const std::exception &e) {
+        std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+        return EX_UNAVAILABLE;
+    }
+
+    std::cout << "Modbus/TCP load: " << args["host"].as<std::string>() << ':' << args["service"].as<std::string>()
+              << ", " << CONNECTIONS << " connections (" << THREADS << " threads), pipeline depth " << PIPELINE << ", ";
+    if (RATE > 0) std::cout << "open loop (" << RATE << " requests/s)";
+    else
+        std::cout << "closed loop";
+    std::cout << '\n';
+    std::cout << "requests: " << mix->describe() << '\n';
+    std::cout << "duration: " << DURATION << "s (after " << WARMUP << "s warmup)" << '\n' << std::endl;  // NOLINT
+
+    using clock_t    = Modbus::Load::Load_Worker::clock_t;
+    auto to_duration = [](double seconds) {
+        return std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double>(seconds));
+    };
+    const auto start   = clock_t::now() + START_DELAY;
+    const auto measure = start + to_duration(WARMUP);
+    const auto end     = measure + to_duration(DURATION);
+
+    std::vector<std::exception_ptr> errors(THREADS);
+    std::vector<std::thread>        threads;
+    threads.reserve(THREADS);
+    for (std::size_t i = 0; i < THREADS; ++i) {
+        threads.emplace_back([&workers, &errors, i, start, measure, end]() {
+            try {
+                workers[i]->run(start, measure, end);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    for (const auto &error : errors) {
+        if (!error) continue;
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception &e) {
+            std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+            return EX_UNAVAILABLE;
+        }
+    }
+
+    // combine the results of all threads
+    const auto &functions = Modbus::Load::Request_Mix::FUNCTION_CODES;
+
+    Modbus::Histogram              latency;
+    std::vector<Modbus::Histogram> function_latency(functions.size());
+    std::uint64_t                  exceptions  = 0;
+    std::uint64_t                  invalid     = 0;
+    std::uint64_t                  outstanding = 0;
+    for (const auto &worker : workers) {
+        const auto &result = worker->get_result();
+        latency.merge(result.latency);
+        for (std::size_t i = 0; i < functions.size(); ++i)
+            function_latency[i].merge(result.functions[i]);  // NOLINT
+        exceptions += result.exceptions;
+        invalid += result.invalid;
+        outstanding += result.outstanding;
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "responses   " << latency.count() << " (" << static_cast<double>(latency.count()) / DURATION
+              << " per second)\n";
+    std::cout << "exceptions  " << exceptions << '\n';
+    std::cout << "invalid     " << invalid << '\n';
+    std::cout << "outstanding " << outstanding << '\n';
+    std::cout << "latency     ";
+    print_latency(std::cout, latency);
+    std::cout << '\n';
+    for (std::size_t i = 0; i < functions.size(); ++i) {
+        if (function_latency[i].count() == 0) continue;
+        std::cout << "  FC " << std::setw(2) << static_cast<unsigned>(functions[i]) << "     ";  // NOLINT
+        print_latency(std::cout, function_latency[i]);
+        std::cout << "  (" << function_latency[i].count() << " responses)\n";
+    }
+    std::cout << std::flush;
+
+    return invalid ? EX_PROTOCOL : EX_OK;
+}
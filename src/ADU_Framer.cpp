@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "ADU_Framer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Modbus::TCP {
+
+//* smallest valid value of the MBAP length field (unit id + function code)
+static constexpr std::size_t MIN_MBAP_LENGTH = 2;
+
+//* largest valid value of the MBAP length field (unit id + maximum PDU)
+static constexpr std::size_t MAX_MBAP_LENGTH = MODBUS_TCP_MAX_ADU_LENGTH - 6;
+
+std::span<std::uint8_t> ADU_Framer::free_space() {
+    if (begin != 0) {
+        const auto size = end - begin;
+        std::memmove(buffer.data(), buffer.data() + begin, size);  // NOLINT
+        begin = 0;
+        end   = size;
+    }
+
+    return {buffer.data() + end, buffer.size() - end};  // NOLINT
+}
+
+std::size_t ADU_Framer::append(std::span<const std::uint8_t> data) {
+    auto       space = free_space();
+    const auto count = std::min(space.size(), data.size());
+    std::memcpy(space.data(), data.data(), count);
+    commit(count);
+    return count;
+}
+
+ADU_Framer::result_t ADU_Framer::next(std::span<const std::uint8_t> &adu) noexcept {
+    const auto available = end - begin;
+    if (available < MBAP_HEADER_SIZE) return result_t::incomplete;
+
+    const auto *header = buffer.data() + begin;  // NOLINT
+
+    // protocol identifier (must be 0 for Modbus)
+    if (header[2] != 0 || header[3] != 0) return result_t::invalid;  // NOLINT
+
+    // length of the remaining ADU (unit id + PDU)
+    const auto length = static_cast<std::size_t>(header[4]) << 8U | header[5];  // NOLINT
+    if (length < MIN_MBAP_LENGTH || length > MAX_MBAP_LENGTH) return result_t::invalid;
+
+    const auto adu_size = MBAP_HEADER_SIZE - 1 + length;
+    if (available < adu_size) return result_t::incomplete;
+
+    adu = {header, adu_size};
+    begin += adu_size;
+    return result_t::complete;
+}
+
+}  // namespace Modbus::TCP
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <modbus/modbus.h>
+#include <span>
+
+namespace Modbus::TCP {
+
+/*! \brief receive buffer that splits a Modbus/TCP byte stream into ADUs
+ *
+ * Received data is appended to the buffer. Complete ADUs are detected using the length field of the MBAP header.
+ * Incomplete ADUs remain in the buffer until the missing bytes are appended.
+ */
+class ADU_Framer final {
+public:
+    //! size of the MBAP header (transaction id, protocol id, length, unit id)
+    static constexpr std::size_t MBAP_HEADER_SIZE = 7;
+
+    //! size of the receive buffer (space for 16 pipelined ADUs of maximum size)
+    static constexpr std::size_t BUFFER_SIZE = 16 * MODBUS_TCP_MAX_ADU_LENGTH;
+
+    enum class result_t : std::uint8_t {
+        complete,    //!< a complete ADU is available
+        incomplete,  //!< more data is required
+        invalid      //!< the data is not a valid Modbus/TCP ADU
+    };
+
+private:
+    std::array<std::uint8_t, BUFFER_SIZE> buffer {};
+    std::size_t                           begin = 0;  //!< index of the first unprocessed byte
+    std::size_t                           end   = 0;  //!< index behind the last received byte
+
+public:
+    /*! \brief get the free space at the end of the buffer
+     *
+     * @details already processed data is discarded to maximize the free space.
+     *
+     * @return writable buffer area (call commit() after writing to it)
+     */
+    std::span<std::uint8_t> free_space();
+
+    /*! \brief mark bytes that were written to free_space() as received
+     *
+     * @param count number of bytes
+     */
+    void commit(std::size_t count) noexcept { end += count; }
+
+    /*! \brief append received data
+     *
+     * @param data received data
+     * @return number of bytes that were appended (less than data.size() if the buffer is full)
+     */
+    std::size_t append(std::span<const std::uint8_t> data);
+
+    /*! \brief extract the next complete ADU
+     *
+     * @param adu set to the ADU if result_t::complete is returned. Valid until free_space() or append() is called
+     * @return result
+     */
+    result_t next(std::span<const std::uint8_t> &adu) noexcept;
+
+    /*! \brief return the ADU that was extracted by the last call of next() to the buffer
+     *
+     * @details the ADU is extracted again by the next call of next()
+     *
+     * @param adu ADU that was returned by next()
+     */
+    void unget(std::span<const std::uint8_t> adu) noexcept { begin -= adu.size(); }
+
+    /*! \brief check if the buffer contains unprocessed data
+     *
+     * @return true if there is buffered data
+     */
+    [[nodiscard]] bool pending() const noexcept { return begin != end; }
+};
+
+}  // namespace Modbus::TCP
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Address_Map.hpp"
+
+#include <stdexcept>
+
+namespace Modbus {
+
+//* number of Modbus addresses
+static constexpr std::size_t ADDRESSES = 0x10000;
+
+Address_Map::Address_Map(std::vector<Address_Window> windows) {
+    if (windows.empty()) throw std::invalid_argument("no address windows");
+
+    std::sort(windows.begin(), windows.end(), [](const Address_Window &a, const Address_Window &b) {
+        return a.start < b.start;
+    });
+
+    for (const auto &window : windows) {
+        if (!window.count || window.start >= ADDRESSES || window.count > ADDRESSES - window.start) {
+            throw std::invalid_argument("invalid address window " + std::to_string(window.start) + ':' +
+                                        std::to_string(window.count));
+        }
+
+        const auto start = static_cast<int>(window.start);
+        const auto end   = static_cast<int>(window.start + window.count);
+        if (!ranges.empty() && start < ranges.back().end) {
+            throw std::invalid_argument("address window " + std::to_string(window.start) + ':' +
+                                        std::to_string(window.count) + " overlaps with another window");
+        }
+
+        // adjacent windows: requests may span both windows
+        if (!ranges.empty() && start == ranges.back().end) ranges.back().end = end;
+        else
+            ranges.push_back({start, end, static_cast<int>(size)});
+
+        size += window.count;
+    }
+}
+
+Address_Map Address_Map::parse(const std::vector<std::string> &windows) {
+    std::vector<Address_Window> parsed;
+    parsed.reserve(windows.size());
+
+    for (const auto &window : windows) {
+        const auto separator = window.find(':');
+        bool       fail      = separator == std::string::npos;
+
+        std::size_t start = 0;
+        std::size_t count = 0;
+        if (!fail) {
+            try {
+                std::size_t idx_start = 0;
+                std::size_t idx_count = 0;
+                const auto  count_str = window.substr(separator + 1);
+                start                 = std::stoul(window.substr(0, separator), &idx_start, 0);
+                count                 = std::stoul(count_str, &idx_count, 0);
+                fail                  = idx_start != separator || idx_count != count_str.size();
+            } catch (const std::exception &) { fail = true; }
+        }
+
+        if (fail) throw std::invalid_argument("invalid address window \"" + window + "\" (expected start:count)");
+        parsed.push_back({start, count});
+    }
+
+    return Address_Map(std::move(parsed));
+}
+
+}  // namespace Modbus
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Modbus {
+
+//! range of Modbus addresses that is stored in a register table
+struct Address_Window {
+    std::size_t start;  //!< first address
+    std::size_t count;  //!< number of registers
+};
+
+/*! \brief mapping of sparse Modbus addresses to a compact register table
+ *
+ * The registers of all windows are stored consecutively in ascending order of their addresses.
+ * Requests must be completely inside one window (adjacent windows are merged).
+ */
+class Address_Map final {
+private:
+    //! merged window
+    struct range_t {
+        int start;   //!< first address
+        int end;     //!< last address + 1
+        int offset;  //!< index of the first register in the table
+    };
+
+    std::vector<range_t> ranges;    //!< sorted by start address
+    std::size_t          size = 0;  //!< number of registers in the table
+
+public:
+    /*! \brief create the mapping
+     *
+     * @param windows address windows (any order, must not overlap)
+     * @exception std::invalid_argument invalid or overlapping windows
+     */
+    explicit Address_Map(std::vector<Address_Window> windows);
+
+    /*! \brief parse a list of address windows
+     *
+     * @param windows windows in the format start:count (e.g. 1000:100). Decimal or hex (0x) values.
+     * @return mapping
+     * @exception std::invalid_argument invalid format or windows
+     */
+    static Address_Map parse(const std::vector<std::string> &windows);
+
+    /*! \brief get the table index of a range of addresses
+     *
+     * @param address first address
+     * @param nb number of registers (> 0)
+     * @return index of the first register in the table or -1 if the range is not completely inside one window
+     */
+    [[nodiscard]] int translate(int address, int nb) const noexcept {
+        // last window that starts at or before the address (binary search)
+        const auto it = std::upper_bound(
+                ranges.begin(), ranges.end(), address, [](int a, const range_t &r) { return a < r.start; });
+        if (it == ranges.begin()) return -1;
+
+        const auto &range = *std::prev(it);
+        if (address + nb > range.end) return -1;
+        return range.offset + (address - range.start);
+    }
+
+    //! number of registers in the table
+    [[nodiscard]] std::size_t get_size() const noexcept { return size; }
+};
+
+}  // namespace Modbus
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Bit_Pack.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define BIT_PACK_X86
+#endif
+
+namespace Modbus::PDU::Bits {
+
+//* bits per byte
+static constexpr unsigned BYTE_BITS = 8;
+
+//* all bits of a byte set
+static constexpr unsigned BYTE_MASK = 0xFF;
+
+/*! \brief funnel shift kernel
+ *
+ * dst[i] = (lo[i] >> shift) | (hi[i] << (8 - shift))
+ *
+ * @param lo source of the low bits of each destination byte
+ * @param hi source of the high bits of each destination byte
+ * @param shift shift count (1 .. 7)
+ * @param dst destination
+ * @param n number of bytes
+ */
+using funnel_t =
+        void (*)(const std::uint8_t *lo, const std::uint8_t *hi, unsigned shift, std::uint8_t *dst, std::size_t n);
+
+/*! \brief unpack kernel
+ *
+ * dst[i] = (src[i / 8] >> (i % 8)) & 1
+ *
+ * @param src source
+ * @param nb number of bits
+ * @param dst destination
+ */
+using unpack_t = void (*)(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst);
+
+static void funnel_scalar(
+        const std::uint8_t *lo, const std::uint8_t *hi, unsigned shift, std::uint8_t *dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+        dst[i] = static_cast<std::uint8_t>(lo[i] >> shift | hi[i] << (BYTE_BITS - shift));  // NOLINT
+}
+
+static void unpack_scalar(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    for (std::size_t i = 0; i < nb; ++i)
+        dst[i] = (src[i / BYTE_BITS] >> (i % BYTE_BITS)) & 1U;  // NOLINT
+}
+
+#ifdef __SSE2__
+static void
+        funnel_sse2(const std::uint8_t *lo, const std::uint8_t *hi, unsigned shift, std::uint8_t *dst, std::size_t n) {
+    static constexpr std::size_t WIDTH = sizeof(__m128i);
+
+    // there are no 8 bit shifts: shift 16 bit lanes and remove the bits that crossed a byte boundary
+    const __m128i count_lo = _mm_cvtsi32_si128(static_cast<int>(shift));
+    const __m128i count_hi = _mm_cvtsi32_si128(static_cast<int>(BYTE_BITS - shift));
+    const __m128i mask_lo  = _mm_set1_epi8(static_cast<char>(BYTE_MASK >> shift));
+    const __m128i mask_hi  = _mm_set1_epi8(static_cast<char>((BYTE_MASK << (BYTE_BITS - shift)) & BYTE_MASK));
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lo + i));  // NOLINT
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hi + i));  // NOLINT
+        const __m128i r = _mm_or_si128(_mm_and_si128(_mm_srl_epi16(a, count_lo), mask_lo),
+                                       _mm_and_si128(_mm_sll_epi16(b, count_hi), mask_hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), r);  // NOLINT
+    }
+
+    funnel_scalar(lo + i, hi + i, shift, dst + i, n - i);  // NOLINT
+}
+
+static void unpack_sse2(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    static constexpr std::size_t WIDTH = sizeof(__m128i);
+
+    // byte i of each 8 byte group selects bit i
+    const __m128i select = _mm_set1_epi64x(static_cast<long long>(0x8040201008040201ULL));  // NOLINT
+    const __m128i one    = _mm_set1_epi8(1);
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= nb; i += WIDTH) {
+        std::uint16_t bits;  // NOLINT
+        std::memcpy(&bits, src + i / BYTE_BITS, sizeof(bits));  // NOLINT
+
+        // broadcast the first byte to the lower 8 bytes and the second byte to the upper 8 bytes
+        __m128i v = _mm_cvtsi32_si128(bits);
+        v         = _mm_unpacklo_epi8(v, v);
+        v         = _mm_unpacklo_epi16(v, v);
+        v         = _mm_unpacklo_epi32(v, v);
+
+        const __m128i r = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, select), select), one);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), r);  // NOLINT
+    }
+
+    unpack_scalar(src + i / BYTE_BITS, nb - i, dst + i);  // NOLINT
+}
+#endif
+
+#ifdef BIT_PACK_X86
+__attribute__((target("avx2"))) static void
+        funnel_avx2(const std::uint8_t *lo, const std::uint8_t *hi, unsigned shift, std::uint8_t *dst, std::size_t n) {
+    static constexpr std::size_t WIDTH = sizeof(__m256i);
+
+    const __m128i count_lo = _mm_cvtsi32_si128(static_cast<int>(shift));
+    const __m128i count_hi = _mm_cvtsi32_si128(static_cast<int>(BYTE_BITS - shift));
+    const __m256i mask_lo  = _mm256_set1_epi8(static_cast<char>(BYTE_MASK >> shift));
+    const __m256i mask_hi  = _mm256_set1_epi8(static_cast<char>((BYTE_MASK << (BYTE_BITS - shift)) & BYTE_MASK));
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lo + i));  // NOLINT
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hi + i));  // NOLINT
+        const __m256i r = _mm256_or_si256(_mm256_and_si256(_mm256_srl_epi16(a, count_lo), mask_lo),
+                                          _mm256_and_si256(_mm256_sll_epi16(b, count_hi), mask_hi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);  // NOLINT
+    }
+
+    funnel_scalar(lo + i, hi + i, shift, dst + i, n - i);  // NOLINT
+}
+
+__attribute__((target("avx2"))) static void unpack_avx2(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    static constexpr std::size_t WIDTH = sizeof(__m256i);
+
+    // byte i of each 8 byte group selects bit i
+    const __m256i select = _mm256_set1_epi64x(static_cast<long long>(0x8040201008040201ULL));  // NOLINT
+    const __m256i one    = _mm256_set1_epi8(1);
+
+    // the shuffle works within 128 bit lanes: lane 0 expands bytes 0 and 1, lane 1 expands bytes 2 and 3
+    const __m256i expand = _mm256_setr_epi8(
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= nb; i += WIDTH) {
+        std::uint32_t bits;  // NOLINT
+        std::memcpy(&bits, src + i / BYTE_BITS, sizeof(bits));  // NOLINT
+
+        const __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(bits)), expand);
+        const __m256i r = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, select), select), one);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), r);  // NOLINT
+    }
+
+    unpack_scalar(src + i / BYTE_BITS, nb - i, dst + i);  // NOLINT
+}
+#endif
+
+bool is_supported(isa_t isa) noexcept {
+    switch (isa) {
+        case isa_t::scalar: return true;
+#ifdef __SSE2__
+        case isa_t::sse2: return true;
+#else
+        case isa_t::sse2: return false;
+#endif
+#ifdef BIT_PACK_X86
+        case isa_t::avx2: return __builtin_cpu_supports("avx2");
+#else
+        case isa_t::avx2: return false;
+#endif
+        default: return false;
+    }
+}
+
+static funnel_t get_funnel(isa_t isa) {
+#ifdef BIT_PACK_X86
+    if (isa == isa_t::avx2) return &funnel_avx2;
+#endif
+#ifdef __SSE2__
+    if (isa == isa_t::sse2) return &funnel_sse2;
+#endif
+    static_cast<void>(isa);
+    return &funnel_scalar;
+}
+
+static unpack_t get_unpack(isa_t isa) {
+#ifdef BIT_PACK_X86
+    if (isa == isa_t::avx2) return &unpack_avx2;
+#endif
+#ifdef __SSE2__
+    if (isa == isa_t::sse2) return &unpack_sse2;
+#endif
+    static_cast<void>(isa);
+    return &unpack_scalar;
+}
+
+static isa_t select_isa() {
+    if (is_supported(isa_t::avx2)) return isa_t::avx2;
+    if (is_supported(isa_t::sse2)) return isa_t::sse2;
+    return isa_t::scalar;
+}
+
+//* kernels for the cpu the program is running on
+static const isa_t    SELECTED_ISA = select_isa();
+static const funnel_t FUNNEL       = get_funnel(SELECTED_ISA);
+static const unpack_t UNPACK       = get_unpack(SELECTED_ISA);
+
+isa_t selected() noexcept {
+    return SELECTED_ISA;
+}
+
+//! extract using the given funnel shift kernel
+static void
+        extract_bits(funnel_t funnel, const std::uint8_t *src, std::size_t offset, std::size_t nb, std::uint8_t *dst) {
+    const std::size_t first = offset / BYTE_BITS;
+    const unsigned    shift = offset % BYTE_BITS;
+    const std::size_t size  = (nb + BYTE_BITS - 1) / BYTE_BITS;
+
+    if (shift == 0) {
+        std::memcpy(dst, src + first, size);  // NOLINT
+    } else {
+        // destination bytes whose high bits are located in the following source byte
+        const std::size_t last    = (offset + nb - 1) / BYTE_BITS;
+        const std::size_t n_shift = last - first;
+
+        funnel(src + first, src + first + 1, shift, dst, n_shift);  // NOLINT
+        if (n_shift < size) dst[size - 1] = static_cast<std::uint8_t>(src[last] >> shift);  // NOLINT
+    }
+
+    const auto tail = nb % BYTE_BITS;
+    if (tail) dst[size - 1] &= static_cast<std::uint8_t>((1U << tail) - 1);  // NOLINT
+}
+
+//! insert using the given funnel shift kernel
+static void
+        insert_bits(funnel_t funnel, std::uint8_t *dst, std::size_t offset, std::size_t nb, const std::uint8_t *src) {
+    const std::size_t first = offset / BYTE_BITS;
+    const std::size_t last  = (offset + nb - 1) / BYTE_BITS;
+    const unsigned    shift = offset % BYTE_BITS;
+
+    if (first == last) {
+        const auto mask = static_cast<std::uint8_t>(((1U << nb) - 1) << shift);
+        dst[first]      = static_cast<std::uint8_t>((dst[first] & ~mask) | ((src[0] << shift) & mask));  // NOLINT
+        return;
+    }
+
+    // first byte: the lower bits of the table are kept
+    const auto first_mask = static_cast<std::uint8_t>(BYTE_MASK << shift);
+    dst[first] = static_cast<std::uint8_t>((dst[first] & ~first_mask) | ((src[0] << shift) & first_mask));  // NOLINT
+
+    // completely overwritten bytes
+    const std::size_t n_full = last - first - 1;
+    if (shift == 0) std::memcpy(dst + first + 1, src + 1, n_full);  // NOLINT
+    else
+        funnel(src, src + 1, BYTE_BITS - shift, dst + first + 1, n_full);  // NOLINT
+
+    // last byte: the upper bits of the table are kept
+    const std::size_t src_size  = (nb + BYTE_BITS - 1) / BYTE_BITS;
+    const std::size_t src_index = last - first;
+    unsigned          value     = static_cast<unsigned>(src[src_index - 1]) >> (BYTE_BITS - shift);  // NOLINT
+    if (src_index < src_size) value |= static_cast<unsigned>(src[src_index]) << shift;              // NOLINT
+
+    const auto last_bits = static_cast<unsigned>(offset + nb - last * BYTE_BITS);
+    const auto last_mask = static_cast<std::uint8_t>((1U << last_bits) - 1);
+    dst[last]            = static_cast<std::uint8_t>((dst[last] & ~last_mask) | (value & last_mask));  // NOLINT
+}
+
+void extract(const std::uint8_t *src, std::size_t offset, std::size_t nb, std::uint8_t *dst) noexcept {
+    extract_bits(FUNNEL, src, offset, nb, dst);
+}
+
+void insert(std::uint8_t *dst, std::size_t offset, std::size_t nb, const std::uint8_t *src) noexcept {
+    insert_bits(FUNNEL, dst, offset, nb, src);
+}
+
+void unpack(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) noexcept {
+    UNPACK(src, nb, dst);
+}
+
+void extract(isa_t isa, const std::uint8_t *src, std::size_t offset, std::size_t nb, std::uint8_t *dst) noexcept {
+    extract_bits(get_funnel(isa), src, offset, nb, dst);
+}
+
+void insert(isa_t isa, std::uint8_t *dst, std::size_t offset, std::size_t nb, const std::uint8_t *src) noexcept {
+    insert_bits(get_funnel(isa), dst, offset, nb, src);
+}
+
+void unpack(isa_t isa, const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) noexcept {
+    get_unpack(isa)(src, nb, dst);
+}
+
+}  // namespace Modbus::PDU::Bits
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*! \brief conversion between packed bit tables and the Modbus coil encoding
+ *
+ * Packed bits are stored LSB first (bit n at byte n / 8, bit n % 8), which is the encoding of coils in a Modbus PDU.
+ * The kernels use AVX2 (if supported by the cpu), SSE2 or a portable implementation.
+ */
+namespace Modbus::PDU::Bits {
+
+//! kernel implementations
+enum class isa_t : std::uint8_t {
+    scalar,  //!< one byte at a time (portable)
+    sse2,    //!< 16 bytes per step (x86)
+    avx2     //!< 32 bytes per step (x86)
+};
+
+/*! \brief check if a kernel can be used on this cpu
+ *
+ * @param isa kernel implementation
+ * @return true if supported
+ */
+[[nodiscard]] bool is_supported(isa_t isa) noexcept;
+
+/*! \brief get the kernel that is used by extract, insert and unpack
+ *
+ * @return selected kernel implementation
+ */
+[[nodiscard]] isa_t selected() noexcept;
+
+/*! \brief copy bits from a packed table to a Modbus coil field
+ *
+ * @details unused bits of the last destination byte are set to 0
+ *
+ * @param src packed table
+ * @param offset index of the first bit to copy
+ * @param nb number of bits to copy (> 0)
+ * @param dst destination (nb / 8 rounded up bytes)
+ */
+void extract(const std::uint8_t *src, std::size_t offset, std::size_t nb, std::uint8_t *dst) noexcept;
+
+/*! \brief copy bits from a Modbus coil field to a packed table
+ *
+ * @details bits of the table outside of the written range are not modified
+ *
+ * @param dst packed table
+ * @param offset index of the first bit to write
+ * @param nb number of bits to write (> 0)
+ * @param src source (nb / 8 rounded up bytes)
+ */
+void insert(std::uint8_t *dst, std::size_t offset, std::size_t nb, const std::uint8_t *src) noexcept;
+
+/*! \brief expand a Modbus coil field to one byte (0 or 1) per bit
+ *
+ * @param src source (nb / 8 rounded up bytes)
+ * @param nb number of bits
+ * @param dst destination (nb bytes)
+ */
+void unpack(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) noexcept;
+
+/*! \brief extract with a specific kernel
+ *
+ * @details intended for tests and benchmarks. The kernel must be supported by the cpu.
+ *
+ * @param isa kernel implementation
+ * @param src packed table
+ * @param offset index of the first bit to copy
+ * @param nb number of bits to copy (> 0)
+ * @param dst destination (nb / 8 rounded up bytes)
+ */
+void extract(isa_t isa, const std::uint8_t *src, std::size_t offset, std::size_t nb, std::uint8_t *dst) noexcept;
+
+/*! \brief insert with a specific kernel
+ *
+ * @details intended for tests and benchmarks. The kernel must be supported by the cpu.
+ *
+ * @param isa kernel implementation
+ * @param dst packed table
+ * @param offset index of the first bit to write
+ * @param nb number of bits to write (> 0)
+ * @param src source (nb / 8 rounded up bytes)
+ */
+void insert(isa_t isa, std::uint8_t *dst, std::size_t offset, std::size_t nb, const std::uint8_t *src) noexcept;
+
+/*! \brief unpack with a specific kernel
+ *
+ * @details intended for tests and benchmarks. The kernel must be supported by the cpu.
+ *
+ * @param isa kernel implementation
+ * @param src source (nb / 8 rounded up bytes)
+ * @param nb number of bits
+ * @param dst destination (nb bytes)
+ */
+void unpack(isa_t isa, const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) noexcept;
+
+}  // namespace Modbus::PDU::Bits
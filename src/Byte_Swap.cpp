@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Byte_Swap.hpp"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define BYTE_SWAP_X86
+#endif
+
+namespace Modbus::PDU::Byte_Swap {
+
+//* bits per byte
+static constexpr unsigned BYTE_BITS = 8;
+
+/*! \brief byte swap kernel
+ *
+ * swaps the bytes of nb 16 bit values. Source and destination may be unaligned.
+ *
+ * @param src source
+ * @param nb number of 16 bit values
+ * @param dst destination
+ */
+using kernel_t = void (*)(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst);
+
+static void swap_scalar(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    for (std::size_t i = 0; i < nb; ++i) {
+        dst[2 * i]     = src[2 * i + 1];  // NOLINT
+        dst[2 * i + 1] = src[2 * i];      // NOLINT
+    }
+}
+
+static void copy(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    std::memcpy(dst, src, 2 * nb);
+}
+
+#ifdef BYTE_SWAP_X86
+#    ifdef __SSE2__
+static void swap_sse2(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    static constexpr std::size_t WIDTH = sizeof(__m128i) / 2;
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= nb; i += WIDTH) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));  // NOLINT
+        const __m128i r = _mm_or_si128(_mm_slli_epi16(v, BYTE_BITS), _mm_srli_epi16(v, BYTE_BITS));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), r);  // NOLINT
+    }
+
+    swap_scalar(src + 2 * i, nb - i, dst + 2 * i);  // NOLINT
+}
+#    endif
+
+__attribute__((target("ssse3"))) static void swap_ssse3(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    static constexpr std::size_t WIDTH = sizeof(__m128i) / 2;
+
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= nb; i += WIDTH) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));  // NOLINT
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), _mm_shuffle_epi8(v, shuffle));  // NOLINT
+    }
+
+    swap_scalar(src + 2 * i, nb - i, dst + 2 * i);  // NOLINT
+}
+
+__attribute__((target("avx2"))) static void swap_avx2(const std::uint8_t *src, std::size_t nb, std::uint8_t *dst) {
+    static constexpr std::size_t WIDTH = sizeof(__m256i) / 2;
+
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,  // NOLINT
+                                             1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    std::size_t i = 0;
+    for (; i + WIDTH <= nb; i += WIDTH) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i));  // NOLINT
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * i), _mm256_shuffle_epi8(v, shuffle));  // NOLINT
+    }
+
+    // the remaining registers (< 16) are handled by the 128 bit kernel
+    swap_ssse3(src + 2 * i, nb - i, dst + 2 * i);  // NOLINT
+}
+#endif
+
+bool is_supported(isa_t isa) noexcept {
+    switch (isa) {
+        case isa_t::scalar: return true;
+#ifdef BYTE_SWAP_X86
+#    ifdef __SSE2__
+        case isa_t::sse2: return true;
+#    else
+        case isa_t::sse2: return false;
+#    endif
+        case isa_t::ssse3: return __builtin_cpu_supports("ssse3");
+        case isa_t::avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("ssse3");
+#else
+        case isa_t::sse2:
+        case isa_t::ssse3:
+        case isa_t::avx2: return false;
+#endif
+        default: return false;
+    }
+}
+
+static kernel_t get_kernel(isa_t isa) {
+#ifdef BYTE_SWAP_X86
+    if (isa == isa_t::avx2) return &swap_avx2;
+    if (isa == isa_t::ssse3) return &swap_ssse3;
+#    ifdef __SSE2__
+    if (isa == isa_t::sse2) return &swap_sse2;
+#    endif
+#else
+    static_cast<void>(isa);
+#endif
+    return &swap_scalar;
+}
+
+static isa_t select_isa() {
+    if (is_supported(isa_t::avx2)) return isa_t::avx2;
+    if (is_supported(isa_t::ssse3)) return isa_t::ssse3;
+    if (is_supported(isa_t::sse2)) return isa_t::sse2;
+    return isa_t::scalar;
+}
+
+//* kernel for the cpu the program is running on
+static const isa_t    SELECTED_ISA = select_isa();
+static const kernel_t KERNEL       = std::endian::native == std::endian::big ? &copy : get_kernel(SELECTED_ISA);
+
+isa_t selected() noexcept {
+    return SELECTED_ISA;
+}
+
+void to_wire(const std::uint16_t *src, std::size_t nb, std::uint8_t *dst) noexcept {
+    KERNEL(reinterpret_cast<const std::uint8_t *>(src), nb, dst);  // NOLINT
+}
+
+void from_wire(const std::uint8_t *src, std::size_t nb, std::uint16_t *dst) noexcept {
+    KERNEL(src, nb, reinterpret_cast<std::uint8_t *>(dst));  // NOLINT
+}
+
+void to_wire(isa_t isa, const std::uint16_t *src, std::size_t nb, std::uint8_t *dst) noexcept {
+    const auto kernel = std::endian::native == std::endian::big ? &copy : get_kernel(isa);
+    kernel(reinterpret_cast<const std::uint8_t *>(src), nb, dst);  // NOLINT
+}
+
+void from_wire(isa_t isa, const std::uint8_t *src, std::size_t nb, std::uint16_t *dst) noexcept {
+    const auto kernel = std::endian::native == std::endian::big ? &copy : get_kernel(isa);
+    kernel(src, nb, reinterpret_cast<std::uint8_t *>(dst));  // NOLINT
+}
+
+}  // namespace Modbus::PDU::Byte_Swap
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*! \brief conversion of register blocks between host byte order and the Modbus encoding (big endian)
+ *
+ * The kernel is selected once at startup depending on the features of the cpu.
+ */
+namespace Modbus::PDU::Byte_Swap {
+
+//! kernel implementations
+enum class isa_t : std::uint8_t {
+    scalar,  //!< one register at a time (portable)
+    sse2,    //!< 8 registers per step (x86)
+    ssse3,   //!< 8 registers per step using pshufb (x86)
+    avx2     //!< 16 registers per step using vpshufb (x86)
+};
+
+/*! \brief check if a kernel can be used on this cpu
+ *
+ * @param isa kernel implementation
+ * @return true if supported
+ */
+[[nodiscard]] bool is_supported(isa_t isa) noexcept;
+
+/*! \brief get the kernel that is used by to_wire and from_wire
+ *
+ * @return selected kernel implementation
+ */
+[[nodiscard]] isa_t selected() noexcept;
+
+/*! \brief encode registers
+ *
+ * @param src registers (host byte order)
+ * @param nb number of registers
+ * @param dst destination (2 * nb bytes, big endian)
+ */
+void to_wire(const std::uint16_t *src, std::size_t nb, std::uint8_t *dst) noexcept;
+
+/*! \brief decode registers
+ *
+ * @param src source (2 * nb bytes, big endian)
+ * @param nb number of registers
+ * @param dst registers (host byte order)
+ */
+void from_wire(const std::uint8_t *src, std::size_t nb, std::uint16_t *dst) noexcept;
+
+/*! \brief encode registers with a specific kernel
+ *
+ * @details intended for benchmarks. The kernel must be supported by the cpu.
+ *
+ * @param isa kernel implementation
+ * @param src registers (host byte order)
+ * @param nb number of registers
+ * @param dst destination (2 * nb bytes, big endian)
+ */
+void to_wire(isa_t isa, const std::uint16_t *src, std::size_t nb, std::uint8_t *dst) noexcept;
+
+/*! \brief decode registers with a specific kernel
+ *
+ * @details intended for tests and benchmarks. The kernel must be supported by the cpu.
+ *
+ * @param isa kernel implementation
+ * @param src source (2 * nb bytes, big endian)
+ * @param nb number of registers
+ * @param dst registers (host byte order)
+ */
+void from_wire(isa_t isa, const std::uint8_t *src, std::size_t nb, std::uint16_t *dst) noexcept;
+
+}  // namespace Modbus::PDU::Byte_Swap
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Capture_Ring.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <ctime>
+#include <netinet/in.h>
+
+namespace Modbus {
+
+//* minimum size of a capture ring buffer
+static constexpr std::size_t MIN_SIZE = 0x10000;
+
+//* nanoseconds per second
+static constexpr std::uint64_t NS_PER_S = 1000000000;
+
+Capture_Ring::Capture_Ring(std::size_t size)
+    : capacity(std::bit_ceil(std::max(size, MIN_SIZE))),
+      buffer(std::make_unique<std::uint8_t[]>(capacity)) {}  // NOLINT
+
+Capture_Ring::flow_t Capture_Ring::make_flow(const struct sockaddr_storage &client,
+                                             const struct sockaddr_storage &server) noexcept {
+    flow_t flow;
+
+    // the port entries have the same offset and size in sockaddr_in and sockaddr_in6
+    flow.client_port = ntohs(reinterpret_cast<const struct sockaddr_in *>(&client)->sin_port);  // NOLINT
+    flow.server_port = ntohs(reinterpret_cast<const struct sockaddr_in *>(&server)->sin_port);  // NOLINT
+
+    if (client.ss_family == AF_INET) {
+        flow.family = AF_INET;
+        std::memcpy(flow.client_addr.data(), &reinterpret_cast<const struct sockaddr_in *>(&client)->sin_addr, 4);
+        std::memcpy(flow.server_addr.data(), &reinterpret_cast<const struct sockaddr_in *>(&server)->sin_addr, 4);
+    } else if (client.ss_family == AF_INET6) {
+        flow.family = AF_INET6;
+        std::memcpy(flow.client_addr.data(), &reinterpret_cast<const struct sockaddr_in6 *>(&client)->sin6_addr, 16);
+        std::memcpy(flow.server_addr.data(), &reinterpret_cast<const struct sockaddr_in6 *>(&server)->sin6_addr, 16);
+    }
+
+    return flow;
+}
+
+bool Capture_Ring::push(const flow_t &flow, direction_t direction, std::span<const std::uint8_t> adu) noexcept {
+    const auto size       = record_size(adu.size());
+    const auto position   = head.load(std::memory_order_relaxed);
+    const auto offset     = position & (capacity - 1);
+    const auto contiguous = capacity - offset;
+
+    // records are not split: the rest of the buffer is skipped if the record does not fit
+    const auto skip = contiguous < size ? contiguous : 0;
+
+    if (position + skip + size - tail_cache > capacity) {
+        tail_cache = tail.load(std::memory_order_acquire);
+        if (position + skip + size - tail_cache > capacity) return false;
+    }
+
+    if (skip >= sizeof(record_t)) {
+        record_t wrap {};
+        wrap.size = WRAP;
+        std::memcpy(&buffer[offset], &wrap, sizeof(wrap));
+    }
+
+    struct timespec now {};
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    record_t record {};
+    record.timestamp = static_cast<std::uint64_t>(now.tv_sec) * NS_PER_S + static_cast<std::uint64_t>(now.tv_nsec);
+    record.flow      = flow;
+    record.size      = static_cast<std::uint16_t>(adu.size());
+    record.direction = direction;
+
+    const auto start = (position + skip) & (capacity - 1);
+    std::memcpy(&buffer[start], &record, sizeof(record));
+    std::memcpy(&buffer[start + sizeof(record)], adu.data(), adu.size());
+
+    head.store(position + skip + size, std::memory_order_release);
+    return true;
+}
+
+}  // namespace Modbus
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <sys/socket.h>
+
+namespace Modbus {
+
+/*! \brief lock-free ring buffer for captured Modbus/TCP ADUs (--capture)
+ *
+ * Single producer (the thread that handles the requests), single consumer (the capture writer).
+ * Each record consists of a record_t header and the ADU. The records are aligned to 8 bytes.
+ * A record that does not fit into the ring is dropped (push returns false): the producer never waits.
+ */
+class Capture_Ring final {
+public:
+    //! direction of a captured ADU
+    enum direction_t : std::uint8_t {
+        REQUEST,  //!< Modbus client --> this server
+        REPLY     //!< this server --> Modbus client
+    };
+
+    //! addresses of a connection (ports in host byte order)
+    struct flow_t {
+        std::uint8_t                 family      = AF_UNSPEC;  //!< AF_INET or AF_INET6
+        std::uint8_t                 reserved    = 0;          //!< 0
+        std::uint16_t                client_port = 0;          //!< port of the Modbus client
+        std::uint16_t                server_port = 0;          //!< port of this server
+        std::uint16_t                reserved2   = 0;          //!< 0
+        std::array<std::uint8_t, 16> client_addr {};           //!< address of the Modbus client (AF_INET: 4 bytes)
+        std::array<std::uint8_t, 16> server_addr {};           //!< address of this server (AF_INET: 4 bytes)
+    };
+
+    //! header of a record
+    struct record_t {
+        std::uint64_t timestamp;    //!< CLOCK_REALTIME in ns
+        flow_t        flow;         //!< addresses of the connection
+        std::uint16_t size;         //!< size of the ADU
+        std::uint8_t  direction;    //!< direction_t
+        std::uint8_t  reserved[5];  //!< 0  // NOLINT
+    };
+
+private:
+    //! record_t::size of a record that marks the end of the used part of the buffer
+    static constexpr std::uint16_t WRAP = 0xFFFF;
+
+    std::size_t                     capacity;  //!< size of buffer (power of 2)
+    std::unique_ptr<std::uint8_t[]> buffer;    //!< records  // NOLINT
+
+    //! write position (written by the producer)
+    alignas(64) std::atomic<std::uint64_t> head {0};
+
+    //! read position seen by the last push (producer only, avoids loading tail for every push)
+    std::uint64_t tail_cache = 0;
+
+    //! read position (written by the consumer)
+    alignas(64) std::atomic<std::uint64_t> tail {0};
+
+    static constexpr std::size_t record_size(std::size_t adu_size) noexcept {
+        return (sizeof(record_t) + adu_size + 7) & ~std::size_t(7);
+    }
+
+public:
+    /**
+     * @brief create a ring buffer
+     *
+     * @param size size in bytes (rounded up to a power of 2)
+     */
+    explicit Capture_Ring(std::size_t size);
+
+    /**
+     * @brief get the flow of a connection
+     *
+     * @param client address of the Modbus client (getpeername)
+     * @param server address of this server (getsockname)
+     */
+    static flow_t make_flow(const struct sockaddr_storage &client, const struct sockaddr_storage &server) noexcept;
+
+    /**
+     * @brief copy an ADU to the ring buffer (producer)
+     *
+     * @return false if the ADU was dropped because the ring buffer is full
+     */
+    bool push(const flow_t &flow, direction_t direction, std::span<const std::uint8_t> adu) noexcept;
+
+    /**
+     * @brief pass all records to a function and remove them from the ring buffer (consumer)
+     *
+     * @param handler called with (const record_t &, std::span<const std::uint8_t> adu)
+     * @return number of records
+     */
+    template <typename Handler>
+    std::size_t drain(Handler &&handler) {
+        std::size_t records = 0;
+
+        auto       position = tail.load(std::memory_order_relaxed);
+        const auto end      = head.load(std::memory_order_acquire);
+        while (position != end) {
+            const auto offset     = position & (capacity - 1);
+            const auto contiguous = capacity - offset;
+
+            record_t record;  // NOLINT
+            if (contiguous >= sizeof(record)) std::memcpy(&record, &buffer[offset], sizeof(record));
+            if (contiguous < sizeof(record) || record.size == WRAP) {
+                position += contiguous;
+                continue;
+            }
+
+            handler(record, std::span<const std::uint8_t>(&buffer[offset + sizeof(record)], record.size));
+            position += record_size(record.size);
+            tail.store(position, std::memory_order_release);
+            ++records;
+        }
+        tail.store(position, std::memory_order_release);
+
+        return records;
+    }
+};
+
+}  // namespace Modbus
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Modbus {
+
+void Histogram::merge(const Histogram &other) noexcept {
+    for (std::size_t i = 0; i < BUCKETS; ++i)
+        add(buckets[i], other.bucket(i));  // NOLINT
+
+    add(total, other.count());
+    add(sum, other.get_sum());
+    if (other.max() > max()) maximum.store(other.max(), std::memory_order_relaxed);
+}
+
+std::uint64_t Histogram::percentile(double quantile) const noexcept {
+    const auto values = count();
+    if (values == 0) return 0;
+
+    // rank of the requested value (1 .. values)
+    const auto rank = std::clamp(static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(values))),
+                                 std::uint64_t(1),
+                                 values);
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS; ++i) {
+        seen += bucket(i);
+        if (seen >= rank) return std::min(upper_bound(i), max());
+    }
+
+    // buckets were modified while they were read
+    return max();
+}
+
+}  // namespace Modbus
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace Modbus {
+
+/*! \brief fixed size log-linear histogram (e.g. durations in nanoseconds)
+ *
+ * Each power of two is divided into SUB_BUCKETS linear buckets (relative error <= 1 / SUB_BUCKETS).
+ * Values above MAX_VALUE are counted in the last bucket.
+ *
+ * There must be only one thread that records values.
+ * Other threads can read the histogram at any time (the values of a snapshot may be slightly inconsistent).
+ */
+class Histogram {
+public:
+    static constexpr std::size_t   SUB_BUCKET_BITS = 3;
+    static constexpr std::size_t   SUB_BUCKETS     = std::size_t(1) << SUB_BUCKET_BITS;
+    static constexpr std::size_t   VALUE_BITS      = 40;  // ~18 minutes in nanoseconds
+    static constexpr std::uint64_t MAX_VALUE       = (std::uint64_t(1) << VALUE_BITS) - 1;
+    static constexpr std::size_t   BUCKETS         = (VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+    std::array<std::atomic<std::uint64_t>, BUCKETS> buckets {};
+    std::atomic<std::uint64_t>                      total {0};    //!< number of recorded values
+    std::atomic<std::uint64_t>                      sum {0};      //!< sum of all recorded values
+    std::atomic<std::uint64_t>                      maximum {0};  //!< maximum recorded value
+
+    /**
+     * @brief increment an atomic that is only written by one thread (no locked instruction required)
+     */
+    static void add(std::atomic<std::uint64_t> &value, std::uint64_t n) noexcept {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+public:
+    /**
+     * @brief get the index of the bucket that contains a value
+     */
+    static constexpr std::size_t index(std::uint64_t value) noexcept {
+        if (value > MAX_VALUE) value = MAX_VALUE;
+        if (value < SUB_BUCKETS) return value;
+
+        const std::size_t shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        return shift * SUB_BUCKETS + (value >> shift);
+    }
+
+    /**
+     * @brief get the smallest value of a bucket
+     */
+    static constexpr std::uint64_t lower_bound(std::size_t index) noexcept {
+        if (index < SUB_BUCKETS) return index;
+
+        const auto shift = index / SUB_BUCKETS - 1;
+        return (index - shift * SUB_BUCKETS) << shift;
+    }
+
+    /**
+     * @brief get the largest value of a bucket
+     */
+    static constexpr std::uint64_t upper_bound(std::size_t index) noexcept {
+        return index + 1 < BUCKETS ? lower_bound(index + 1) - 1 : MAX_VALUE;
+    }
+
+    /**
+     * @brief record a value
+     */
+    void record(std::uint64_t value) noexcept {
+        add(buckets[index(value)], 1);  // NOLINT
+        add(total, 1);
+        add(sum, value);
+        if (value > maximum.load(std::memory_order_relaxed)) maximum.store(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief add the values of another histogram (e.g. to combine the histograms of multiple threads)
+     */
+    void merge(const Histogram &other) noexcept;
+
+    /**
+     * @brief get the value below which the fraction quantile of all values is (upper bound of the bucket)
+     *
+     * @param quantile 0.0 .. 1.0 (e.g. 0.99)
+     * @return value or 0 if the histogram is empty
+     */
+    [[nodiscard]] std::uint64_t percentile(double quantile) const noexcept;
+
+    [[nodiscard]] std::uint64_t count() const noexcept { return total.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] std::uint64_t get_sum() const noexcept { return sum.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] std::uint64_t max() const noexcept { return maximum.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] std::uint64_t bucket(std::size_t index) const noexcept {
+        return buckets[index].load(std::memory_order_relaxed);  // NOLINT
+    }
+};
+
+}  // namespace Modbus
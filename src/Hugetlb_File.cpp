@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Hugetlb_File.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace Modbus::shm {
+
+Hugetlb_File::Hugetlb_File(const std::string &directory,
+                           const std::string &name,
+                           std::size_t        size,
+                           bool               exclusive,
+                           mode_t             permissions,
+                           bool               populate)
+    : path(directory + '/' + name), size(size) {
+    struct statfs fs {};
+    if (statfs(directory.c_str(), &fs) == -1)
+        throw std::system_error(errno, std::generic_category(), "Failed to access directory " + directory);
+    if (fs.f_type != HUGETLBFS_MAGIC)
+        throw std::system_error(EINVAL, std::generic_category(), directory + " is not a hugetlbfs mount");
+
+    // the block size of a hugetlbfs is the huge page size
+    const auto page_size = static_cast<std::size_t>(fs.f_bsize);
+    mapped_size          = (size + page_size - 1) / page_size * page_size;
+
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+    if (exclusive) flags |= O_EXCL;
+
+    fd = open(path.c_str(), flags, permissions);  // NOLINT
+    if (fd == -1) throw std::system_error(errno, std::generic_category(), "Failed to create " + path);
+
+    const auto fail = [this](const std::string &what) {
+        const int error = errno;
+        close(fd);
+        unlink(path.c_str());
+        return std::system_error(error, std::generic_category(), what + ' ' + path);
+    };
+
+    // permissions are not affected by the umask (like the POSIX shared memory objects)
+    if (fchmod(fd, permissions) == -1) throw fail("Failed to set permissions of");
+    if (ftruncate(fd, static_cast<off_t>(mapped_size)) == -1) throw fail("Failed to resize");
+
+    int mmap_flags = MAP_SHARED;
+    if (populate) mmap_flags |= MAP_POPULATE;
+    addr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, mmap_flags, fd, 0);
+    if (addr == MAP_FAILED) {  // NOLINT
+        addr = nullptr;
+        throw fail("Failed to map (not enough huge pages available? see /proc/sys/vm/nr_hugepages)");
+    }
+}
+
+Hugetlb_File::~Hugetlb_File() {
+    munmap(addr, mapped_size);
+    close(fd);
+    unlink(path.c_str());
+}
+
+}  // namespace Modbus::shm
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+namespace Modbus::shm {
+
+/*! \brief shared file in a hugetlbfs mount (--hugetlbfs)
+ *
+ * Alternative to a POSIX shared memory object that is backed by huge pages.
+ * Other processes open and map <directory>/<name> instead of the shared memory object <name>.
+ *
+ * The file is created on construction and deleted on destruction.
+ * The mapped size is rounded up to a multiple of the huge page size.
+ */
+class Hugetlb_File final {
+private:
+    std::string path;                   //!< path of the file
+    int         fd          = -1;       //!< file descriptor
+    std::size_t size        = 0;        //!< requested size in bytes
+    std::size_t mapped_size = 0;        //!< size of the mapping (multiple of the huge page size)
+    void       *addr        = nullptr;  //!< mapped address
+
+public:
+    /*! \brief create and map a file in a hugetlbfs mount
+     *
+     * @param directory mount point of a hugetlbfs (e.g. /dev/hugepages)
+     * @param name name of the file
+     * @param size size in bytes
+     * @param exclusive fail if the file already exists
+     * @param permissions file permissions
+     * @param populate allocate all huge pages on creation (MAP_POPULATE)
+     */
+    Hugetlb_File(const std::string &directory,
+                 const std::string &name,
+                 std::size_t        size,
+                 bool               exclusive,
+                 mode_t             permissions,
+                 bool               populate);
+
+    ~Hugetlb_File();
+
+    Hugetlb_File(const Hugetlb_File &other)            = delete;
+    Hugetlb_File(Hugetlb_File &&other)                 = delete;
+    Hugetlb_File &operator=(const Hugetlb_File &other) = delete;
+    Hugetlb_File &operator=(Hugetlb_File &&other)      = delete;
+
+    [[nodiscard]] void *get_addr() const noexcept { return addr; }
+
+    [[nodiscard]] std::size_t get_size() const noexcept { return size; }
+
+    [[nodiscard]] std::size_t get_mapped_size() const noexcept { return mapped_size; }
+
+    [[nodiscard]] const std::string &get_path() const noexcept { return path; }
+};
+
+}  // namespace Modbus::shm
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Log.hpp"
+
+#include "Print_Time.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace Modbus {
+
+//* maximum length of a queued message (longer messages are truncated)
+static constexpr std::size_t MESSAGE_SIZE = 480;
+
+//* time the background thread waits if the queue is empty
+static constexpr auto IDLE_INTERVAL = std::chrono::milliseconds(10);
+
+//* identical consecutive messages within this time are suppressed
+static constexpr std::time_t REPEAT_WINDOW = 10;
+
+//* maximum number of messages per second
+static constexpr std::size_t MAX_PER_SECOND = 100;
+
+//* names of the levels (index: Log::level_t)
+static constexpr std::array<const char *, 3> LEVEL_NAMES {"INFO", "WARNING", "ERROR"};
+
+/**
+ * @brief get the name of a level as used in the log
+ */
+static const char *level_name(Log::level_t level) noexcept {
+    return LEVEL_NAMES[static_cast<std::size_t>(level)];  // NOLINT
+}
+
+/*! \brief bounded multi producer, single consumer queue of log messages
+ *
+ * Each slot has a sequence number that tells producers and the consumer whether the slot is free or filled
+ * (D. Vyukov, bounded MPMC queue). Producers never wait: push fails if the queue is full.
+ */
+class Log_Queue final {
+public:
+    struct message_t {
+        std::time_t                    time   = 0;                   //!< time the message was logged
+        Log::level_t                   level  = Log::level_t::info;  //!< level of the message
+        std::size_t                    length = 0;                   //!< length of the message
+        std::array<char, MESSAGE_SIZE> text {};                      //!< message (not null terminated)
+    };
+
+private:
+    struct slot_t {
+        std::atomic<std::size_t> sequence {0};
+        message_t                message;
+    };
+
+    std::size_t               mask;   //!< number of slots - 1
+    std::unique_ptr<slot_t[]> slots;  //!< messages  // NOLINT
+
+    //! next slot of a producer
+    alignas(64) std::atomic<std::size_t> enqueue_position {0};
+
+    //! next slot of the consumer
+    alignas(64) std::size_t dequeue_position = 0;
+
+public:
+    std::atomic<std::uint64_t> dropped {0};  //!< messages that did not fit into the queue
+
+    explicit Log_Queue(std::size_t capacity)
+        : mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+          slots(std::make_unique<slot_t[]>(mask + 1)) {  // NOLINT
+        for (std::size_t i = 0; i <= mask; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(Log::level_t level, std::string_view text) noexcept {
+        auto    position = enqueue_position.load(std::memory_order_relaxed);
+        slot_t *slot     = nullptr;
+        while (true) {
+            slot            = &slots[position & mask];
+            const auto seq  = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        auto &message  = slot->message;
+        message.time   = std::time(nullptr);
+        message.level  = level;
+        message.length = std::min(text.size(), MESSAGE_SIZE);
+        std::copy_n(text.data(), message.length, message.text.data());
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(message_t &message) noexcept {
+        auto &slot = slots[dequeue_position & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_position + 1) return false;
+
+        message = slot.message;
+        slot.sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+        ++dequeue_position;
+        return true;
+    }
+};
+
+/*! \brief background thread that formats and writes the queued messages
+ */
+class Log_Writer final {
+private:
+    Log_Queue queue;
+
+    std::string output;  //!< formatted messages of one iteration (written with one system call)
+
+    // suppression of identical consecutive messages
+    bool         has_last   = false;               //!< last_* describe the last written message
+    Log::level_t last_level = Log::level_t::info;  //!< level of the last written message
+    std::string  last_text;                        //!< text of the last written message
+    std::time_t  last_time = 0;                    //!< time the last message was written
+    std::size_t  repeated  = 0;                    //!< suppressed repetitions of the last message
+
+    // rate limit
+    std::time_t   second     = 0;  //!< current second
+    std::size_t   per_second = 0;  //!< messages written in the current second
+    std::uint64_t limited    = 0;  //!< messages suppressed by the rate limit
+
+    std::uint64_t reported_drops = 0;  //!< dropped messages that are already reported
+
+    std::atomic<bool> stop {false};  //!< terminates the thread
+    std::thread       thread;        //!< formats and writes the messages (initialized last)
+
+    void format(std::time_t time, Log::level_t level, std::string_view text) {
+        output += Print_Time::iso.at(time);
+        output += ' ';
+        output += level_name(level);
+        output += ": ";
+        output += text;
+        output += '\n';
+    }
+
+    void report_repeated(std::time_t now) {
+        if (repeated != 0) format(now, last_level, "last message repeated " + std::to_string(repeated) + " times");
+        repeated = 0;
+        has_last = false;
+    }
+
+    void report_limited(std::time_t now) {
+        if (limited == 0) return;
+        format(now,
+               Log::level_t::warning,
+               std::to_string(limited) + " log messages suppressed (more than " + std::to_string(MAX_PER_SECOND) +
+                       " per second)");
+        limited = 0;
+    }
+
+    void report_drops(std::time_t now) {
+        const auto drops = queue.dropped.load(std::memory_order_relaxed);
+        if (drops == reported_drops) return;
+        format(now,
+               Log::level_t::warning,
+               std::to_string(drops - reported_drops) + " log messages dropped (queue full)");
+        reported_drops = drops;
+    }
+
+    void handle(const Log_Queue::message_t &message) {
+        const std::string_view text(message.text.data(), message.length);
+
+        if (has_last) {
+            if (message.level == last_level && text == last_text && message.time - last_time < REPEAT_WINDOW) {
+                ++repeated;
+                return;
+            }
+            report_repeated(message.time);
+        }
+
+        if (message.time != second) {
+            report_limited(message.time);
+            second     = message.time;
+            per_second = 0;
+        }
+
+        if (per_second >= MAX_PER_SECOND) {
+            ++limited;
+            return;
+        }
+        ++per_second;
+
+        format(message.time, message.level, text);
+        has_last   = true;
+        last_level = message.level;
+        last_text.assign(text);
+        last_time = message.time;
+    }
+
+    void write_output() {
+        std::size_t written = 0;
+        while (written < output.size()) {
+            const auto ret = ::write(STDERR_FILENO, output.data() + written, output.size() - written);
+            if (ret == -1 && errno == EINTR) continue;
+            if (ret <= 0) break;  // stderr is not writable: the messages are lost
+            written += static_cast<std::size_t>(ret);
+        }
+        output.clear();
+    }
+
+    void drain() {
+        Log_Queue::message_t message;
+        while (queue.pop(message))
+            handle(message);
+
+        // the repetitions of a message are reported at least every REPEAT_WINDOW seconds
+        const auto now = std::time(nullptr);
+        if (has_last && now - last_time >= REPEAT_WINDOW) report_repeated(now);
+
+        report_drops(now);
+        if (!output.empty()) write_output();
+    }
+
+    void run() {
+        while (!stop.load(std::memory_order_acquire)) {
+            drain();
+            std::this_thread::sleep_for(IDLE_INTERVAL);
+        }
+
+        drain();
+        const auto now = std::time(nullptr);
+        report_repeated(now);
+        report_limited(now);
+        if (!output.empty()) write_output();
+    }
+
+public:
+    explicit Log_Writer(std::size_t capacity) : queue(capacity), thread(&Log_Writer::run, this) {}
+
+    ~Log_Writer() {
+        stop.store(true, std::memory_order_release);
+        thread.join();
+    }
+
+    Log_Writer(const Log_Writer &other)            = delete;
+    Log_Writer(Log_Writer &&other)                 = delete;
+    Log_Writer &operator=(const Log_Writer &other) = delete;
+    Log_Writer &operator=(Log_Writer &&other)      = delete;
+
+    void push(Log::level_t level, std::string_view text) noexcept { queue.push(level, text); }
+
+    [[nodiscard]] std::uint64_t get_dropped() const noexcept { return queue.dropped.load(std::memory_order_relaxed); }
+};
+
+//* background thread (nullptr: synchronous logging)
+static std::unique_ptr<Log_Writer> writer;  // NOLINT
+
+//* dropped messages of stopped background threads
+static std::uint64_t stopped_drops = 0;  // NOLINT
+
+void Log::write(level_t level, std::string_view message) noexcept {
+    if (writer) {
+        writer->push(level, message);
+        return;
+    }
+
+    try {
+        std::cerr << Print_Time::iso << ' ' << level_name(level) << ": " << message << std::endl;  // NOLINT
+    } catch (...) {  // NOLINT
+        // logging must not throw
+    }
+}
+
+void Log::start(std::size_t capacity) {
+    if (!writer) writer = std::make_unique<Log_Writer>(capacity);
+}
+
+void Log::stop() {
+    if (!writer) return;
+
+    stopped_drops += writer->get_dropped();
+    writer.reset();
+}
+
+std::uint64_t Log::get_dropped() noexcept {
+    return stopped_drops + (writer ? writer->get_dropped() : 0);
+}
+
+}  // namespace Modbus
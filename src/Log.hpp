@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string_view>
+
+namespace Modbus {
+
+/*! \brief log messages of the event loops (stderr)
+ *
+ * Messages are written synchronously until start is called.
+ * After that, they are copied to a bounded lock-free queue and a background thread formats and writes them.
+ * Threads that log never wait for stderr: if the queue is full, the message is dropped and counted.
+ *
+ * The background thread
+ *  - formats the timestamp only once per second
+ *  - suppresses identical consecutive messages ("last message repeated n times")
+ *  - limits the number of messages per second (the number of suppressed messages is logged)
+ *
+ * Usage: Log::info() << "text " << value;  (the message is logged by the destructor)
+ */
+class Log final {
+public:
+    enum class level_t : std::uint8_t { info, warning, error };
+
+    //! collects a message and logs it on destruction
+    class Line final {
+    private:
+        level_t            level;
+        std::ostringstream stream;
+
+    public:
+        explicit Line(level_t level) : level(level) {}
+
+        ~Line() { Log::write(level, stream.view()); }
+
+        Line(const Line &other)            = delete;
+        Line(Line &&other)                 = delete;
+        Line &operator=(const Line &other) = delete;
+        Line &operator=(Line &&other)      = delete;
+
+        template <typename T>
+        Line &operator<<(const T &value) {
+            stream << value;
+            return *this;
+        }
+    };
+
+    static Line info() { return Line(level_t::info); }
+
+    static Line warning() { return Line(level_t::warning); }
+
+    static Line error() { return Line(level_t::error); }
+
+    /**
+     * @brief log a message
+     *
+     * @details can be called by multiple threads
+     */
+    static void write(level_t level, std::string_view message) noexcept;
+
+    /**
+     * @brief start the background thread (asynchronous logging)
+     *
+     * @param capacity maximum number of queued messages (rounded up to a power of 2)
+     */
+    static void start(std::size_t capacity);
+
+    /**
+     * @brief write all queued messages and stop the background thread (synchronous logging)
+     *
+     * @details must not be called while other threads log messages
+     */
+    static void stop();
+
+    /**
+     * @brief get the number of messages that were dropped because the queue was full
+     */
+    [[nodiscard]] static std::uint64_t get_dropped() noexcept;
+};
+
+}  // namespace Modbus
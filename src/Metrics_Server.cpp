@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Metrics_Server.hpp"
+
+#include "Histogram.hpp"
+#include "Log.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace Modbus {
+
+//* maximum size of a HTTP request header
+static constexpr std::size_t REQUEST_MAX = 4096;
+
+//* listen backlog of the metrics socket
+static constexpr int BACKLOG = 16;
+
+//* host of a tcp metrics socket if only the port is specified
+static constexpr const char *DEFAULT_HOST = "127.0.0.1";
+
+//* nanoseconds per second (lock and latency histograms are recorded in ns)
+static constexpr double NS_PER_S = 1e9;
+
+//* reported quantiles of the lock and latency histograms
+static constexpr std::array<double, 3> QUANTILES {0.5, 0.99, 0.999};
+
+Metrics_Server::Metrics_Server(const std::string &address, bool force, mode_t permissions) : address(address) {
+    if (address.empty()) throw std::invalid_argument("invalid metrics address: ''");
+
+    if (address.front() == '@' || address.find('/') != std::string::npos) listen_unix(force, permissions);
+    else
+        listen_tcp();
+}
+
+Metrics_Server::~Metrics_Server() {
+    while (!scrapers.empty())
+        close_scraper(scrapers.begin()->first);
+
+    if (client) client->remove_aux_fd(listen_fd);
+    close(listen_fd);
+    if (!unix_path.empty()) unlink(unix_path.c_str());
+}
+
+void Metrics_Server::listen_unix(bool force, mode_t permissions) {
+    struct sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (address.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("invalid metrics socket path: '" + address + '\'');
+
+    const bool abstract = address.front() == '@';
+    std::memcpy(addr.sun_path, address.data(), address.size());  // NOLINT
+    if (abstract) addr.sun_path[0] = '\0';                        // NOLINT
+    const auto addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + address.size());
+
+    if (force && !abstract) unlink(address.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) throw std::system_error(errno, std::generic_category(), "Failed to create metrics socket");
+
+    if (bind(listen_fd, reinterpret_cast<const struct sockaddr *>(&addr), addr_len) == -1) {  // NOLINT
+        const int error = errno;
+        close(listen_fd);
+        throw std::system_error(error, std::generic_category(), "Failed to bind metrics socket '" + address + '\'');
+    }
+    if (!abstract) unix_path = address;
+
+    if ((!abstract && chmod(address.c_str(), permissions) == -1) || ::listen(listen_fd, BACKLOG) == -1) {
+        const int error = errno;
+        close(listen_fd);
+        if (!abstract) unlink(address.c_str());
+        throw std::system_error(
+                error, std::generic_category(), "Failed to listen on metrics socket '" + address + '\'');
+    }
+}
+
+void Metrics_Server::listen_tcp() {
+    // port, host:port or [ipv6]:port
+    std::string host    = DEFAULT_HOST;
+    std::string service = address;
+
+    const auto separator = address.rfind(':');
+    if (separator != std::string::npos) {
+        host    = address.substr(0, separator);
+        service = address.substr(separator + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints {};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    struct addrinfo *result = nullptr;
+    const int        rc     = getaddrinfo(host.c_str(), service.c_str(), &hints, &result);
+    if (rc != 0) throw std::runtime_error("metrics address '" + address + "': " + gai_strerror(rc));
+    const std::unique_ptr<struct addrinfo, decltype(&freeaddrinfo)> info(result, &freeaddrinfo);
+
+    int error = 0;
+    for (auto *entry = result; entry; entry = entry->ai_next) {
+        const int fd = socket(entry->ai_family, entry->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, entry->ai_protocol);
+        if (fd == -1) {
+            error = errno;
+            continue;
+        }
+
+        const int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, entry->ai_addr, entry->ai_addrlen) == 0 && ::listen(fd, BACKLOG) == 0) {
+            listen_fd = fd;
+            return;
+        }
+
+        error = errno;
+        close(fd);
+    }
+
+    throw std::system_error(error, std::generic_category(), "Failed to listen on metrics address '" + address + '\'');
+}
+
+void Metrics_Server::add_source(const TCP::Client_Poll &source) {
+    sources.push_back(&source);
+}
+
+void Metrics_Server::attach(TCP::Client_Poll &event_loop) {
+    client = &event_loop;
+    client->add_aux_fd(listen_fd, [this](short) { accept_scraper(); });
+}
+
+void Metrics_Server::accept_scraper() {
+    const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+            Log::error() << "metrics socket: accept failed: " << strerror(errno);
+        }
+        return;
+    }
+
+    scrapers.try_emplace(fd);
+    try {
+        client->add_aux_fd(fd, [this, fd](short) { handle_scraper(fd); });
+    } catch (const std::system_error &e) {
+        Log::error() << "metrics socket: " << e.what();
+        scrapers.erase(fd);
+        close(fd);
+    }
+}
+
+void Metrics_Server::handle_scraper(int fd) {
+    auto &scraper = scrapers.at(fd);
+    auto &request = scraper.request;
+
+    std::array<char, REQUEST_MAX> buffer {};
+    const ssize_t                 rc = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+    if (rc == -1 && (errno == EAGAIN || errno == EINTR)) return;
+    if (rc <= 0) {
+        close_scraper(fd);
+        return;
+    }
+
+    // wait for the end of the request header (a request body is ignored)
+    request.append(buffer.data(), static_cast<std::size_t>(rc));
+    if (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+        if (request.size() >= REQUEST_MAX) close_scraper(fd);
+        return;
+    }
+
+    const auto         body = render();
+    std::ostringstream reply;
+    reply << "HTTP/1.1 200 OK\r\n"
+          << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+          << "Content-Length: " << body.size() << "\r\n"
+          << "Connection: close\r\n\r\n"
+          << body;
+    scraper.reply = reply.str();
+
+    send_reply(fd);
+}
+
+void Metrics_Server::send_reply(int fd) {
+    auto &scraper = scrapers.at(fd);
+
+    while (scraper.sent < scraper.reply.size()) {
+        const ssize_t rc = send(fd,
+                                scraper.reply.data() + scraper.sent,
+                                scraper.reply.size() - scraper.sent,
+                                MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+
+            if (errno == EAGAIN) {
+                // the remaining part is sent once the socket is writable (the request is not read any more)
+                if (!scraper.writing) {
+                    scraper.writing = true;
+                    client->remove_aux_fd(fd);
+                    try {
+                        client->add_aux_fd(fd, [this, fd](short) { send_reply(fd); }, POLLOUT);
+                    } catch (const std::system_error &e) {
+                        Log::error() << "metrics socket: " << e.what();
+                        close_scraper(fd);
+                    }
+                }
+                return;
+            }
+
+            Log::warning() << "metrics socket: failed to send the metrics (" << strerror(errno) << ')';
+            break;
+        }
+        scraper.sent += static_cast<std::size_t>(rc);
+    }
+
+    close_scraper(fd);
+}
+
+void Metrics_Server::close_scraper(int fd) {
+    if (scrapers.erase(fd) == 0) return;
+
+    client->remove_aux_fd(fd);
+    close(fd);
+}
+
+/**
+ * @brief write the HELP and TYPE lines of a metric
+ */
+static void metric_header(std::ostream &out, const char *name, const char *type, const char *help) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << ' ' << type << '\n';
+}
+
+/**
+ * @brief write the values of a histogram of durations in nanoseconds as summary in seconds
+ *
+ * @param labels labels of the values (e.g. unit_id="1") or empty
+ */
+static void summary_values(std::ostream &out, const char *name, const std::string &labels, const Histogram &histogram) {
+    const auto prefix = labels.empty() ? std::string() : labels + ',';
+    for (const auto quantile : QUANTILES) {
+        const auto value = static_cast<double>(histogram.percentile(quantile)) / NS_PER_S;
+        out << name << '{' << prefix << "quantile=\"" << quantile << "\"} " << value << '\n';
+    }
+
+    const auto label_set = labels.empty() ? std::string() : '{' + labels + '}';
+    out << name << "_sum" << label_set << ' ' << static_cast<double>(histogram.get_sum()) / NS_PER_S << '\n';
+    out << name << "_count" << label_set << ' ' << histogram.count() << '\n';
+}
+
+/**
+ * @brief write a histogram of durations in nanoseconds as summary in seconds
+ */
+static void summary(std::ostream &out, const char *name, const char *help, const Histogram &histogram) {
+    metric_header(out, name, "summary", help);
+    summary_values(out, name, "", histogram);
+}
+
+std::string Metrics_Server::render() const {
+    using counter_t = std::atomic<std::uint64_t>;
+    using stats_t   = TCP::Client_Poll::traffic_stats_t;
+
+    // sum of a counter of all sources
+    const auto sum = [this](auto member) {
+        std::uint64_t value = 0;
+        for (const auto *source : sources)
+            value += member(source->get_traffic_stats()).load(std::memory_order_relaxed);
+        return value;
+    };
+
+    std::ostringstream out;
+
+    // counters per function code / unit id (only values that are not 0)
+    const auto labeled = [&](const char *name, const char *label, const char *help, auto array) {
+        metric_header(out, name, "counter", help);
+        for (std::size_t i = 0; i < 0x100; ++i) {
+            const auto value = sum([&](const stats_t &stats) -> const counter_t & { return (stats.*array)[i]; });
+            if (value) out << name << '{' << label << "=\"" << i << "\"} " << value << '\n';
+        }
+    };
+
+    labeled("modbus_requests_total", "function_code", "Modbus requests by function code.", &stats_t::requests);
+    labeled("modbus_unit_requests_total", "unit_id", "Modbus requests by unit id.", &stats_t::unit_requests);
+    labeled("modbus_exception_responses_total",
+            "function_code",
+            "Modbus exception responses by function code.",
+            &stats_t::exceptions);
+
+    const auto counter = [&](const char *name, const char *type, const char *help, counter_t stats_t::*member) {
+        metric_header(out, name, type, help);
+        out << name << ' ' << sum([&](const stats_t &stats) -> const counter_t & { return stats.*member; }) << '\n';
+    };
+
+    counter("modbus_received_bytes_total", "counter", "Received Modbus/TCP bytes.", &stats_t::bytes_in);
+    counter("modbus_sent_bytes_total", "counter", "Sent Modbus/TCP bytes.", &stats_t::bytes_out);
+    counter("modbus_connections", "gauge", "Active Modbus/TCP connections.", &stats_t::connections);
+    counter("modbus_connections_total", "counter", "Accepted Modbus/TCP connections.", &stats_t::connections_total);
+    counter("modbus_accept_rejected_total",
+            "counter",
+            "Connections that were closed on accept because the connection limit was reached.",
+            &stats_t::accept_rejected);
+    counter("modbus_loop_iterations_total", "counter", "Iterations of the event loops.", &stats_t::loop_iterations);
+    counter("modbus_capture_dropped_total",
+            "counter",
+            "ADUs that were not captured because the capture ring buffer was full.",
+            &stats_t::capture_dropped);
+
+    metric_header(out, "modbus_log_dropped_total", "counter", "Log messages that were dropped (log queue full).");
+    out << "modbus_log_dropped_total " << Log::get_dropped() << '\n';
+
+    // lock contention
+    Histogram     wait;
+    Histogram     hold;
+    std::uint64_t timeouts       = 0;
+    std::uint64_t table_timeouts = 0;
+    std::uint64_t busy           = 0;
+    std::uint64_t recovered      = 0;
+    for (const auto *source : sources) {
+        const auto &stats = source->get_lock_stats();
+        wait.merge(stats.wait);
+        hold.merge(stats.hold);
+        timeouts += stats.timeouts.load(std::memory_order_relaxed);
+        table_timeouts += stats.table_timeouts.load(std::memory_order_relaxed);
+        busy += stats.busy.load(std::memory_order_relaxed);
+        recovered += stats.recovered.load(std::memory_order_relaxed);
+    }
+
+    summary(out, "modbus_lock_wait_seconds", "Time to acquire the semaphore, lock and table locks.", wait);
+    summary(out, "modbus_lock_hold_seconds", "Time the semaphore, lock and table locks are held.", hold);
+
+    metric_header(out, "modbus_lock_timeouts_total", "counter", "Semaphore/lock acquisitions that timed out.");
+    out << "modbus_lock_timeouts_total " << timeouts << '\n';
+    metric_header(out, "modbus_table_lock_timeouts_total", "counter", "Table lock acquisitions that timed out.");
+    out << "modbus_table_lock_timeouts_total " << table_timeouts << '\n';
+    metric_header(out, "modbus_busy_responses_total", "counter", "Requests answered with the exception 0x06.");
+    out << "modbus_busy_responses_total " << busy << '\n';
+    metric_header(out, "modbus_lock_recovered_total", "counter", "Locks recovered from a terminated owner.");
+    out << "modbus_lock_recovered_total " << recovered << '\n';
+
+    // request latency (only function codes and unit ids with requests)
+    using latency_t = TCP::Client_Poll::latency_stats_t;
+    static constexpr std::array<const char *, latency_t::PHASE_COUNT> PHASES {"queue", "execute", "send", "total"};
+
+    metric_header(out,
+                  "modbus_request_latency_seconds",
+                  "summary",
+                  "Server-side latency of Modbus requests by function code and phase.");
+    for (std::size_t function = 0; function <= latency_t::OTHER_FUNCTIONS; ++function) {
+        const auto code = function < latency_t::OTHER_FUNCTIONS
+                                  ? std::to_string(latency_t::FUNCTION_CODES[function])  // NOLINT
+                                  : std::string("other");
+        for (std::size_t phase = 0; phase < latency_t::PHASE_COUNT; ++phase) {
+            Histogram latency;
+            for (const auto *source : sources)
+                latency.merge(source->get_latency_stats().functions[function][phase]);  // NOLINT
+            if (latency.count() == 0) continue;
+
+            const auto labels = "function_code=\"" + code + "\",phase=\"" + PHASES[phase] + '"';  // NOLINT
+            summary_values(out, "modbus_request_latency_seconds", labels, latency);
+        }
+    }
+
+    metric_header(out,
+                  "modbus_unit_request_latency_seconds",
+                  "summary",
+                  "Server-side latency (request received --> reply sent) of Modbus requests by unit id.");
+    for (std::size_t unit = 0; unit < TCP::Client_Poll::MAX_CLIENT_IDS; ++unit) {
+        Histogram latency;
+        for (const auto *source : sources)
+            latency.merge(source->get_latency_stats().units[unit]);  // NOLINT
+        if (latency.count() == 0) continue;
+
+        summary_values(out, "modbus_unit_request_latency_seconds", "unit_id=\"" + std::to_string(unit) + '"', latency);
+    }
+
+    return out.str();
+}
+
+}  // namespace Modbus
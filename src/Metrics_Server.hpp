@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Modbus_TCP_Client_poll.hpp"
+
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Modbus {
+
+/*! \brief HTTP endpoint that provides the statistics of Client_Poll objects in the Prometheus text format
+ *
+ * Every HTTP request (any method and path) is answered with the current metrics. The connection is closed after the
+ * reply. The statistics of all sources are combined.
+ *
+ * The sockets are handled by the event loop of a Client_Poll object (no additional thread).
+ */
+class Metrics_Server final {
+private:
+    //! connection of a scraper
+    struct scraper_t {
+        std::string request;          //!< received part of the request
+        std::string reply;            //!< rendered reply (empty until the request is complete)
+        std::size_t sent    = 0;      //!< number of bytes of reply that are sent
+        bool        writing = false;  //!< the socket is watched for POLLOUT
+    };
+
+    std::string                           address;              //!< listen address (see constructor)
+    std::string                           unix_path;            //!< socket file (removed on destruction)
+    int                                   listen_fd = -1;       //!< listening socket
+    TCP::Client_Poll                     *client    = nullptr;  //!< event loop that handles the sockets
+    std::vector<const TCP::Client_Poll *> sources;              //!< Client_Poll objects whose statistics are reported
+    std::unordered_map<int, scraper_t>    scrapers;             //!< connected scrapers (key: socket)
+
+public:
+    /*! \brief create the listening socket
+     *
+     * @param address unix socket (path that contains a '/' or @name for an abstract socket) or tcp socket (port,
+     *                host:port or [ipv6]:port, port only: 127.0.0.1)
+     * @param force remove an existing socket file
+     * @param permissions socket file permissions
+     */
+    Metrics_Server(const std::string &address, bool force, mode_t permissions);
+
+    ~Metrics_Server();
+
+    Metrics_Server(const Metrics_Server &other)            = delete;
+    Metrics_Server(Metrics_Server &&other)                 = delete;
+    Metrics_Server &operator=(const Metrics_Server &other) = delete;
+    Metrics_Server &operator=(Metrics_Server &&other)      = delete;
+
+    /*! \brief report the statistics of a Client_Poll object
+     *
+     * @details the Client_Poll object must exist until this object is destroyed. It may be used by another thread.
+     *
+     * @param source Client_Poll object
+     */
+    void add_source(const TCP::Client_Poll &source);
+
+    /*! \brief handle the sockets in the event loop of a Client_Poll object
+     *
+     * @details the Client_Poll object must exist until this object is destroyed
+     *
+     * @param event_loop Client_Poll object
+     */
+    void attach(TCP::Client_Poll &event_loop);
+
+    /*! \brief get the current metrics
+     *
+     * @return metrics in the Prometheus text format
+     */
+    [[nodiscard]] std::string render() const;
+
+    //! get the listen address
+    [[nodiscard]] const std::string &get_address() const noexcept { return address; }
+
+private:
+    void listen_unix(bool force, mode_t permissions);
+
+    void listen_tcp();
+
+    void accept_scraper();
+
+    void handle_scraper(int fd);
+
+    /*! \brief send the reply to a scraper
+     *
+     * @details never blocks: the socket is watched for POLLOUT until the reply is sent completely
+     *
+     * @param fd socket of the scraper
+     */
+    void send_reply(int fd);
+
+    void close_scraper(int fd);
+};
+
+}  // namespace Modbus
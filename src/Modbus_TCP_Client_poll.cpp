@@ -5,14 +5,21 @@
 
 #include "Modbus_TCP_Client_poll.hpp"
 
-#include "Print_Time.hpp"
+#include "Log.hpp"
+#include "PDU_Engine.hpp"
+#include "Shm_Control.hpp"
 #include "sa_to_str.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <sys/socket.h>
 #include <system_error>
 
@@ -21,17 +28,51 @@ namespace Modbus::TCP {
 //* maximum number of Modbus registers (per type)
 static constexpr int MAX_REGS = 0x10000;
 
-//* value to increment error counter if semaphore could not be acquired
-static constexpr long SEMAPHORE_ERROR_INC = 10;
+//* size of a Modbus/TCP exception reply (MBAP header + function code + exception code)
+static constexpr int EXCEPTION_REPLY_SIZE = 9;
 
-//* value to decrement error counter if semaphore could be acquired
-static constexpr long SEMAPHORE_ERROR_DEC = 1;
+//* offset of the function code in a Modbus/TCP ADU
+static constexpr std::size_t FC = 7;
 
-//* maximum value of semaphore error counter
-static constexpr long SEMAPHORE_ERROR_MAX = 1000;
+//* function code flag of exception replies
+static constexpr std::uint8_t EXCEPTION_FLAG = 0x80;
 
-//* maximum time to wait for semaphore (100ms)
-static constexpr struct timespec SEMAPHORE_MAX_TIME = {0, 100'000};
+//* maximum size of the unsent replies of a connection (peers that do not read their replies are not read any more)
+static constexpr std::size_t MAX_TX_BUFFER = 256 * 1024;
+
+//* maximum number of bytes of an ADU that are logged by the packet monitor (one log message per ADU)
+static constexpr std::size_t MONITOR_MAX_BYTES = 128;
+
+/**
+ * @brief increment a statistics counter (only written by the thread that calls run, no locked instruction required)
+ */
+static inline void count(std::atomic<std::uint64_t> &counter, std::uint64_t n = 1) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief format an ADU for the packet monitor (--monitor)
+ *
+ * @details longer ADUs are shortened, so that the line fits into one log message
+ *
+ * @param adu request or reply
+ * @return bytes in hex, separated by spaces
+ */
+static std::string hex_dump(std::span<const std::uint8_t> adu) {
+    static constexpr std::string_view DIGITS = "0123456789ABCDEF";
+
+    const auto  size = std::min(adu.size(), MONITOR_MAX_BYTES);
+    std::string text;
+    text.reserve(3 * size);
+    for (std::size_t i = 0; i < size; ++i) {
+        if (i != 0) text += ' ';
+        text += DIGITS[adu[i] >> 4U];    // NOLINT
+        text += DIGITS[adu[i] & 0xFU];  // NOLINT
+    }
+
+    if (size < adu.size()) text += " ... (" + std::to_string(adu.size()) + " bytes)";
+    return text;
+}
 
 Client_Poll::Client_Poll(const std::string &host,
                          const std::string &service,
@@ -68,10 +109,10 @@ Client_Poll::Client_Poll(const std::string &host,
 
     // use mapping for all client ids
     for (std::size_t i = 0; i < MAX_CLIENT_IDS; ++i) {
-        this->mappings[i] = mb_mapping;  // NOLINT
+        this->tables[i].mapping = mb_mapping;  // NOLINT
     }
 
-    listen();
+    listen(host_str, service.c_str(), false);
 
 #ifdef OS_LINUX
     if (tcp_timeout) set_tcp_timeout(tcp_timeout);
@@ -80,11 +121,12 @@ Client_Poll::Client_Poll(const std::string &host,
 #endif
 }
 
-Client_Poll::Client_Poll(const std::string                              &host,
-                         const std::string                              &service,
-                         std::array<modbus_mapping_t *, MAX_CLIENT_IDS> &mappings,
-                         std::size_t                                     tcp_timeout,  // NOLINT
-                         std::size_t                                     max_clients)                                      // NOLINT
+Client_Poll::Client_Poll(const std::string                                 &host,
+                         const std::string                                 &service,
+                         const std::array<Register_Tables, MAX_CLIENT_IDS> &tables,
+                         std::size_t                                        tcp_timeout,  // NOLINT
+                         std::size_t                                        max_clients,  // NOLINT
+                         bool                                               reuse_port)
     : max_clients(max_clients), poll_fds(max_clients + 2, {0, 0, 0}) {
     const char *host_str = "::";
     if (!(host.empty() || host == "any")) host_str = host.c_str();
@@ -99,7 +141,7 @@ Client_Poll::Client_Poll(const std::string                              &host,
     delete_mapping = nullptr;
 
     for (std::size_t i = 0; i < MAX_CLIENT_IDS; ++i) {
-        if (mappings[i] == nullptr) {  // NOLINT
+        if (tables[i].mapping == nullptr) {  // NOLINT
             if (delete_mapping == nullptr) {
                 delete_mapping = modbus_mapping_new(MAX_REGS, MAX_REGS, MAX_REGS, MAX_REGS);
 
@@ -109,13 +151,13 @@ Client_Poll::Client_Poll(const std::string                              &host,
                     throw std::runtime_error("failed to allocate memory: " + error_msg);
                 }
             }
-            this->mappings[i] = delete_mapping;  // NOLINT
+            this->tables[i].mapping = delete_mapping;  // NOLINT
         } else {
-            this->mappings[i] = mappings[i];  // NOLINT
+            this->tables[i] = tables[i];  // NOLINT
         }
     }
 
-    listen();
+    listen(host_str, service.c_str(), reuse_port);
 
 #ifdef OS_LINUX
     if (tcp_timeout) set_tcp_timeout(tcp_timeout);
@@ -124,9 +166,49 @@ Client_Poll::Client_Poll(const std::string                              &host,
 #endif
 }
 
-void Client_Poll::listen() {
+/**
+ * @brief create a listening tcp socket with SO_REUSEPORT (like modbus_tcp_pi_listen)
+ * @param host host to listen for incoming connections
+ * @param service service/port to listen for incoming connections
+ * @return listening socket or -1 on error (errno is set)
+ */
+static int listen_reuse_port(const char *host, const char *service) {
+    struct addrinfo hints {};
+    hints.ai_flags    = AI_PASSIVE;
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *addr_list = nullptr;
+    const int        tmp       = getaddrinfo(host, service, &hints, &addr_list);
+    if (tmp != 0) {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+
+    int sock = -1;
+    for (auto *addr = addr_list; addr != nullptr; addr = addr->ai_next) {
+        sock = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (sock == -1) continue;
+
+        int enable = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == 0 &&
+            setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0 &&
+            bind(sock, addr->ai_addr, addr->ai_addrlen) == 0 && ::listen(sock, 1) == 0)
+            break;
+
+        const int error = errno;
+        close(sock);
+        errno = error;
+        sock  = -1;
+    }
+
+    freeaddrinfo(addr_list);
+    return sock;
+}
+
+void Client_Poll::listen(const char *host, const char *service, bool reuse_port) {
     // create tcp socket
-    server_socket = modbus_tcp_pi_listen(modbus, 1);
+    server_socket = reuse_port ? listen_reuse_port(host, service) : modbus_tcp_pi_listen(modbus, 1);
     if (server_socket == -1) {
         if (errno == ECONNREFUSED) {
             throw std::runtime_error("failed to create tcp socket: unknown or invalid service");
@@ -152,6 +234,9 @@ Client_Poll::~Client_Poll() {
     }
     if (delete_mapping) modbus_mapping_free(delete_mapping);
     if (server_socket != -1) { close(server_socket); }
+#ifdef OS_LINUX
+    if (epoll_fd != -1) { close(epoll_fd); }
+#endif
 }
 
 #ifdef OS_LINUX
@@ -187,9 +272,148 @@ void Client_Poll::set_tcp_timeout(std::size_t tcp_timeout) const {
 #endif
 
 void Client_Poll::enable_semaphore(const std::string &name, bool force) {
-    if (semaphore) throw std::logic_error("semaphore already enabled");
+    if (semaphore || shm_lock) throw std::logic_error("semaphore already enabled");
+
+    semaphore       = std::make_shared<cxxsemaphore::Semaphore>(name, 1, force);
+    semaphore_mutex = std::make_shared<std::timed_mutex>();
+}
+
+void Client_Poll::enable_lock(const std::string &name, bool force, mode_t permissions) {
+    if (semaphore || shm_lock) throw std::logic_error("semaphore already enabled");
+
+    shm_lock = std::make_shared<shm::Shm_Lock>(name, force, permissions);
+}
+
+void Client_Poll::share_semaphore(const Client_Poll &other) {
+    if (semaphore || shm_lock) throw std::logic_error("semaphore already enabled");
+    if (!other.semaphore && !other.shm_lock) throw std::logic_error("semaphore of other Client_Poll not enabled");
+
+    semaphore       = other.semaphore;
+    semaphore_mutex = other.semaphore_mutex;
+    shm_lock        = other.shm_lock;
+}
+
+void Client_Poll::set_lock_timeout(double timeout) {
+    if (timeout < 0) throw std::invalid_argument("lock timeout must not be negative");
+
+    lock_timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(timeout));
+}
+
+void Client_Poll::set_lock_batch(std::size_t max_requests, double max_time) {
+    if (max_requests == 0) throw std::invalid_argument("lock batch size must be at least 1");
+    if (max_time < 0) throw std::invalid_argument("lock batch time must not be negative");
+
+    lock_batch_size = max_requests;
+    lock_batch_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(max_time));
+}
+
+void Client_Poll::set_mapping_factory(mapping_factory_t factory) {
+    mapping_factory = std::move(factory);
+
+    // client ids without own register tables are created by the factory
+    for (auto &table : tables) {
+        if (table.mapping == delete_mapping) table.mapping = nullptr;
+    }
+}
+
+void Client_Poll::set_backend(backend_t new_backend) {
+    if (new_backend == backend) return;
+    if (!connections.empty()) throw std::logic_error("cannot change event backend while connections are active");
+
+    // release resources of the current backend
+#ifdef OS_LINUX
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+        epoll_fd        = -1;
+        epoll_signal_fd = -1;
+        epoll_server    = false;
+    }
+#endif
+#ifdef IO_URING_ENABLED
+    uring.reset();
+    uring_signal_fd = -1;
+    uring_server    = false;
+#endif
+    backend = backend_t::poll;
+
+    if (new_backend == backend_t::epoll) {
+#ifdef OS_LINUX
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1) throw std::system_error(errno, std::generic_category(), "Failed to create epoll instance");
+        epoll_events.resize(max_clients + 2);
+#else
+        throw std::runtime_error("epoll is only available on linux systems");
+#endif
+    } else if (new_backend == backend_t::io_uring) {
+#ifdef IO_URING_ENABLED
+        try {
+            uring = std::make_unique<Uring>();
+        } catch (const std::system_error &e) {
+            Log::warning() << "io_uring is not available (" << e.what() << "). Falling back to poll.";
+            return;
+        }
+#else
+        throw std::runtime_error("io_uring support is not enabled (compile with ENABLE_IO_URING)");
+#endif
+    }
+
+    backend = new_backend;
+
+    for (const auto &aux : aux_fds)
+        watch_aux_fd(aux.first, aux.second);
+}
+
+void Client_Poll::add_aux_fd(int fd, aux_handler_t handler, short events) {
+    auto [aux, inserted] = aux_fds.try_emplace(fd);
+    if (!inserted) throw std::logic_error("file descriptor is already watched");
 
-    semaphore = std::make_unique<cxxsemaphore::Semaphore>(name, 1, force);
+    aux->second.handler    = std::move(handler);
+    aux->second.events     = events;
+    aux->second.generation = ++aux_generation;
+
+    try {
+        watch_aux_fd(fd, aux->second);
+    } catch (const std::system_error &) {
+        aux_fds.erase(fd);
+        throw;
+    }
+}
+
+void Client_Poll::remove_aux_fd(int fd) {
+    if (aux_fds.erase(fd) == 0) return;
+
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+#ifdef IO_URING_ENABLED
+    if (backend == backend_t::io_uring) uring->cancel(fd);
+#endif
+}
+
+void Client_Poll::watch_aux_fd([[maybe_unused]] int fd, [[maybe_unused]] const aux_fd_t &aux) {
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) {
+        // the poll and epoll event flags have the same values
+        struct epoll_event event {};
+        event.events  = static_cast<std::uint32_t>(aux.events);
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+            throw std::system_error(errno, std::generic_category(), "Failed to update epoll set (aux fd)");
+        epoll_events.resize(max_clients + 2 + aux_fds.size());
+    }
+#endif
+#ifdef IO_URING_ENABLED
+    if (backend == backend_t::io_uring) uring->poll(fd, aux.generation, static_cast<std::uint32_t>(aux.events));
+#endif
+}
+
+void Client_Poll::handle_aux(int fd, short revents) {
+    const auto aux = aux_fds.find(fd);
+    if (aux == aux_fds.end()) return;  // removed by a previous handler
+
+    // copy: the handler may remove the fd
+    const auto handler = aux->second.handler;
+    handler(revents);
 }
 
 void Client_Poll::set_debug(bool enable_debug) {
@@ -225,6 +449,8 @@ void Client_Poll::set_byte_timeout(double timeout) {
         const std::string error_msg = modbus_strerror(errno);
         throw std::runtime_error("modbus_set_byte_timeout failed: " + error_msg + ' ' + std::to_string(errno));
     }
+
+    byte_timeout = std::chrono::seconds(T.sec) + std::chrono::microseconds(T.usec);
 }
 
 void Client_Poll::set_response_timeout(double timeout) {
@@ -264,6 +490,47 @@ void Client_Poll::set_response_timeout(double timeout) {
 }
 
 Client_Poll::run_t Client_Poll::run(int signal_fd, bool reconnect, int timeout) {
+    count(traffic_stats.loop_iterations);
+
+    // wake up in time to close connections that exceed the byte timeout
+    const int wait = byte_timeout_wait(timeout);
+
+    auto ret = [&]() {
+#ifdef IO_URING_ENABLED
+        if (backend == backend_t::io_uring) return run_uring(signal_fd, wait);
+#endif
+#ifdef OS_LINUX
+        if (backend == backend_t::epoll) return run_epoll(signal_fd, wait);
+#endif
+        return run_poll(signal_fd, wait);
+    }();
+    if (ret == run_t::timeout && wait != timeout) ret = run_t::ok;  // only the byte timeout expired
+
+    // release the lock of the requests handled in this iteration and send the deferred replies
+    finish_lock_batch();
+
+    // eventfds of the written tables are signaled once per iteration (never while a lock is held)
+    for (auto *control : notify_pending)
+        control->signal_eventfds();
+    notify_pending.clear();
+
+    close_timed_out_connections();
+
+    if (ret != run_t::ok) return ret;
+
+    // check if there are any connections
+    if (!reconnect) {
+        if (connections.empty()) return run_t::term_nocon;
+    }
+
+    return run_t::ok;
+}
+
+Client_Poll::run_t Client_Poll::run_poll(int signal_fd, int timeout) {
+    // signal fd + server socket + aux fds + connections
+    const std::size_t max_poll_size = max_clients + 2 + aux_fds.size();
+    if (poll_fds.size() < max_poll_size) poll_fds.resize(max_poll_size, {0, 0, 0});
+
     std::size_t i = 0;
 
     // poll signal fd
@@ -274,7 +541,7 @@ Client_Poll::run_t Client_Poll::run(int signal_fd, bool reconnect, int timeout)
     }
 
     // do not poll server socket if maximum number of connections is reached
-    const auto active_clients = client_addrs.size();
+    const auto active_clients = connections.size();
     const bool poll_server    = active_clients < max_clients;
     if (poll_server) {
         auto &fd  = poll_fds[i++];
@@ -282,15 +549,25 @@ Client_Poll::run_t Client_Poll::run(int signal_fd, bool reconnect, int timeout)
         fd.events = POLLIN;
     }
 
+    // add auxiliary file descriptors to poll
+    for (const auto &aux : aux_fds) {
+        auto &fd  = poll_fds[i++];
+        fd.fd     = aux.first;
+        fd.events = aux.second.events;
+    }
+    const std::size_t aux_end = i;
+
     // add client sockets to poll
-    for (const auto &con : client_addrs) {
+    for (const auto &con : connections) {
         auto &fd  = poll_fds[i++];
         fd.fd     = con.first;
-        fd.events = POLLIN;
+        fd.events = 0;
+        if (wants_input(con.second)) fd.events |= POLLIN;
+        if (wants_output(con.second)) fd.events |= POLLOUT;
     }
 
     // number of files to poll
-    const nfds_t poll_size = active_clients + (poll_server ? 2 : 1);
+    const nfds_t poll_size = aux_end + active_clients;
 
     int tmp = poll(poll_fds.data(), poll_size, timeout);
     if (tmp == -1) {
@@ -323,32 +600,7 @@ Client_Poll::run_t Client_Poll::run(int signal_fd, bool reconnect, int timeout)
             else if (fd.revents & POLLHUP)
                 throw std::logic_error("poll (server socket) returned POLLHUP");
             else if (fd.revents & POLLIN || fd.revents & POLLERR) {
-                tmp = modbus_tcp_pi_accept(modbus, &server_socket);
-                if (tmp < 0) {
-                    const std::string error_msg = modbus_strerror(errno);
-                    throw std::runtime_error("modbus_tcp_accept failed: " + error_msg);
-                }
-
-                auto client_socket = modbus_get_socket(modbus);
-
-                struct sockaddr_storage peer_addr;  // NOLINT
-                socklen_t               len = sizeof(peer_addr);
-                tmp = getpeername(client_socket, reinterpret_cast<struct sockaddr *>(&peer_addr), &len);  // NOLINT
-
-                if (tmp < 0) {
-                    const std::string error_msg = modbus_strerror(errno);
-                    throw std::runtime_error("getpeername failed: " + error_msg);
-                }
-
-                std::ostringstream sstr;
-
-                sstr << sockaddr_to_str(peer_addr);
-                // the port entries have the same offset and size in sockaddr_in and sockaddr_in6
-                sstr << ':' << htons(reinterpret_cast<const struct sockaddr_in *>(&peer_addr)->sin_port);  // NOLINT
-
-                client_addrs[client_socket] = sstr.str();
-                std::cerr << Print_Time::iso << " INFO: [" << active_clients + 1 << "] Modbus Server (" << sstr.str()
-                          << ") established connection." << std::endl;  // NOLINT
+                accept_connection();
             } else {
                 std::ostringstream sstr;
                 sstr << "poll (server socket) returned unknown revent: " << fd.revents;
@@ -357,88 +609,1033 @@ Client_Poll::run_t Client_Poll::run(int signal_fd, bool reconnect, int timeout)
         }
     }
 
+    for (; i < aux_end; ++i) {
+        const auto &fd = poll_fds[i];
+        if (fd.revents) handle_aux(fd.fd, fd.revents);
+    }
+
     for (; i < poll_size; ++i) {
         auto &fd = poll_fds[i];
 
-        auto close_con = [&fd](auto &_client_addrs) {
-            close(fd.fd);
-            std::cerr << Print_Time::iso << " INFO: [" << _client_addrs.size() - 1 << "] Modbus server ("
-                      << _client_addrs[fd.fd] << ") connection closed." << std::endl;
-            _client_addrs.erase(fd.fd);
-        };
-
         if (fd.revents) {
             if (fd.revents & POLLNVAL) {
                 std::ostringstream sstr;
-                sstr << "poll (client socket: " << client_addrs.at(fd.fd) << ") returned POLLNVAL";
+                sstr << "poll (client socket: " << connections.at(fd.fd).addr << ") returned POLLNVAL";
                 throw std::logic_error(sstr.str());
             }
 
-            if (fd.revents & POLLHUP & !(fd.revents & POLLERR)) {
-                close_con(client_addrs);
-            } else if (fd.revents & POLLIN || fd.revents & POLLERR) {
-                modbus_set_socket(modbus, fd.fd);
-
-                std::array<uint8_t, MODBUS_TCP_MAX_ADU_LENGTH> query {};
-                int                                            rc = modbus_receive(modbus, query.data());
-                if (debug) std::cout.flush();
-
-                if (rc > 0) {
-                    const auto CLIENT_ID = query[6];
-
-                    // get mapping
-                    auto mapping = mappings[CLIENT_ID];  // NOLINT
-
-                    // handle request
-                    if (semaphore) {
-                        if (!semaphore->wait(SEMAPHORE_MAX_TIME)) {
-                            std::cerr << Print_Time::iso << " WARNING: Failed to acquire semaphore '"
-                                      << semaphore->get_name() << "' within 100ms." << std::endl;  // NOLINT
-
-                            semaphore_error_counter += SEMAPHORE_ERROR_INC;
-
-                            if (semaphore_error_counter >= SEMAPHORE_ERROR_MAX) {
-                                std::cerr << Print_Time::iso << "ERROR: Repeatedly failed to acquire the semaphore"
-                                          << std::endl;  // NOLINT
-                                close_con(client_addrs);
-                                return run_t::semaphore;
-                            }
-                        } else {
-                            semaphore_error_counter -= SEMAPHORE_ERROR_DEC;
-                            if (semaphore_error_counter < 0) semaphore_error_counter = 0;
-                        }
-                    }
-
-                    int ret = modbus_reply(modbus, query.data(), rc, mapping);
-                    if (semaphore && semaphore->is_acquired()) semaphore->post();
-                    if (debug) std::cout.flush();
-
-                    if (ret == -1) {
-                        std::cerr << Print_Time::iso << " ERROR: modbus_reply failed: " << modbus_strerror(errno)
-                                  << std::endl;  // NOLINT
-                        close_con(client_addrs);
-                    }
-                } else if (rc == -1) {
-                    if (errno != ECONNRESET) {
-                        std::cerr << Print_Time::iso << " ERROR: modbus_receive failed: " << modbus_strerror(errno)
-                                  << std::endl;  // NOLINT
-                    }
-                    close_con(client_addrs);
-                } else {  // rc == 0
-                    close_con(client_addrs);
+            // hangup without remaining data (POLLIN is not polled while the connection waits for its replies)
+            if (fd.revents & POLLHUP && !(fd.revents & POLLIN)) {
+                close_connection(fd.fd);
+                continue;
+            }
+
+            if (fd.revents & POLLOUT) {
+                const auto ret = handle_writable(fd.fd);
+                if (ret != run_t::ok) return ret;
+                if (!connections.contains(fd.fd)) continue;
+            }
+
+            if (fd.revents & POLLIN || fd.revents & POLLERR) {
+                const auto ret = handle_client(fd.fd);
+                if (ret != run_t::ok) return ret;
+            }
+        }
+    }
+
+    return run_t::ok;
+}
+
+#ifdef OS_LINUX
+void Client_Poll::epoll_update_server() {
+    // do not wait for new connections if maximum number of connections is reached
+    const bool register_server = connections.size() < max_clients;
+    if (register_server == epoll_server) return;
+
+    struct epoll_event event {};
+    event.events  = EPOLLIN;
+    event.data.fd = server_socket;
+
+    const int op = register_server ? EPOLL_CTL_ADD : EPOLL_CTL_DEL;
+    if (epoll_ctl(epoll_fd, op, server_socket, &event) == -1)
+        throw std::system_error(errno, std::generic_category(), "Failed to update epoll set (server socket)");
+
+    epoll_server = register_server;
+}
+
+Client_Poll::run_t Client_Poll::run_epoll(int signal_fd, int timeout) {
+    if (signal_fd != epoll_signal_fd) {
+        if (epoll_signal_fd != -1) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, epoll_signal_fd, nullptr);
+
+        struct epoll_event event {};
+        event.events  = EPOLLIN;
+        event.data.fd = signal_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) == -1)
+            throw std::system_error(errno, std::generic_category(), "Failed to update epoll set (signal fd)");
+        epoll_signal_fd = signal_fd;
+    }
+
+    epoll_update_server();
+
+    const int tmp = epoll_wait(epoll_fd, epoll_events.data(), static_cast<int>(epoll_events.size()), timeout);
+    if (tmp == -1) {
+        if (errno == EINTR) return run_t::interrupted;
+        throw std::system_error(errno, std::generic_category(), "Failed to wait for socket(s) (epoll)");
+    } else if (tmp == 0) {
+        // epoll timed out
+        return run_t::timeout;
+    }
+
+    const auto num_events = static_cast<std::size_t>(tmp);
+
+    // termination signals have priority over everything else
+    for (std::size_t i = 0; i < num_events; ++i) {
+        const auto &event = epoll_events[i];
+        if (event.data.fd != signal_fd) continue;
+
+        if (event.events & EPOLLERR) throw std::logic_error("epoll (signal fd) returned EPOLLERR");
+        if (event.events & EPOLLHUP) throw std::logic_error("epoll (signal fd) returned EPOLLHUP");
+        return run_t::term_signal;
+    }
+
+    // server socket and aux fds before the client sockets (like run_poll):
+    // they are never handled while the lock of a batch is held
+    for (std::size_t i = 0; i < num_events; ++i) {
+        const auto &event = epoll_events[i];
+        const int   fd    = event.data.fd;
+
+        if (fd == server_socket) {
+            if (event.events & EPOLLHUP) throw std::logic_error("epoll (server socket) returned EPOLLHUP");
+            accept_connection();
+        } else if (aux_fds.contains(fd)) {
+            handle_aux(fd, static_cast<short>(event.events));
+        }
+    }
+
+    for (std::size_t i = 0; i < num_events; ++i) {
+        const auto &event = epoll_events[i];
+        const int   fd    = event.data.fd;
+
+        if (fd == signal_fd || fd == server_socket || aux_fds.contains(fd)) continue;
+
+        // connection closed while handling a previous event
+        if (!connections.contains(fd)) continue;
+
+        if (event.events & EPOLLOUT) {
+            const auto ret = handle_writable(fd);
+            if (ret != run_t::ok) return ret;
+            if (!connections.contains(fd)) continue;
+        }
+
+        if (event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            // connection waits for its replies to be sent (not read until then)
+            if (!wants_input(connections.at(fd))) {
+                if (event.events & (EPOLLERR | EPOLLHUP)) close_connection(fd);
+                continue;
+            }
+
+            const auto ret = handle_client(fd);
+            if (ret != run_t::ok) return ret;
+        }
+    }
+
+    return run_t::ok;
+}
+
+void Client_Poll::epoll_update_client(int client_fd) {
+    auto &con = connections.at(client_fd);
+
+    std::uint32_t mask = 0;
+    if (wants_input(con)) mask |= EPOLLIN;
+    if (wants_output(con)) mask |= EPOLLOUT;
+    if (mask == con.epoll_mask) return;
+
+    struct epoll_event event {};
+    event.events  = mask;
+    event.data.fd = client_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &event) == -1)
+        throw std::system_error(errno, std::generic_category(), "Failed to update epoll set (client socket)");
+
+    con.epoll_mask = mask;
+}
+#endif
+
+#ifdef IO_URING_ENABLED
+void Client_Poll::uring_update_server() {
+    // do not accept new connections if maximum number of connections is reached
+    const bool accept = connections.size() < max_clients;
+    if (accept == uring_server) return;
+
+    if (accept) uring->accept_multishot(server_socket);
+    else
+        uring->cancel_accept(server_socket);
+
+    uring_server = accept;
+}
+
+Client_Poll::run_t Client_Poll::run_uring(int signal_fd, int timeout) {
+    if (signal_fd != uring_signal_fd) {
+        uring->poll_signal(signal_fd);
+        uring_signal_fd = signal_fd;
+    }
+
+    uring_update_server();
+
+    const int tmp = uring->submit_and_wait(timeout);
+    if (tmp == -EINTR) return run_t::interrupted;
+    if (tmp == -ETIME) return run_t::timeout;
+    if (tmp < 0) throw std::system_error(-tmp, std::generic_category(), "Failed to wait for socket(s) (io_uring)");
+
+    const auto &completions = uring->get_completions();
+
+    // termination signals have priority over everything else
+    for (const auto &completion : completions) {
+        if (completion.op != Uring::op_t::signal) continue;
+
+        if (completion.res < 0)
+            throw std::system_error(-completion.res, std::generic_category(), "io_uring (signal fd) failed");
+        return run_t::term_signal;
+    }
+
+    // accept and aux fds before the client sockets (like run_poll):
+    // they are never handled while the lock of a batch is held
+    for (const auto &completion : completions) {
+        switch (completion.op) {
+            case Uring::op_t::accept: {
+                // multishot accept terminated --> has to be rearmed
+                if (!(completion.flags & IORING_CQE_F_MORE)) uring_server = false;
+
+                if (completion.res == -ECANCELED) break;
+                if (completion.res < 0) {
+                    throw std::system_error(
+                            -completion.res, std::generic_category(), "Failed to accept connection (io_uring)");
+                }
+
+                // connection was accepted before the accept operation could be canceled
+                if (connections.size() >= max_clients) {
+                    close(completion.res);
+                    count(traffic_stats.accept_rejected);
+                    break;
                 }
+
+                const auto &con = add_connection(completion.res);
+                uring->recv_multishot(completion.res, con.generation);
+                break;
+            }
+            case Uring::op_t::poll: {
+                auto aux = aux_fds.find(completion.fd);
+                if (aux == aux_fds.end() || aux->second.generation != completion.generation) break;  // removed
+                if (completion.res < 0)
+                    throw std::system_error(-completion.res, std::generic_category(), "io_uring (aux fd) failed");
+
+                handle_aux(completion.fd, static_cast<short>(completion.res));
+
+                // wait for the next event if the handler did not remove the fd
+                aux = aux_fds.find(completion.fd);
+                if (aux != aux_fds.end() && aux->second.generation == completion.generation)
+                    uring->poll(completion.fd, completion.generation, static_cast<std::uint32_t>(aux->second.events));
+                break;
             }
+            case Uring::op_t::recv:
+            case Uring::op_t::send:
+            case Uring::op_t::signal:
+            case Uring::op_t::cancel: break;
         }
     }
 
-    // check if there are any connections
-    if (!reconnect) {
-        if (client_addrs.empty()) return run_t::term_nocon;
+    for (const auto &completion : completions) {
+        switch (completion.op) {
+            case Uring::op_t::recv: {
+                const auto ret = uring_receive(completion);
+                if (ret != run_t::ok) return ret;
+                break;
+            }
+            case Uring::op_t::send: {
+                const auto ret = uring_send_complete(completion);
+                if (ret != run_t::ok) return ret;
+                break;
+            }
+            case Uring::op_t::accept:
+            case Uring::op_t::poll:
+            case Uring::op_t::signal:
+            case Uring::op_t::cancel: break;
+        }
+    }
+
+    uring_update_server();
+
+    return run_t::ok;
+}
+
+Client_Poll::run_t Client_Poll::uring_receive(const Uring::completion_t &completion) {
+    const bool has_buffer = completion.flags & IORING_CQE_F_BUFFER;
+
+    auto con = connections.find(completion.fd);
+    if (con == connections.end() || con->second.generation != completion.generation) {
+        // completion of an already closed connection
+        if (has_buffer) uring->recycle_buffer(completion);
+        return run_t::ok;
+    }
+
+    if (completion.res == -ENOBUFS) {
+        // all provided buffers are in use --> receive again
+        if (!(completion.flags & IORING_CQE_F_MORE)) uring->recv_multishot(completion.fd, completion.generation);
+        return run_t::ok;
+    }
+
+    if (completion.res <= 0) {
+        if (completion.res < 0 && completion.res != -ECONNRESET && completion.res != -ECANCELED) {
+            Log::error() << "receive failed: " << strerror(-completion.res);
+        }
+        close_connection(completion.fd);
+        return run_t::ok;
+    }
+
+    if (byte_timeout_exceeded(completion.fd)) {
+        uring->recycle_buffer(completion);
+        return run_t::ok;
+    }
+
+    auto data = uring->get_buffer(completion);
+    count(traffic_stats.bytes_in, data.size());
+    auto &connection = con->second;
+    while (!data.empty() && !connection.deferred) {
+        const auto appended = connection.framer.append(data);
+        data                = data.subspan(appended);
+
+        const auto ret = handle_buffered(completion.fd);
+        if (ret != run_t::ok || !connections.contains(completion.fd)) {
+            uring->recycle_buffer(completion);
+            return ret;
+        }
+    }
+
+    // requests are deferred until the previous replies are sent --> keep the remaining data
+    if (!data.empty()) {
+        if (connection.rx_backlog.size() + data.size() > ADU_Framer::BUFFER_SIZE) {
+            Log::error() << "Modbus server (" << connection.addr << ") does not read its replies.";
+            uring->recycle_buffer(completion);
+            close_connection(completion.fd);
+            return run_t::ok;
+        }
+        connection.rx_backlog.insert(connection.rx_backlog.end(), data.begin(), data.end());
+    }
+    uring->recycle_buffer(completion);
+
+    // multishot receive terminated --> has to be rearmed
+    if (!(completion.flags & IORING_CQE_F_MORE)) uring->recv_multishot(completion.fd, completion.generation);
+
+    return run_t::ok;
+}
+
+Client_Poll::run_t Client_Poll::uring_send_complete(const Uring::completion_t &completion) {
+    auto con = connections.find(completion.fd);
+    if (con == connections.end() || con->second.generation != completion.generation) {
+        // send operation of an already closed connection
+        uring_orphaned_tx.erase(completion.generation);
+        return run_t::ok;
+    }
+
+    auto &connection = con->second;
+
+    if (completion.res < 0) {
+        if (completion.res != -EPIPE && completion.res != -ECONNRESET && completion.res != -ECANCELED) {
+            Log::error() << "send failed: " << strerror(-completion.res);
+        }
+        close_connection(completion.fd);
+        return run_t::ok;
+    }
+
+    // short send --> send the remaining data
+    connection.tx_sent += static_cast<std::size_t>(completion.res);
+    count(traffic_stats.bytes_out, static_cast<std::uint64_t>(completion.res));
+    if (connection.tx_sent < connection.tx_inflight.size()) {
+        uring->send(completion.fd,
+                    completion.generation,
+                    std::span<const std::uint8_t>(connection.tx_inflight).subspan(connection.tx_sent));
+        return run_t::ok;
+    }
+
+    connection.tx_inflight.clear();
+    connection.tx_sent = 0;
+
+    const auto sent = std::chrono::steady_clock::now();
+    for (const auto &timing : connection.inflight_times)
+        record_latency(timing, sent);
+    connection.inflight_times.clear();
+
+    // send replies that were encoded while the send operation was in progress
+    return handle_writable(completion.fd);
+}
+#endif
+
+void Client_Poll::accept_connection() {
+    const int tmp = modbus_tcp_pi_accept(modbus, &server_socket);
+    if (tmp < 0) {
+        const std::string error_msg = modbus_strerror(errno);
+        throw std::runtime_error("modbus_tcp_accept failed: " + error_msg);
+    }
+
+    const auto client_socket = modbus_get_socket(modbus);
+
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) {
+        struct epoll_event event {};
+        event.events  = EPOLLIN;
+        event.data.fd = client_socket;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1) {
+            const int error = errno;
+            close(client_socket);
+            throw std::system_error(error, std::generic_category(), "Failed to update epoll set (client socket)");
+        }
+    }
+#endif
+
+    [[maybe_unused]] auto &con = add_connection(client_socket);
+
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) {
+        con.epoll_mask = EPOLLIN;
+        epoll_update_server();
+    }
+#endif
+}
+
+void Client_Poll::add_client(int client_socket) {
+    if (connections.size() >= max_clients) {
+        close(client_socket);
+        throw std::runtime_error("maximum number of connections reached");
+    }
+
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) {
+        struct epoll_event event {};
+        event.events  = EPOLLIN;
+        event.data.fd = client_socket;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1) {
+            const int error = errno;
+            close(client_socket);
+            throw std::system_error(error, std::generic_category(), "Failed to update epoll set (client socket)");
+        }
+    }
+#endif
+
+    [[maybe_unused]] auto &con = add_connection(client_socket);
+
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) {
+        con.epoll_mask = EPOLLIN;
+        epoll_update_server();
+    }
+#endif
+#ifdef IO_URING_ENABLED
+    if (backend == backend_t::io_uring) uring->recv_multishot(client_socket, con.generation);
+#endif
+}
+
+Client_Poll::connection_t &Client_Poll::add_connection(int client_socket) {
+    struct sockaddr_storage peer_addr;  // NOLINT
+    socklen_t               len = sizeof(peer_addr);
+    const int tmp = getpeername(client_socket, reinterpret_cast<struct sockaddr *>(&peer_addr), &len);  // NOLINT
+
+    if (tmp < 0) {
+        const std::string error_msg = modbus_strerror(errno);
+        close(client_socket);
+        throw std::runtime_error("getpeername failed: " + error_msg);
+    }
+
+    std::ostringstream sstr;
+
+    if (peer_addr.ss_family == AF_INET || peer_addr.ss_family == AF_INET6) {
+        sstr << sockaddr_to_str(peer_addr);
+        // the port entries have the same offset and size in sockaddr_in and sockaddr_in6
+        sstr << ':' << htons(reinterpret_cast<const struct sockaddr_in *>(&peer_addr)->sin_port);  // NOLINT
+    } else {
+        sstr << "local socket";  // e.g. socketpair (add_client)
+    }
+
+    const auto active_clients = connections.size();
+    auto      &con            = connections[client_socket];
+    con.addr                  = sstr.str();
+
+    if (capture) {
+        struct sockaddr_storage local_addr;  // NOLINT
+        socklen_t               local_len = sizeof(local_addr);
+        if (getsockname(client_socket, reinterpret_cast<struct sockaddr *>(&local_addr), &local_len) == 0)  // NOLINT
+            con.flow = Capture_Ring::make_flow(peer_addr, local_addr);
+    }
+#ifdef IO_URING_ENABLED
+    con.generation = ++uring_generation;
+#endif
+    count(traffic_stats.connections_total);
+    traffic_stats.connections.store(connections.size(), std::memory_order_relaxed);
+    Log::info() << "[" << active_clients + 1 << "] Modbus Server (" << con.addr << ") established connection.";
+
+    return con;
+}
+
+void Client_Poll::close_connection(int client_fd) {
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
+#endif
+#ifdef IO_URING_ENABLED
+    if (backend == backend_t::io_uring) {
+        uring->cancel(client_fd);
+
+        // the kernel may still access the data of a pending send operation
+        auto &con = connections[client_fd];
+        if (!con.tx_inflight.empty()) uring_orphaned_tx.emplace(con.generation, std::move(con.tx_inflight));
+    }
+#endif
+
+    close(client_fd);
+    Log::info() << "[" << connections.size() - 1 << "] Modbus server (" << connections[client_fd].addr
+                << ") connection closed.";
+    connections.erase(client_fd);
+    traffic_stats.connections.store(connections.size(), std::memory_order_relaxed);
+}
+
+Client_Poll::run_t Client_Poll::handle_client(int client_fd) {
+    auto &framer = connections.at(client_fd).framer;
+
+    if (byte_timeout_exceeded(client_fd)) return run_t::ok;
+
+    // read everything that is available (never blocks)
+    auto          space = framer.free_space();
+    const ssize_t rc    = recv(client_fd, space.data(), space.size(), MSG_DONTWAIT);
+
+    if (rc > 0) {
+        count(traffic_stats.bytes_in, static_cast<std::uint64_t>(rc));
+        framer.commit(static_cast<std::size_t>(rc));
+        return handle_buffered(client_fd);
+    } else if (rc == -1) {
+        if (errno == EAGAIN || errno == EINTR) return run_t::ok;
+
+        if (errno != ECONNRESET) {
+            Log::error() << "receive failed: " << strerror(errno);
+        }
+        close_connection(client_fd);
+    } else {  // rc == 0
+        close_connection(client_fd);
     }
 
     return run_t::ok;
 }
 
+bool Client_Poll::byte_timeout_exceeded(int client_fd) {
+    auto      &con = connections.at(client_fd);
+    const auto now = std::chrono::steady_clock::now();
+
+    // only relevant if the previously received data ended with an incomplete request
+    // (the buffered requests of a deferred connection are complete)
+    const bool exceeded = con.framer.pending() && !con.deferred && byte_timeout.count() != 0 &&
+                          now - con.last_receive > byte_timeout;
+    con.last_receive    = now;
+
+    if (exceeded) {
+        Log::error() << "Modbus server (" << con.addr << ") exceeded the byte timeout.";
+        close_connection(client_fd);
+    }
+
+    return exceeded;
+}
+
+int Client_Poll::byte_timeout_wait(int timeout) const {
+    if (byte_timeout.count() == 0) return timeout;
+
+    // earliest byte timeout of the connections with an incomplete request
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    for (const auto &[fd, con] : connections) {
+        if (!con.framer.pending() || con.deferred) continue;
+        const auto con_deadline = con.last_receive + byte_timeout;
+        if (!deadline || con_deadline < *deadline) deadline = con_deadline;
+    }
+    if (!deadline) return timeout;
+
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+    const int  wait      = static_cast<int>(std::max(remaining.count(), std::chrono::milliseconds::rep(0)));
+    return timeout < 0 ? wait : std::min(timeout, wait);
+}
+
+void Client_Poll::close_timed_out_connections() {
+    if (byte_timeout.count() == 0) return;
+
+    const auto       now = std::chrono::steady_clock::now();
+    std::vector<int> expired;
+    for (const auto &[fd, con] : connections)
+        if (con.framer.pending() && !con.deferred && now - con.last_receive >= byte_timeout) expired.push_back(fd);
+
+    for (const auto fd : expired) {
+        Log::error() << "Modbus server (" << connections.at(fd).addr << ") exceeded the byte timeout.";
+        close_connection(fd);
+    }
+}
+
+#ifdef OS_LINUX
+/**
+ * @brief enable/disable TCP_CORK
+ *
+ * @details while the socket is corked, the kernel collects sent data and transmits it together once it is uncorked
+ *
+ * @param socket tcp socket
+ * @param enable true: cork, false: uncork (sends all pending data)
+ * @return true on success
+ */
+static bool set_cork(int socket, bool enable) {
+    const int value = enable ? 1 : 0;
+    return setsockopt(socket, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0;
+}
+#endif
+
+/**
+ * @brief check if a socket is writable
+ *
+ * @details libmodbus sends its replies with a blocking send call
+ *
+ * @param socket socket
+ * @return true if data can be sent without blocking (or the send call fails immediately)
+ */
+static bool is_writable(int socket) {
+    struct pollfd fd {};
+    fd.fd     = socket;
+    fd.events = POLLOUT;
+    return poll(&fd, 1, 0) == 1;
+}
+
+Client_Poll::run_t Client_Poll::handle_buffered(int client_fd) {
+    auto &con    = connections.at(client_fd);
+    auto &framer = con.framer;
+
+    [[maybe_unused]] bool corked  = false;
+    std::size_t           handled = 0;
+
+    std::span<const std::uint8_t> query;
+    while (true) {
+        const auto result = framer.next(query);
+        if (result == ADU_Framer::result_t::incomplete) break;
+
+        if (result == ADU_Framer::result_t::invalid) {
+            Log::error() << "received invalid Modbus/TCP frame.";
+            close_connection(client_fd);
+            return run_t::ok;
+        }
+
+        // libmodbus sends the reply immediately --> previous replies have to be sent first
+        // (never while the lock of a batch is held: a slow client would block the other processes)
+        if (!is_native(query)) {
+            if (lock_batch.locked) {
+                release_global_lock();
+                lock_batch.locked = false;
+            }
+            if (!flush_replies(client_fd)) return run_t::ok;
+
+            // the request is handled again once the socket is writable and all previous replies are sent
+            if (!con.tx_buffer.empty() || !con.tx_inflight.empty() || !is_writable(client_fd)) {
+                framer.unget(query);
+                con.deferred = true;
+                break;
+            }
+        }
+
+        if (debug) Log::info() << "request from " << con.addr << ": " << hex_dump(query);
+
+#ifdef OS_LINUX
+        // pipelined requests: the replies of libmodbus are transmitted together after the last request is handled
+        // (the replies of the PDU engine are collected in the output buffer of the connection)
+        if (handled == 1 && libmodbus_reply) corked = set_cork(client_fd, true);
+#endif
+
+        const auto ret = handle_request(client_fd, query);
+        if (ret != run_t::ok || !connections.contains(client_fd)) return ret;
+        ++handled;
+    }
+
+#ifdef OS_LINUX
+    if (corked) set_cork(client_fd, false);
+#endif
+
+    // replies are sent after the lock of the batch is released
+    if (lock_batch.locked) lock_batch.clients.push_back(client_fd);
+    else
+        flush_replies(client_fd);
+
+    return run_t::ok;
+}
+
+Client_Poll::run_t Client_Poll::handle_request(int client_fd, std::span<const std::uint8_t> query) {
+    const auto CLIENT_ID = query[6];
+    const auto FUNCTION  = query[FC];
+
+    count(traffic_stats.requests[FUNCTION]);         // NOLINT
+    count(traffic_stats.unit_requests[CLIENT_ID]);  // NOLINT
+
+    auto &con = connections.at(client_fd);
+    if (capture) capture_adu(con, Capture_Ring::REQUEST, query);
+
+    // the reply is encoded to the output buffer of the connection (latency is recorded once it is sent)
+    const auto encoded = [&](std::chrono::steady_clock::time_point locked, std::size_t offset) {
+        con.tx_times.push_back({FUNCTION, CLIENT_ID, con.last_receive, locked, std::chrono::steady_clock::now()});
+        if (capture) capture_adu(con, Capture_Ring::REPLY, std::span(con.tx_buffer).subspan(offset));
+    };
+
+    // register tables of this client id are created on the first request
+    if (!this->tables[CLIENT_ID].mapping) {  // NOLINT
+        const auto exception = create_tables(CLIENT_ID);
+        if (exception) {
+            const auto offset = con.tx_buffer.size();
+            PDU::reply_exception(query, exception, con.tx_buffer);
+            count(traffic_stats.exceptions[FUNCTION]);  // NOLINT
+            encoded(std::chrono::steady_clock::now(), offset);
+            return run_t::ok;
+        }
+    }
+
+    // get mapping
+    const auto &tables = this->tables[CLIENT_ID];  // NOLINT
+
+    const bool native = is_native(query);
+
+    // handle request (the reply of libmodbus is sent while the lock is held --> no batch)
+    const auto access = PDU::get_table_access(FUNCTION);
+    if (!acquire_lock(tables, access, native)) {
+        count(lock_stats.busy);
+        const auto offset = con.tx_buffer.size();
+        PDU::reply_exception(query, MODBUS_EXCEPTION_SLAVE_OR_SERVER_BUSY, con.tx_buffer);
+        count(traffic_stats.exceptions[FUNCTION]);  // NOLINT
+        encoded(std::chrono::steady_clock::now(), offset);
+        return run_t::ok;
+    }
+    const auto locked = std::chrono::steady_clock::now();
+
+    // registers that are written by the request (only required for other processes)
+    const auto write_range = tables.control ? PDU::get_write_range(query, tables) : std::nullopt;
+    if (write_range) tables.control->begin_write(*write_range);
+
+    if (native) {
+        auto      &tx_buffer = con.tx_buffer;
+        const auto offset    = tx_buffer.size();
+        PDU::execute(query, tables, tx_buffer);
+        if (write_range) tables.control->end_write(*write_range);
+        release_lock(tables, access);
+        if (write_range) queue_notify(tables.control);
+        encoded(locked, offset);
+        if (tx_buffer[offset + FC] & EXCEPTION_FLAG) count(traffic_stats.exceptions[FUNCTION]);  // NOLINT
+
+        if (debug) Log::info() << "reply to " << con.addr << ": " << hex_dump(std::span(tx_buffer).subspan(offset));
+
+        return run_t::ok;
+    }
+
+    modbus_set_socket(modbus, client_fd);
+    const int ret = modbus_reply(modbus, query.data(), static_cast<int>(query.size()), tables.mapping);
+    if (write_range) tables.control->end_write(*write_range);
+    release_lock(tables, access);
+    if (write_range) queue_notify(tables.control);
+    if (debug) std::fflush(stdout);  // debug output of libmodbus (modbus_set_debug)
+
+    if (ret == -1) {
+        Log::error() << "modbus_reply failed: " << modbus_strerror(errno);
+        close_connection(client_fd);
+        return run_t::ok;
+    }
+
+    // the reply is sent by modbus_reply
+    const auto sent = std::chrono::steady_clock::now();
+    record_latency({FUNCTION, CLIENT_ID, con.last_receive, locked, sent}, sent);
+
+    count(traffic_stats.bytes_out, static_cast<std::uint64_t>(ret));
+    // the exception reply is the only reply of libmodbus with a 2 byte PDU
+    if (ret == EXCEPTION_REPLY_SIZE) count(traffic_stats.exceptions[FUNCTION]);  // NOLINT
+
+    return run_t::ok;
+}
+
+void Client_Poll::queue_notify(shm::Shm_Control *control) {
+    if (!control->has_eventfds()) return;
+    if (std::find(notify_pending.begin(), notify_pending.end(), control) == notify_pending.end())
+        notify_pending.push_back(control);
+}
+
+bool Client_Poll::is_native(std::span<const std::uint8_t> query) const noexcept {
+    // function codes that are not supported by the PDU engine are handled by libmodbus
+    // (packed tables and address windows can only be accessed by the PDU engine)
+    const auto &tables = this->tables[query[6]];  // NOLINT
+    return (!libmodbus_reply || tables.builtin_only()) && PDU::is_supported(query[FC]);
+}
+
+std::uint8_t Client_Poll::create_tables(std::uint8_t client_id) {
+    const Register_Tables *created = nullptr;
+    try {
+        created = mapping_factory(client_id);
+    } catch (const std::exception &e) {
+        Log::error() << "Failed to create register tables for client id " << static_cast<unsigned>(client_id) << ": "
+                     << e.what();
+        return MODBUS_EXCEPTION_SLAVE_OR_SERVER_FAILURE;
+    }
+
+    if (!created) return MODBUS_EXCEPTION_GATEWAY_TARGET;
+
+    tables[client_id] = *created;  // NOLINT
+    return 0;
+}
+
+/**
+ * @brief get the time until a deadline as relative timeout (0 if the deadline has passed)
+ */
+static struct timespec remaining_timeout(std::chrono::steady_clock::time_point deadline) {
+    auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+    if (remaining < std::chrono::nanoseconds::zero()) remaining = std::chrono::nanoseconds::zero();
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+
+    struct timespec timeout {};
+    timeout.tv_sec  = seconds.count();
+    timeout.tv_nsec = (remaining - seconds).count();
+    return timeout;
+}
+
+bool Client_Poll::acquire_lock(const Register_Tables &tables, const Table_Access &access, bool batch) {
+    const bool global      = shm_lock || semaphore;
+    const bool table_locks = tables.control && tables.control->has_table_locks();
+    if (!global && !table_locks) return true;
+
+    // --lock-timeout is the maximum time for all locks of the request together
+    auto       now      = std::chrono::steady_clock::now();
+    const auto deadline = now + lock_timeout;
+
+    if (lock_batch.locked) {
+        // release the lock if the batch is exhausted to give other processes access to the shared memory
+        const bool exhausted = lock_batch.requests >= lock_batch_size || now - lock_batch.start >= lock_batch_time;
+        if (exhausted) {
+            release_global_lock();
+            lock_batch.locked = false;
+        }
+    }
+
+    const auto start    = now;
+    const bool acquires = !lock_batch.locked;  // a held batch lock is not a new acquisition
+    if (acquires && global) {
+        if (!acquire_global_lock(deadline)) return false;
+        now = std::chrono::steady_clock::now();
+
+        if (batch && lock_batch_size > 1) {
+            lock_batch.locked   = true;
+            lock_batch.requests = 0;
+            lock_batch.start    = now;
+        }
+    }
+    ++lock_batch.requests;
+
+    if (table_locks) {
+        const auto timeout = remaining_timeout(deadline);
+        const int  ret     = tables.control->lock_tables(access, &timeout);
+        if (ret != 0) {
+            // release the global lock (if any)
+            release_lock(tables, Table_Access());
+
+            if (ret != ETIMEDOUT) throw std::system_error(ret, std::generic_category(), "Failed to acquire table lock");
+            count(lock_stats.table_timeouts);
+            print_busy_warning("table lock");
+            return false;
+        }
+        now = std::chrono::steady_clock::now();
+    }
+
+    if (acquires || table_locks) {
+        lock_stats.wait.record(static_cast<std::uint64_t>((now - start).count()));
+        if (acquires) lock_acquired = now;
+    }
+
+    return true;
+}
+
+void Client_Poll::release_lock(const Register_Tables &tables, const Table_Access &access) noexcept {
+    if (tables.control && tables.control->has_table_locks()) {
+        tables.control->unlock_tables(access);
+
+        // without semaphore/lock the table locks are the only locks that are held
+        if (!shm_lock && !semaphore) {
+            const auto held = std::chrono::steady_clock::now() - lock_acquired;
+            lock_stats.hold.record(static_cast<std::uint64_t>(held.count()));
+        }
+    }
+
+    // the lock of a batch is released by finish_lock_batch
+    if (!lock_batch.locked) release_global_lock();
+}
+
+bool Client_Poll::acquire_global_lock(std::chrono::steady_clock::time_point deadline) {
+    const auto timed_out = [this](const std::string &name) {
+        count(lock_stats.timeouts);
+        print_busy_warning(name);
+        return false;
+    };
+
+    if (shm_lock) {
+        const auto timeout = remaining_timeout(deadline);
+        const auto result  = shm_lock->lock(&timeout, lock_spins);
+        if (result == shm::lock::result_t::timeout) return timed_out("lock '" + shm_lock->get_name() + '\'');
+        if (result == shm::lock::result_t::error)
+            throw std::system_error(errno, std::generic_category(), "Failed to acquire lock " + shm_lock->get_name());
+        if (result == shm::lock::result_t::recovered) {
+            count(lock_stats.recovered);
+            Log::warning() << "The owner of the lock '" << shm_lock->get_name()
+                           << "' terminated while holding it. Register values may be inconsistent.";
+        }
+    }
+
+    if (semaphore) {
+        semaphore_lock = std::unique_lock<std::timed_mutex>(*semaphore_mutex, std::defer_lock);
+        if (!semaphore_lock.try_lock_until(deadline) || !semaphore->wait(remaining_timeout(deadline))) {
+            if (semaphore_lock.owns_lock()) semaphore_lock.unlock();
+            return timed_out("semaphore '" + semaphore->get_name() + '\'');
+        }
+    }
+
+    return true;
+}
+
+void Client_Poll::release_global_lock() noexcept {
+    if (!shm_lock && !semaphore) return;
+
+    if (semaphore) {
+        semaphore->post();
+        semaphore_lock.unlock();
+    }
+
+    if (shm_lock) shm_lock->unlock();
+
+    lock_stats.hold.record(static_cast<std::uint64_t>((std::chrono::steady_clock::now() - lock_acquired).count()));
+}
+
+void Client_Poll::finish_lock_batch() {
+    if (lock_batch.locked) {
+        release_global_lock();
+        lock_batch.locked = false;
+    }
+
+    for (const auto client_fd : lock_batch.clients) {
+        // connection may have been closed after the request was handled
+        if (connections.contains(client_fd)) flush_replies(client_fd);
+    }
+    lock_batch.clients.clear();
+}
+
+void Client_Poll::print_busy_warning(const std::string &name) const {
+    const auto timeout_ms = std::chrono::duration<double, std::milli>(lock_timeout).count();
+    Log::warning() << "Failed to acquire " << name << " within " << timeout_ms
+                   << "ms. Request answered with exception 0x06 (server device busy).";
+}
+
+bool Client_Poll::flush_replies(int client_fd) {
+    auto &con = connections.at(client_fd);
+
+#ifdef IO_URING_ENABLED
+    if (backend == backend_t::io_uring) {
+        // only one send operation per connection: remaining replies are sent once it is completed
+        if (con.tx_buffer.empty() || !con.tx_inflight.empty()) {
+            if (con.tx_buffer.size() > MAX_TX_BUFFER) {
+                Log::error() << "Modbus server (" << con.addr << ") does not read its replies.";
+                close_connection(client_fd);
+                return false;
+            }
+            return true;
+        }
+
+        std::swap(con.tx_buffer, con.tx_inflight);
+        std::swap(con.tx_times, con.inflight_times);
+        con.tx_sent = 0;
+        uring->send(client_fd, con.generation, con.tx_inflight);
+        return true;
+    }
+#endif
+
+    std::size_t sent = 0;
+    while (sent < con.tx_buffer.size()) {
+        const ssize_t rc = send(client_fd,
+                                con.tx_buffer.data() + sent,
+                                con.tx_buffer.size() - sent,
+                                MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+
+            // socket buffer is full --> the remaining replies are sent once the socket is writable
+            if (errno == EAGAIN) break;
+
+            if (errno != EPIPE && errno != ECONNRESET) {
+                Log::error() << "send failed: " << strerror(errno);
+            }
+            close_connection(client_fd);
+            return false;
+        }
+        sent += static_cast<std::size_t>(rc);
+    }
+
+    if (sent != 0) {
+        count(traffic_stats.bytes_out, sent);
+        con.tx_buffer.erase(con.tx_buffer.begin(), con.tx_buffer.begin() + static_cast<std::ptrdiff_t>(sent));
+    }
+
+    if (con.tx_buffer.empty()) {
+        const auto now = std::chrono::steady_clock::now();
+        for (const auto &timing : con.tx_times)
+            record_latency(timing, now);
+        con.tx_times.clear();
+    }
+
+#ifdef OS_LINUX
+    if (backend == backend_t::epoll) epoll_update_client(client_fd);
+#endif
+
+    return true;
+}
+
+bool Client_Poll::wants_input(const connection_t &con) noexcept {
+    return !con.deferred && con.tx_buffer.size() < MAX_TX_BUFFER;
+}
+
+bool Client_Poll::wants_output(const connection_t &con) noexcept {
+    return !con.tx_buffer.empty() || con.deferred;
+}
+
+Client_Poll::run_t Client_Poll::handle_writable(int client_fd) {
+    if (!flush_replies(client_fd)) return run_t::ok;
+
+    // deferred requests are handled once all previous replies are sent
+    auto &con = connections.at(client_fd);
+    if (!con.deferred || !con.tx_buffer.empty() || !con.tx_inflight.empty()) return run_t::ok;
+    con.deferred = false;
+
+    auto ret = handle_buffered(client_fd);
+
+    // data that was received while the requests were deferred (io_uring)
+    while (ret == run_t::ok && connections.contains(client_fd) && !con.deferred && !con.rx_backlog.empty()) {
+        const auto appended = con.framer.append(con.rx_backlog);
+        con.rx_backlog.erase(con.rx_backlog.begin(), con.rx_backlog.begin() + static_cast<std::ptrdiff_t>(appended));
+        ret = handle_buffered(client_fd);
+    }
+
+    return ret;
+}
+
+void Client_Poll::capture_adu(const connection_t            &con,
+                              Capture_Ring::direction_t     direction,
+                              std::span<const std::uint8_t> adu) {
+    if (!capture->push(con.flow, direction, adu)) count(traffic_stats.capture_dropped);
+}
+
+void Client_Poll::record_latency(const request_timing_t &timing, std::chrono::steady_clock::time_point sent) noexcept {
+    const auto duration = [](auto from, auto to) { return static_cast<std::uint64_t>((to - from).count()); };
+
+    auto &phases = latency_stats->functions[latency_stats_t::function_index(timing.function)];  // NOLINT
+    phases[latency_stats_t::QUEUE].record(duration(timing.received, timing.locked));
+    phases[latency_stats_t::EXECUTE].record(duration(timing.locked, timing.executed));
+    phases[latency_stats_t::SEND].record(duration(timing.executed, sent));
+
+    const auto total = duration(timing.received, sent);
+    phases[latency_stats_t::TOTAL].record(total);
+    latency_stats->units[timing.unit].record(total);  // NOLINT
+}
+
 std::string Client_Poll::get_listen_addr() const {
     struct sockaddr_storage sock_addr;  // NOLINT
     socklen_t               len = sizeof(sock_addr);
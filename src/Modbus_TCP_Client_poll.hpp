@@ -4,12 +4,24 @@
  */
 #pragma once
 
+#include "ADU_Framer.hpp"
+#include "Capture_Ring.hpp"
+#include "Histogram.hpp"
+#include "Register_Tables.hpp"
+#include "Shm_Lock.hpp"
+#include "Uring.hpp"
+
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cxxsemaphore.hpp>
+#include <functional>
 #include <memory>
 #include <modbus/modbus.h>
+#include <mutex>
+#include <span>
 #include <string>
 #include <sys/poll.h>
 #include <unistd.h>
@@ -17,6 +29,9 @@
 #include <unordered_set>
 #include <vector>
 
+#ifdef OS_LINUX
+#    include <sys/epoll.h>
+#endif
 
 namespace Modbus::TCP {
 
@@ -24,24 +39,185 @@ class Client_Poll {
 public:
     static constexpr std::size_t MAX_CLIENT_IDS = 256;
 
-    enum class run_t : std::uint8_t { ok, term_signal, term_nocon, timeout, interrupted, semaphore };
+    enum class run_t : std::uint8_t { ok, term_signal, term_nocon, timeout, interrupted };
+
+    //! mechanism that is used to wait for events on the sockets
+    enum class backend_t : std::uint8_t {
+        poll,     //!< rebuild the poll set on every call of run (default)
+        epoll,    //!< persistent epoll set, only ready sockets are handled (linux only)
+        io_uring  //!< io_uring with multishot accept/receive (linux >= 6.0, requires ENABLE_IO_URING)
+    };
+
+    //! handler of an auxiliary file descriptor (argument: returned poll events, see man 2 poll)
+    using aux_handler_t = std::function<void(short revents)>;
+
+    /**
+     * @brief creates the register tables of a client id on the first request (see set_mapping_factory)
+     *
+     * @details returns nullptr if the client id is not allowed. Throws an exception if the tables cannot be created.
+     *          Called by the threads of all Client_Poll objects that share the factory.
+     */
+    using mapping_factory_t = std::function<const Register_Tables *(std::uint8_t client_id)>;
+
+    //! contention of the semaphore, lock and table locks (written by the thread that calls run)
+    struct lock_stats_t {
+        Histogram                  wait;                //!< time to acquire the locks of a request (ns)
+        Histogram                  hold;                //!< time the locks are held (ns)
+        std::atomic<std::uint64_t> timeouts {0};        //!< semaphore/lock acquisitions that timed out
+        std::atomic<std::uint64_t> table_timeouts {0};  //!< table lock acquisitions that timed out
+        std::atomic<std::uint64_t> busy {0};            //!< requests answered with exception 0x06
+        std::atomic<std::uint64_t> recovered {0};       //!< locks recovered from a terminated owner
+    };
+
+    //! request, traffic and connection counters (written by the thread that calls run)
+    struct traffic_stats_t {
+        using counter_t = std::atomic<std::uint64_t>;
+
+        std::array<counter_t, 0x100>          requests {};            //!< requests per function code
+        std::array<counter_t, 0x100>          exceptions {};          //!< exception replies per function code
+        std::array<counter_t, MAX_CLIENT_IDS> unit_requests {};       //!< requests per unit id
+        counter_t                             bytes_in {0};           //!< received bytes
+        counter_t                             bytes_out {0};          //!< sent bytes
+        counter_t                             connections {0};        //!< active connections
+        counter_t                             connections_total {0};  //!< accepted connections
+        counter_t                             accept_rejected {0};    //!< connections closed after accept (limit)
+        counter_t                             loop_iterations {0};    //!< calls of run
+        counter_t                             capture_dropped {0};    //!< ADUs not captured (ring buffer full)
+    };
+
+    //! server-side latency of the requests in ns (written by the thread that calls run)
+    struct latency_stats_t {
+        //! part of the latency
+        enum phase_t : std::uint8_t {
+            QUEUE,    //!< request received --> locks acquired
+            EXECUTE,  //!< locks acquired --> request executed
+            SEND,     //!< request executed --> reply sent (includes the delay of replies deferred by a lock batch)
+            TOTAL,    //!< request received --> reply sent
+            PHASE_COUNT
+        };
+
+        //! function codes with own histograms (all other function codes share the histograms OTHER_FUNCTIONS)
+        static constexpr std::array<std::uint8_t, 11> FUNCTION_CODES {1, 2, 3, 4, 5, 6, 15, 16, 17, 22, 23};
+        static constexpr std::size_t                  OTHER_FUNCTIONS = FUNCTION_CODES.size();
+
+        std::array<std::array<Histogram, PHASE_COUNT>, OTHER_FUNCTIONS + 1> functions;  //!< phases per function code
+        std::array<Histogram, MAX_CLIENT_IDS>                             units;      //!< TOTAL per unit id
+
+        /**
+         * @brief get the index of the histograms of a function code in functions
+         */
+        static constexpr std::size_t function_index(std::uint8_t function_code) noexcept {
+            for (std::size_t i = 0; i < FUNCTION_CODES.size(); ++i)
+                if (FUNCTION_CODES[i] == function_code) return i;  // NOLINT
+            return OTHER_FUNCTIONS;
+        }
+    };
 
 private:
+    //! timestamps of a request whose reply is not yet sent
+    struct request_timing_t {
+        std::uint8_t                          function;  //!< function code
+        std::uint8_t                          unit;      //!< unit id
+        std::chrono::steady_clock::time_point received;  //!< time the request was received
+        std::chrono::steady_clock::time_point locked;    //!< time the locks were acquired
+        std::chrono::steady_clock::time_point executed;  //!< time the reply was encoded
+    };
+
+    //! data of an active connection
+    struct connection_t {
+        std::string                           addr;              //!< peer address
+        ADU_Framer                            framer;            //!< receive buffer
+        std::chrono::steady_clock::time_point last_receive;      //!< time of the last received data
+        std::uint32_t                         generation = 0;    //!< distinguishes reused fds (io_uring)
+        std::vector<std::uint8_t>             tx_buffer;         //!< encoded replies that are not yet sent
+        std::vector<std::uint8_t>             tx_inflight;       //!< replies that are currently sent (io_uring)
+        std::size_t                           tx_sent = 0;       //!< number of bytes of tx_inflight that are sent
+        std::vector<request_timing_t>         tx_times;          //!< timestamps of the replies in tx_buffer
+        std::vector<request_timing_t>         inflight_times;    //!< timestamps of the replies in tx_inflight
+        Capture_Ring::flow_t                  flow;              //!< addresses of the connection (capture only)
+        bool                                  deferred = false;  //!< requests paused until the replies are sent
+        std::vector<std::uint8_t>             rx_backlog;        //!< data received while deferred (io_uring)
+        std::uint32_t                         epoll_mask = 0;    //!< events the socket is registered for (epoll)
+    };
+
+    //! file descriptor that is watched in addition to the modbus sockets
+    struct aux_fd_t {
+        aux_handler_t handler;         //!< called if the file descriptor is ready or an error occurred
+        short         events     = 0;  //!< events to wait for (see man 2 poll)
+        std::uint32_t generation = 0;  //!< distinguishes registrations that reuse a fd (io_uring)
+    };
+
     const std::size_t          max_clients;
     std::vector<struct pollfd> poll_fds;
 
-    bool debug = false;  //!< modbus debugging enabled
+    bool debug           = false;  //!< modbus debugging enabled
+    bool libmodbus_reply = false;  //!< handle all requests with modbus_reply instead of the built-in PDU engine
+
+    Capture_Ring *capture = nullptr;  //!< ring buffer that receives a copy of all ADUs (nullptr: disabled)
 
-    modbus_t *modbus;  //!< modbus object (see libmodbus library)
-    std::array<modbus_mapping_t *, MAX_CLIENT_IDS>
-                      mappings {};         //!< modbus data objects (one per possible client id) (see libmodbus library)
+    //! maximum time between two parts of the same request (0: disabled)
+    std::chrono::microseconds byte_timeout = std::chrono::milliseconds(500);  // NOLINT
+
+    modbus_t                                   *modbus;     //!< modbus object (see libmodbus library)
+    std::array<Register_Tables, MAX_CLIENT_IDS> tables {};  //!< register storage (one per possible client id)
+    mapping_factory_t mapping_factory;  //!< creates the register tables of client ids without tables
     modbus_mapping_t *delete_mapping;      //!< contains a pointer to a mapping that is to be deleted
     int               server_socket = -1;  //!< socket of the modbus connection
-    std::unordered_map<int, std::string> client_addrs;
+    std::unordered_map<int, connection_t> connections;  //!< active connections (key: socket)
+
+    std::unordered_map<int, aux_fd_t> aux_fds;             //!< auxiliary file descriptors (key: file descriptor)
+    std::uint32_t                     aux_generation = 0;  //!< generation of the last registered aux fd
+
+    std::vector<shm::Shm_Control *> notify_pending;  //!< control objects whose eventfds are signaled after the loop
+
+    std::shared_ptr<cxxsemaphore::Semaphore> semaphore;
+    std::shared_ptr<std::timed_mutex>        semaphore_mutex;  //!< serializes the semaphore use of multiple threads
+    std::unique_lock<std::timed_mutex>       semaphore_lock;   //!< semaphore_mutex (while the semaphore is acquired)
+
+    std::shared_ptr<shm::Shm_Lock> shm_lock;        //!< robust mutex in shared memory (alternative to semaphore)
+    std::uint32_t                  lock_spins = 0;  //!< adaptive spin count of shm_lock
 
-    std::unique_ptr<cxxsemaphore::Semaphore> semaphore;
+    //! maximum time to wait for the semaphore or lock
+    std::chrono::nanoseconds lock_timeout = std::chrono::milliseconds(100);  // NOLINT
 
-    long semaphore_error_counter = 0;
+    //! limits of the lock batch (requests of one loop iteration that are handled with one lock acquisition)
+    std::size_t              lock_batch_size = 1;  //!< maximum number of requests (1: no batching)
+    std::chrono::nanoseconds lock_batch_time {};   //!< maximum time the lock is held
+
+    //! state of the current lock batch
+    struct lock_batch_t {
+        bool                                  locked   = false;  //!< semaphore or lock is held
+        std::size_t                           requests = 0;      //!< requests handled since the lock was acquired
+        std::chrono::steady_clock::time_point start;             //!< time of the lock acquisition
+        std::vector<int>                      clients;           //!< connections with deferred replies
+    } lock_batch;
+
+    lock_stats_t                          lock_stats;     //!< contention of the locks
+    traffic_stats_t                       traffic_stats;  //!< request, traffic and connection counters
+    std::chrono::steady_clock::time_point lock_acquired;  //!< time the locks were acquired
+
+    //! latency of the requests (allocated once: the histograms are too large for the stack)
+    std::unique_ptr<latency_stats_t> latency_stats = std::make_unique<latency_stats_t>();
+
+    backend_t backend = backend_t::poll;  //!< event notification mechanism
+
+#ifdef OS_LINUX
+    int  epoll_fd        = -1;     //!< epoll instance (backend_t::epoll only)
+    int  epoll_signal_fd = -1;     //!< signal fd that is registered at the epoll instance
+    bool epoll_server    = false;  //!< server socket is registered at the epoll instance
+
+    std::vector<struct epoll_event> epoll_events;  //!< event buffer for epoll_wait
+#endif
+
+#ifdef IO_URING_ENABLED
+    std::unique_ptr<Uring> uring;                     //!< io_uring instance (backend_t::io_uring only)
+    int                    uring_signal_fd  = -1;     //!< signal fd that is watched by the io_uring instance
+    bool                   uring_server     = false;  //!< multishot accept is armed
+    std::uint32_t          uring_generation = 0;      //!< generation of the last accepted connection
+
+    //! replies of closed connections whose send operation is not completed yet (key: generation)
+    std::unordered_map<std::uint32_t, std::vector<std::uint8_t>> uring_orphaned_tx;
+#endif
 
 public:
     /*! \brief create modbus client (TCP server)
@@ -63,14 +239,16 @@ public:
      *
      * @param host host to listen for incoming connections
      * @param service service/port to listen  for incoming connections
-     * @param mappings modbus mappings (one for each possible id)
+     * @param tables modbus mappings (one for each possible id). nullptr: an mapping object with maximum size is used
      * @param tcp_timeout tcp timeout (currently only available on linux systems)
+     * @param reuse_port bind the listening socket with SO_REUSEPORT (multiple Client_Poll objects on the same port)
      */
-    Client_Poll(const std::string                              &host,
-                const std::string                              &service,
-                std::array<modbus_mapping_t *, MAX_CLIENT_IDS> &mappings,
-                std::size_t                                     tcp_timeout = 5,
-                std::size_t                                     max_clients = 1);
+    Client_Poll(const std::string                                 &host,
+                const std::string                                 &service,
+                const std::array<Register_Tables, MAX_CLIENT_IDS> &tables,
+                std::size_t                                        tcp_timeout = 5,
+                std::size_t                                        max_clients = 1,
+                bool                                               reuse_port  = false);
 
     /**
      * @brief destroy the modbus client
@@ -90,22 +268,155 @@ public:
      */
     void enable_semaphore(const std::string &name, bool force = false);
 
+    /**
+     * @brief use a robust, process-shared mutex with priority inheritance in shared memory (alternative to semaphore)
+     *
+     * @param name name of the shared memory object
+     * @param force use the shared memory object even if it already exists
+     * @param permissions shared memory file permissions
+     */
+    void enable_lock(const std::string &name, bool force, mode_t permissions);
+
+    /**
+     * @brief use the semaphore or lock of another Client_Poll object
+     *
+     * @details the Client_Poll objects may be used by different threads
+     *
+     * @param other Client_Poll object with enabled semaphore or lock
+     */
+    void share_semaphore(const Client_Poll &other);
+
+    /**
+     * @brief set the maximum time to wait for the semaphore or lock
+     *
+     * @details requests that cannot acquire the semaphore or lock within this time are answered with the exception
+     *          0x06 (server device busy)
+     *
+     * @param timeout timeout in seconds
+     */
+    void set_lock_timeout(double timeout);
+
+    /**
+     * @brief handle multiple requests with one acquisition of the semaphore or lock
+     *
+     * @details all requests that are received in one iteration of run() are handled with one acquisition of the
+     *          semaphore or lock. Replies of the built-in request handling are sent after the lock is released.
+     *          The lock is released early if one of the limits is reached.
+     *
+     * @param max_requests maximum number of requests per lock acquisition (1: no batching)
+     * @param max_time maximum time in seconds the lock is held
+     */
+    void set_lock_batch(std::size_t max_requests, double max_time);
+
+    /**
+     * @brief create the register tables of client ids on demand
+     *
+     * @details the factory is called on the first request of each client id that has no register tables (nullptr
+     *          mapping in the tables passed to the constructor). These client ids do not use the mapping object with
+     *          maximum size anymore. If the factory returns nullptr, the request is answered with the exception 0x0B
+     *          (gateway target device failed to respond). If it throws, the request is answered with the exception 0x04
+     *          (server device failure).
+     *
+     * @param factory mapping factory
+     */
+    void set_mapping_factory(mapping_factory_t factory);
+
+    /**
+     * @brief select the mechanism that is used to wait for events
+     *
+     * @details must be called before the first connection is established.
+     *          If io_uring is requested but not supported by the kernel, the current backend is kept.
+     *
+     * @param new_backend event notification mechanism
+     */
+    void set_backend(backend_t new_backend);
+
+    /*! \brief watch an additional file descriptor in the event loop
+     *
+     * @details The handler is called by run if the file descriptor is ready or an error occurred (level
+     *          triggered). It may add and remove auxiliary file descriptors (e.g. a listening socket that adds the
+     *          accepted connections). The file descriptor is not closed by this object.
+     *
+     * @param fd file descriptor
+     * @param handler event handler
+     * @param events events to wait for (POLLIN: readable, POLLOUT: writable)
+     */
+    void add_aux_fd(int fd, aux_handler_t handler, short events = POLLIN);
+
+    /*! \brief stop watching an auxiliary file descriptor
+     *
+     * @details must be called before the file descriptor is closed
+     *
+     * @param fd file descriptor
+     */
+    void remove_aux_fd(int fd);
+
+    /*! \brief handle an already connected socket like an accepted connection
+     *
+     * @details e.g. one end of a socketpair (benchmarks). The socket is closed by this object (also on error).
+     *
+     * @param client_socket connected stream socket
+     * @exception std::runtime_error maximum number of connections reached
+     */
+    void add_client(int client_socket);
+
     /*! \brief enable/disable debugging output
      *
      * @param enable_debug true: enable debug output
      */
     void set_debug(bool enable_debug);
 
+    /*! \brief select the request handling
+     *
+     * @details by default, requests are executed by the built-in PDU engine (Modbus::PDU).
+     *          Function codes that are not supported by the engine are always handled by libmodbus.
+     *
+     * @param enable true: handle all requests with libmodbus (modbus_reply)
+     */
+    void set_libmodbus_reply(bool enable) noexcept { libmodbus_reply = enable; }
+
+    /*! \brief copy all received requests and all replies to a ring buffer
+     *
+     * @details replies that are sent by libmodbus are not captured.
+     *          ADUs that do not fit into the ring buffer are dropped and counted (traffic_stats_t::capture_dropped).
+     *          Must be called before the first connection is accepted.
+     *
+     * @param ring ring buffer (only used by this object, nullptr: disabled)
+     */
+    void set_capture(Capture_Ring *ring) noexcept { capture = ring; }
+
     /** \brief get the address the tcp server is listening on
      *
      * @return server listening address
      */
     std::string get_listen_addr() const;
 
+    /**
+     * @brief get the contention statistics of the semaphore, lock and table locks
+     *
+     * @details can be read by other threads while run is executed
+     */
+    [[nodiscard]] const lock_stats_t &get_lock_stats() const noexcept { return lock_stats; }
+
+    /**
+     * @brief get the request, traffic and connection counters
+     *
+     * @details can be read by other threads while run is executed
+     */
+    [[nodiscard]] const traffic_stats_t &get_traffic_stats() const noexcept { return traffic_stats; }
+
+    /**
+     * @brief get the latency histograms of the requests
+     *
+     * @details can be read by other threads while run is executed
+     */
+    [[nodiscard]] const latency_stats_t &get_latency_stats() const noexcept { return *latency_stats; }
+
     /*!
      * \brief set byte timeout
      *
      * @details see https://libmodbus.org/docs/v3.1.7/modbus_set_byte_timeout.html
+     *          Connections that send the parts of a request with a larger delay are closed.
      *
      * @param timeout byte timeout in seconds
      */
@@ -154,7 +465,130 @@ private:
     void set_tcp_timeout(std::size_t tcp_timeout) const;
 #endif
 
-    void listen();
+    void listen(const char *host, const char *service, bool reuse_port);
+
+    run_t run_poll(int signal_fd, int timeout);
+
+#ifdef OS_LINUX
+    run_t run_epoll(int signal_fd, int timeout);
+
+    void epoll_update_server();
+#endif
+
+#ifdef IO_URING_ENABLED
+    run_t run_uring(int signal_fd, int timeout);
+
+    void uring_update_server();
+
+    run_t uring_receive(const Uring::completion_t &completion);
+
+    run_t uring_send_complete(const Uring::completion_t &completion);
+#endif
+
+#ifdef OS_LINUX
+    //! register the events that are required by the current state of a connection (epoll)
+    void epoll_update_client(int client_fd);
+#endif
+
+    /*! \brief check if a connection is read
+     *
+     * @details connections are not read while they wait for their replies to be sent
+     *
+     * @param con connection
+     * @return true: wait for received data
+     */
+    [[nodiscard]] static bool wants_input(const connection_t &con) noexcept;
+
+    /*! \brief check if a connection waits until it is writable
+     *
+     * @param con connection
+     * @return true: replies are buffered or requests are deferred until the replies are sent
+     */
+    [[nodiscard]] static bool wants_output(const connection_t &con) noexcept;
+
+    //! send buffered replies of a writable connection and resume deferred requests
+    run_t handle_writable(int client_fd);
+
+    void watch_aux_fd(int fd, const aux_fd_t &aux);
+
+    void handle_aux(int fd, short revents);
+
+    void accept_connection();
+
+    connection_t &add_connection(int client_socket);
+
+    run_t handle_client(int client_fd);
+
+    bool byte_timeout_exceeded(int client_fd);
+
+    /*! \brief get the wait timeout of the event loop
+     *
+     * @param timeout timeout of run (ms, -1: infinite)
+     * @return timeout (ms), shortened to the earliest byte timeout of the connections with an incomplete request
+     */
+    [[nodiscard]] int byte_timeout_wait(int timeout) const;
+
+    //! close the connections whose incomplete request exceeded the byte timeout
+    void close_timed_out_connections();
+
+    run_t handle_buffered(int client_fd);
+
+    run_t handle_request(int client_fd, std::span<const std::uint8_t> query);
+
+    /*! \brief check if a request is handled by the PDU engine
+     *
+     * @details all other requests are handled by libmodbus, which sends the reply immediately
+     *
+     * @param query request ADU
+     * @return true: reply is encoded to the output buffer of the connection
+     */
+    [[nodiscard]] bool is_native(std::span<const std::uint8_t> query) const noexcept;
+
+    std::uint8_t create_tables(std::uint8_t client_id);
+
+    /*! \brief acquire the semaphore/lock and the table locks that are required by a request
+     *
+     * @param tables register tables of the request
+     * @param access accessed tables
+     * @param batch keep the semaphore/lock for the following requests (--lock-batch). Must be false if the reply is
+     *              sent before the lock is released.
+     * @return false: timeout
+     */
+    bool acquire_lock(const Register_Tables &tables, const Table_Access &access, bool batch);
+
+    void release_lock(const Register_Tables &tables, const Table_Access &access) noexcept;
+
+    bool acquire_global_lock(std::chrono::steady_clock::time_point deadline);
+
+    void release_global_lock() noexcept;
+
+    void finish_lock_batch();
+
+    /*! \brief signal the eventfds of a control object at the end of the current iteration
+     *
+     * @details the eventfds are written after all locks are released
+     *
+     * @param control control object of the written tables
+     */
+    void queue_notify(shm::Shm_Control *control);
+
+    void print_busy_warning(const std::string &name) const;
+
+    /*! \brief send the buffered replies of a connection
+     *
+     * @details never blocks: replies that can not be sent immediately stay in the output buffer and are sent once the
+     * socket is writable.
+     *
+     * @param client_fd client socket
+     * @return false: connection was closed
+     */
+    bool flush_replies(int client_fd);
+
+    void record_latency(const request_timing_t &timing, std::chrono::steady_clock::time_point sent) noexcept;
+
+    void capture_adu(const connection_t &con, Capture_Ring::direction_t direction, std::span<const std::uint8_t> adu);
+
+    void close_connection(int client_fd);
 };
 
 }  // namespace Modbus::TCP
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Notify_Socket.hpp"
+
+#include "Log.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace Modbus::shm {
+
+//* maximum length of a request (name prefix + '\n')
+static constexpr std::size_t REQUEST_MAX = 256;
+
+//* listen backlog of the notify socket
+static constexpr int BACKLOG = 16;
+
+//* status: eventfd attached
+static constexpr char STATUS_OK = 0;
+
+//* status: unknown name prefix
+static constexpr char STATUS_UNKNOWN = 1;
+
+Notify_Socket::Notify_Socket(const std::string &path, bool force, mode_t permissions) : path(path) {
+    struct sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("invalid notify socket path: '" + path + '\'');
+
+    const bool abstract = path.front() == '@';
+    std::memcpy(addr.sun_path, path.data(), path.size());  // NOLINT
+    if (abstract) addr.sun_path[0] = '\0';                  // NOLINT
+    const auto addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size());
+
+    if (force && !abstract) unlink(path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) throw std::system_error(errno, std::generic_category(), "Failed to create notify socket");
+
+    if (bind(listen_fd, reinterpret_cast<const struct sockaddr *>(&addr), addr_len) == -1) {  // NOLINT
+        const int error = errno;
+        close(listen_fd);
+        throw std::system_error(error, std::generic_category(), "Failed to bind notify socket '" + path + '\'');
+    }
+
+    if ((!abstract && chmod(path.c_str(), permissions) == -1) || ::listen(listen_fd, BACKLOG) == -1) {
+        const int error = errno;
+        close(listen_fd);
+        if (!abstract) unlink(path.c_str());
+        throw std::system_error(error, std::generic_category(), "Failed to listen on notify socket '" + path + '\'');
+    }
+}
+
+Notify_Socket::~Notify_Socket() {
+    while (!consumers.empty())
+        close_consumer(consumers.begin()->first);
+
+    if (client) client->remove_aux_fd(listen_fd);
+    close(listen_fd);
+    if (path.front() != '@') unlink(path.c_str());
+}
+
+void Notify_Socket::add_control(const std::string &name_prefix, Shm_Control &control) {
+    std::lock_guard<std::mutex> guard(controls_mutex);
+    controls[name_prefix] = &control;
+}
+
+void Notify_Socket::attach(TCP::Client_Poll &event_loop) {
+    client = &event_loop;
+    client->add_aux_fd(listen_fd, [this](short) { accept_consumer(); });
+}
+
+void Notify_Socket::accept_consumer() {
+    const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+            Log::error() << "notify socket: accept failed: " << strerror(errno);
+        }
+        return;
+    }
+
+    consumers.try_emplace(fd);
+    try {
+        client->add_aux_fd(fd, [this, fd](short) { handle_consumer(fd); });
+    } catch (const std::system_error &e) {
+        Log::error() << "notify socket: " << e.what();
+        consumers.erase(fd);
+        close(fd);
+    }
+}
+
+void Notify_Socket::handle_consumer(int fd) {
+    auto &consumer = consumers.at(fd);
+
+    std::array<char, REQUEST_MAX> buffer {};
+    const ssize_t                 rc = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+    if (rc == -1 && (errno == EAGAIN || errno == EINTR)) return;
+    if (rc <= 0) {
+        // consumer closed the socket (or failed)
+        close_consumer(fd);
+        return;
+    }
+
+    // data after the request is ignored
+    if (consumer.event_fd != -1) return;
+
+    consumer.request.append(buffer.data(), static_cast<std::size_t>(rc));
+    const auto end = consumer.request.find('\n');
+    if (end == std::string::npos) {
+        if (consumer.request.size() >= REQUEST_MAX) close_consumer(fd);
+        return;
+    }
+
+    consumer.request.resize(end);
+    register_consumer(fd, consumer);
+}
+
+void Notify_Socket::register_consumer(int fd, consumer_t &consumer) {
+    Shm_Control *control = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(controls_mutex);
+        const auto                  entry = controls.find(consumer.request);
+        if (entry != controls.end()) control = entry->second;
+    }
+    char status = control ? STATUS_OK : STATUS_UNKNOWN;
+
+    int event_fd = -1;
+    if (status == STATUS_OK) {
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd == -1) {
+            Log::error() << "notify socket: eventfd failed: " << strerror(errno);
+            close_consumer(fd);
+            return;
+        }
+    }
+
+    std::array<char, CMSG_SPACE(sizeof(int))> control_buf {};
+    struct iovec                              iov {};
+    iov.iov_base = &status;
+    iov.iov_len  = sizeof(status);
+    struct msghdr msg {};
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    if (event_fd != -1) {
+        msg.msg_control    = control_buf.data();
+        msg.msg_controllen = control_buf.size();
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level     = SOL_SOCKET;
+        cmsg->cmsg_type      = SCM_RIGHTS;
+        cmsg->cmsg_len       = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &event_fd, sizeof(event_fd));  // NOLINT
+    }
+
+    const bool sent = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == 1;
+    if (!sent || status != STATUS_OK) {
+        if (status != STATUS_OK) {
+            Log::warning() << "notify socket: unknown name prefix \"" << consumer.request << '"';
+        }
+        if (event_fd != -1) close(event_fd);
+        close_consumer(fd);
+        return;
+    }
+
+    consumer.control  = control;
+    consumer.event_fd = event_fd;
+    consumer.control->add_eventfd(event_fd);
+    Log::info() << "notify socket: consumer registered for \"" << consumer.request << '"';
+}
+
+void Notify_Socket::close_consumer(int fd) {
+    const auto consumer = consumers.find(fd);
+    if (consumer == consumers.end()) return;
+
+    if (consumer->second.event_fd != -1) {
+        consumer->second.control->remove_eventfd(consumer->second.event_fd);
+        close(consumer->second.event_fd);
+        Log::info() << "notify socket: consumer for \"" << consumer->second.request << "\" disconnected";
+    }
+
+    client->remove_aux_fd(fd);
+    close(fd);
+    consumers.erase(consumer);
+}
+
+}  // namespace Modbus::shm
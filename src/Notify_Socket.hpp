@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Modbus_TCP_Client_poll.hpp"
+#include "Shm_Control.hpp"
+
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace Modbus::shm {
+
+/*! \brief unix socket that provides eventfds for write notifications
+ *
+ * A consumer connects, sends the name prefix of the register tables terminated by '\n' and receives a status byte
+ * (0: ok, 1: unknown name prefix). If the status is 0, an eventfd is attached (SCM_RIGHTS) that is signaled after
+ * every write request (see Shm_Control::add_eventfd). The eventfd is signaled until the consumer closes the socket.
+ *
+ * The sockets are handled by the event loop of a Client_Poll object (no additional thread).
+ * See control::connect_notify for the consumer side.
+ */
+class Notify_Socket final {
+private:
+    //! connected consumer
+    struct consumer_t {
+        std::string  request;             //!< received part of the name prefix
+        Shm_Control *control  = nullptr;  //!< control object the eventfd is registered at
+        int          event_fd = -1;       //!< eventfd of the consumer
+    };
+
+    std::string                                    path;                 //!< socket path ('@': abstract socket)
+    int                                            listen_fd = -1;       //!< listening socket
+    TCP::Client_Poll                              *client    = nullptr;  //!< event loop that handles the sockets
+    std::unordered_map<std::string, Shm_Control *> controls;             //!< control objects (key: name prefix)
+    std::mutex                                     controls_mutex;       //!< controls (add_control: any thread)
+    std::unordered_map<int, consumer_t>            consumers;            //!< connected consumers (key: socket)
+
+public:
+    /*! \brief create the listening socket
+     *
+     * @param path socket path (starts with '@': abstract socket)
+     * @param force remove an existing socket file
+     * @param permissions socket file permissions
+     */
+    Notify_Socket(const std::string &path, bool force, mode_t permissions);
+
+    ~Notify_Socket();
+
+    Notify_Socket(const Notify_Socket &other)            = delete;
+    Notify_Socket(Notify_Socket &&other)                 = delete;
+    Notify_Socket &operator=(const Notify_Socket &other) = delete;
+    Notify_Socket &operator=(Notify_Socket &&other)      = delete;
+
+    /*! \brief make the register tables of a name prefix available
+     *
+     * @details can be called by any thread (e.g. for register tables that are created on demand)
+     *
+     * @param name_prefix name prefix of the register tables
+     * @param control control object of the register tables
+     */
+    void add_control(const std::string &name_prefix, Shm_Control &control);
+
+    /*! \brief handle the sockets in the event loop of a Client_Poll object
+     *
+     * @details the Client_Poll object must exist until this object is destroyed
+     *
+     * @param event_loop Client_Poll object
+     */
+    void attach(TCP::Client_Poll &event_loop);
+
+    //! get the socket path ('@': abstract socket)
+    [[nodiscard]] const std::string &get_path() const noexcept { return path; }
+
+private:
+    void accept_consumer();
+
+    void handle_consumer(int fd);
+
+    void register_consumer(int fd, consumer_t &consumer);
+
+    void close_consumer(int fd);
+};
+
+}  // namespace Modbus::shm
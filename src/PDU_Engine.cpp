@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "PDU_Engine.hpp"
+
+#include "Bit_Pack.hpp"
+#include "Byte_Swap.hpp"
+
+#include <array>
+#include <cstring>
+#include <string_view>
+
+namespace Modbus::PDU {
+
+//* offset of the function code in a Modbus/TCP ADU (behind the MBAP header)
+static constexpr std::size_t FC = 7;
+
+//* offset of the length field in a Modbus/TCP ADU
+static constexpr std::size_t LENGTH = 4;
+
+//* size of the MBAP header without the unit id (not included in the length field)
+static constexpr std::size_t MBAP_LENGTH_OFFSET = 6;
+
+//* function code flag of exception responses
+static constexpr std::uint8_t EXCEPTION_FLAG = 0x80;
+
+//* identifier in the response of report slave id (same as libmodbus)
+static constexpr std::uint8_t REPORT_SLAVE_ID = 180;
+
+//* run indicator status in the response of report slave id (ON)
+static constexpr std::uint8_t RUN_INDICATOR_ON = 0xFF;
+
+//* single coil value ON
+static constexpr unsigned COIL_ON = 0xFF00;
+
+//* bits per byte
+static constexpr int BYTE_BITS = 8;
+
+//! complete Modbus/TCP request (MBAP header + PDU)
+using request_t = std::span<const std::uint8_t>;
+
+/*! \brief request handler
+ *
+ * @param req complete request
+ * @param tables register storage
+ * @param rsp reply buffer (size MODBUS_TCP_MAX_ADU_LENGTH)
+ * @return size of the reply (the MBAP length field is set by the caller)
+ */
+using handler_t = std::size_t (*)(request_t req, const Register_Tables &tables, std::uint8_t *rsp);
+
+static inline int get_u16(request_t req, std::size_t index) {
+    return req[index] << BYTE_BITS | req[index + 1];
+}
+
+/**
+ * @brief get the index of the first register of an address range in a table
+ *
+ * @param tables register storage
+ * @param table accessed table
+ * @param address first address (relative to the start address of the modbus_mapping_t table)
+ * @param nb number of registers
+ * @return index or -1 if the range is not inside one address window (see Register_Tables::windows)
+ */
+static inline int table_index(const Register_Tables &tables, shm::control::table_index_t table, int address, int nb) {
+    const auto *windows = tables.windows[table];  // NOLINT
+    return windows ? windows->translate(address, nb) : address;
+}
+
+static inline std::size_t response_basis(request_t req, std::uint8_t *rsp) {
+    rsp[0]  = req[0];   // transaction id
+    rsp[1]  = req[1];   // NOLINT
+    rsp[2]  = 0;        // NOLINT protocol id
+    rsp[3]  = 0;        // NOLINT
+    rsp[6]  = req[6];   // NOLINT unit id
+    rsp[FC] = req[FC];  // NOLINT
+    return FC + 1;
+}
+
+static inline std::size_t exception(request_t req, std::uint8_t *rsp, int exception_code) {
+    auto length = response_basis(req, rsp);
+    rsp[FC] |= EXCEPTION_FLAG;                                // NOLINT
+    rsp[length++] = static_cast<std::uint8_t>(exception_code);  // NOLINT
+    return length;
+}
+
+static inline std::size_t echo(request_t req, std::uint8_t *rsp) {
+    std::memcpy(rsp, req.data(), req.size());
+    return req.size();
+}
+
+static std::size_t illegal_function(request_t req, const Register_Tables &, std::uint8_t *rsp) {
+    return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
+}
+
+template <bool INPUT>
+static std::size_t read_bits(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    auto &mapping = *tables.mapping;
+
+    if (req.size() < FC + 5) return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+    const int  start   = INPUT ? mapping.start_input_bits : mapping.start_bits;
+    const int  nb_bits = INPUT ? mapping.nb_input_bits : mapping.nb_bits;
+    const auto tab     = INPUT ? mapping.tab_input_bits : mapping.tab_bits;
+    const auto table   = INPUT ? shm::control::DI : shm::control::DO;
+
+    const int nb      = get_u16(req, FC + 3);
+    const int address = table_index(tables, table, get_u16(req, FC + 1) - start, nb);
+
+    if (nb < 1 || MODBUS_MAX_READ_BITS < nb) return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+    if (address < 0 || address + nb > nb_bits) return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+
+    auto       length = response_basis(req, rsp);
+    const auto size   = static_cast<std::size_t>(nb / BYTE_BITS + (nb % BYTE_BITS ? 1 : 0));
+    rsp[length++]     = static_cast<std::uint8_t>(size);  // NOLINT
+
+    if (tables.packed_bits) {
+        Bits::extract(tab, static_cast<std::size_t>(address), static_cast<std::size_t>(nb), rsp + length);  // NOLINT
+        return length + size;
+    }
+
+    // same packing as libmodbus (values other than 0/1 in the table affect the following bits as well)
+    unsigned shift    = 0;
+    unsigned one_byte = 0;
+    for (int i = address; i < address + nb; ++i) {
+        one_byte |= static_cast<unsigned>(tab[i]) << shift;  // NOLINT
+        if (shift == BYTE_BITS - 1) {
+            rsp[length++] = static_cast<std::uint8_t>(one_byte);  // NOLINT
+            one_byte      = 0;
+            shift         = 0;
+        } else {
+            ++shift;
+        }
+    }
+    if (shift != 0) rsp[length++] = static_cast<std::uint8_t>(one_byte);  // NOLINT
+
+    return length;
+}
+
+template <bool INPUT>
+static std::size_t read_registers(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    auto &mapping = *tables.mapping;
+
+    if (req.size() < FC + 5) return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+    const int  start  = INPUT ? mapping.start_input_registers : mapping.start_registers;
+    const int  nb_reg = INPUT ? mapping.nb_input_registers : mapping.nb_registers;
+    const auto tab    = INPUT ? mapping.tab_input_registers : mapping.tab_registers;
+    const auto table  = INPUT ? shm::control::AI : shm::control::AO;
+
+    const int nb      = get_u16(req, FC + 3);
+    const int address = table_index(tables, table, get_u16(req, FC + 1) - start, nb);
+
+    if (nb < 1 || MODBUS_MAX_READ_REGISTERS < nb) return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+    if (address < 0 || address + nb > nb_reg) return exception(req, rsp, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+
+    auto length   = response_basis(req, rsp);
+    rsp[length++] = static_cast<std::uint8_t>(nb << 1);  // NOLINT
+    Byte_Swap::to_wire(tab + address, static_cast<std::size_t>(nb), rsp + length);  // NOLINT
+
+    return length + 2 * static_cast<std::size_t>(nb);
+}
+
+//! registers that are written by a request (see decode_write)
+struct write_access_t {
+    int                         exception  = 0;                 //!< exception code (0: valid request)
+    shm::control::table_index_t table      = shm::control::AO;  //!< written table
+    int                         index      = 0;                 //!< index of the first written register
+    int                         nb         = 0;                 //!< number of written registers
+    int                         read_index = 0;                 //!< index of the first read register (FC 23 only)
+    int                         read_nb    = 0;                 //!< number of read registers (FC 23 only)
+};
+
+/**
+ * @brief decode and check a request that writes registers
+ *
+ * @details used by the write handlers and by get_write_range: a request modifies the registers that are reported
+ *          here if and only if it is not answered with an exception. The checks are applied in the same order as in
+ *          libmodbus (same exception codes).
+ *
+ * @param req complete request
+ * @param tables register storage
+ * @return written registers or exception code (MODBUS_EXCEPTION_ILLEGAL_FUNCTION: not a write request)
+ */
+static write_access_t decode_write(request_t req, const Register_Tables &tables) noexcept {
+    const auto    &mapping = *tables.mapping;
+    write_access_t write;
+
+    const auto fail = [&write](int exception_code) {
+        write.exception = exception_code;
+        return write;
+    };
+
+    switch (req[FC]) {
+        case MODBUS_FC_WRITE_SINGLE_COIL: {
+            if (req.size() < FC + 5) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+            write.table = shm::control::DO;
+            write.nb    = 1;
+            write.index = table_index(tables, write.table, get_u16(req, FC + 1) - mapping.start_bits, 1);
+            if (write.index < 0 || write.index >= mapping.nb_bits) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+
+            const auto data = static_cast<unsigned>(get_u16(req, FC + 3));
+            if (data != COIL_ON && data != 0) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+            return write;
+        }
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+        case MODBUS_FC_MASK_WRITE_REGISTER: {
+            const std::size_t size = req[FC] == MODBUS_FC_MASK_WRITE_REGISTER ? FC + 7 : FC + 5;
+            if (req.size() < size) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+            write.nb    = 1;
+            write.index = table_index(tables, write.table, get_u16(req, FC + 1) - mapping.start_registers, 1);
+            if (write.index < 0 || write.index >= mapping.nb_registers)
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+            return write;
+        }
+        case MODBUS_FC_WRITE_MULTIPLE_COILS: {
+            if (req.size() < FC + 6) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+            write.table        = shm::control::DO;
+            write.nb           = get_u16(req, FC + 3);
+            write.index        = table_index(tables, write.table, get_u16(req, FC + 1) - mapping.start_bits, write.nb);
+            const int nb_bytes = req[FC + 5];
+
+            if (write.nb < 1 || MODBUS_MAX_WRITE_BITS < write.nb || nb_bytes * BYTE_BITS < write.nb ||
+                req.size() < FC + 6 + static_cast<std::size_t>(nb_bytes))
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+            if (write.index < 0 || write.index + write.nb > mapping.nb_bits)
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+            return write;
+        }
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS: {
+            if (req.size() < FC + 6) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+            const int start    = mapping.start_registers;
+            write.nb           = get_u16(req, FC + 3);
+            write.index        = table_index(tables, write.table, get_u16(req, FC + 1) - start, write.nb);
+            const int nb_bytes = req[FC + 5];
+
+            if (write.nb < 1 || MODBUS_MAX_WRITE_REGISTERS < write.nb || nb_bytes != write.nb * 2 ||
+                req.size() < FC + 6 + static_cast<std::size_t>(nb_bytes))
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+            if (write.index < 0 || write.index + write.nb > mapping.nb_registers)
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+            return write;
+        }
+        case MODBUS_FC_WRITE_AND_READ_REGISTERS: {
+            if (req.size() < FC + 10) return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+            const int start    = mapping.start_registers;
+            write.read_nb      = get_u16(req, FC + 3);
+            write.read_index   = table_index(tables, write.table, get_u16(req, FC + 1) - start, write.read_nb);
+            write.nb           = get_u16(req, FC + 7);
+            write.index        = table_index(tables, write.table, get_u16(req, FC + 5) - start, write.nb);
+            const int nb_bytes = req[FC + 9];
+
+            if (write.nb < 1 || MODBUS_MAX_WR_WRITE_REGISTERS < write.nb || write.read_nb < 1 ||
+                MODBUS_MAX_WR_READ_REGISTERS < write.read_nb || nb_bytes != write.nb * 2 ||
+                req.size() < FC + 10 + static_cast<std::size_t>(nb_bytes))
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+            if (write.read_index < 0 || write.read_index + write.read_nb > mapping.nb_registers || write.index < 0 ||
+                write.index + write.nb > mapping.nb_registers)
+                return fail(MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+            return write;
+        }
+        default: return fail(MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
+    }
+}
+
+static std::size_t write_coil(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    const auto write = decode_write(req, tables);
+    if (write.exception) return exception(req, rsp, write.exception);
+
+    const bool on       = get_u16(req, FC + 3) != 0;
+    auto      &tab_bits = tables.mapping->tab_bits;
+    if (tables.packed_bits) {
+        const auto mask = static_cast<std::uint8_t>(1U << (write.index % BYTE_BITS));
+        auto      &byte = tab_bits[write.index / BYTE_BITS];  // NOLINT
+        byte            = on ? byte | mask : byte & static_cast<std::uint8_t>(~mask);
+    } else {
+        tab_bits[write.index] = on ? 1 : 0;  // NOLINT
+    }
+    return echo(req, rsp);
+}
+
+static std::size_t write_register(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    const auto write = decode_write(req, tables);
+    if (write.exception) return exception(req, rsp, write.exception);
+
+    tables.mapping->tab_registers[write.index] = static_cast<std::uint16_t>(get_u16(req, FC + 3));  // NOLINT
+    return echo(req, rsp);
+}
+
+static std::size_t write_coils(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    const auto write = decode_write(req, tables);
+    if (write.exception) return exception(req, rsp, write.exception);
+
+    auto       *tab_bits = tables.mapping->tab_bits;
+    const auto *values   = req.data() + FC + 6;  // NOLINT
+    const auto  index    = static_cast<std::size_t>(write.index);
+    const auto  nb       = static_cast<std::size_t>(write.nb);
+    if (tables.packed_bits)
+        Bits::insert(tab_bits, index, nb, values);
+    else
+        Bits::unpack(values, nb, tab_bits + index);  // NOLINT
+
+    // reply: address and number of coils
+    const auto length = response_basis(req, rsp);
+    std::memcpy(rsp + length, req.data() + length, 4);  // NOLINT
+    return length + 4;
+}
+
+static std::size_t write_registers(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    const auto write = decode_write(req, tables);
+    if (write.exception) return exception(req, rsp, write.exception);
+
+    auto       *tab_registers = tables.mapping->tab_registers;
+    const auto *values        = req.data() + FC + 6;                                                // NOLINT
+    Byte_Swap::from_wire(values, static_cast<std::size_t>(write.nb), tab_registers + write.index);  // NOLINT
+
+    // reply: address and number of registers
+    const auto length = response_basis(req, rsp);
+    std::memcpy(rsp + length, req.data() + length, 4);  // NOLINT
+    return length + 4;
+}
+
+static std::size_t report_slave_id(request_t req, const Register_Tables &, std::uint8_t *rsp) {
+    static constexpr std::string_view ID = "LMB" LIBMODBUS_VERSION_STRING;
+
+    auto       length         = response_basis(req, rsp);
+    const auto byte_count_pos = length++;
+    rsp[length++]             = REPORT_SLAVE_ID;   // NOLINT
+    rsp[length++]             = RUN_INDICATOR_ON;  // NOLINT
+    std::memcpy(rsp + length, ID.data(), ID.size());  // NOLINT
+    length += ID.size();
+    rsp[byte_count_pos] = static_cast<std::uint8_t>(length - byte_count_pos - 1);  // NOLINT
+    return length;
+}
+
+static std::size_t mask_write_register(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    const auto write = decode_write(req, tables);
+    if (write.exception) return exception(req, rsp, write.exception);
+
+    const auto and_mask = static_cast<unsigned>(get_u16(req, FC + 3));
+    const auto or_mask  = static_cast<unsigned>(get_u16(req, FC + 5));
+
+    auto &reg = tables.mapping->tab_registers[write.index];  // NOLINT
+    reg       = static_cast<std::uint16_t>((reg & and_mask) | (or_mask & ~and_mask));
+    return echo(req, rsp);
+}
+
+static std::size_t write_read_registers(request_t req, const Register_Tables &tables, std::uint8_t *rsp) {
+    const auto write = decode_write(req, tables);
+    if (write.exception) return exception(req, rsp, write.exception);
+
+    // write first
+    auto       *tab_registers = tables.mapping->tab_registers;
+    const auto *values        = req.data() + FC + 10;                                               // NOLINT
+    Byte_Swap::from_wire(values, static_cast<std::size_t>(write.nb), tab_registers + write.index);  // NOLINT
+
+    const auto nb     = static_cast<std::size_t>(write.read_nb);
+    auto       length = response_basis(req, rsp);
+    rsp[length++]     = static_cast<std::uint8_t>(nb << 1);                  // NOLINT
+    Byte_Swap::to_wire(tab_registers + write.read_index, nb, rsp + length);  // NOLINT
+
+    return length + 2 * nb;
+}
+
+//* request handlers indexed by function code (nullptr: handled by libmodbus)
+static constexpr std::array<handler_t, 0x100> HANDLERS = []() {
+    std::array<handler_t, 0x100> handlers {};
+    handlers.fill(&illegal_function);
+
+    handlers[MODBUS_FC_READ_COILS]                = &read_bits<false>;
+    handlers[MODBUS_FC_READ_DISCRETE_INPUTS]      = &read_bits<true>;
+    handlers[MODBUS_FC_READ_HOLDING_REGISTERS]    = &read_registers<false>;
+    handlers[MODBUS_FC_READ_INPUT_REGISTERS]      = &read_registers<true>;
+    handlers[MODBUS_FC_WRITE_SINGLE_COIL]         = &write_coil;
+    handlers[MODBUS_FC_WRITE_SINGLE_REGISTER]     = &write_register;
+    handlers[MODBUS_FC_READ_EXCEPTION_STATUS]     = nullptr;  // libmodbus fails without a reply
+    handlers[MODBUS_FC_WRITE_MULTIPLE_COILS]      = &write_coils;
+    handlers[MODBUS_FC_WRITE_MULTIPLE_REGISTERS]  = &write_registers;
+    handlers[MODBUS_FC_REPORT_SLAVE_ID]           = &report_slave_id;
+    handlers[MODBUS_FC_MASK_WRITE_REGISTER]       = &mask_write_register;
+    handlers[MODBUS_FC_WRITE_AND_READ_REGISTERS]  = &write_read_registers;
+
+    return handlers;
+}();
+
+bool is_supported(std::uint8_t function_code) noexcept {
+    return HANDLERS[function_code] != nullptr;  // NOLINT
+}
+
+std::optional<Write_Range> get_write_range(request_t request, const Register_Tables &tables) noexcept {
+    if (request.size() < FC + 5) return std::nullopt;
+
+    const auto write = decode_write(request, tables);
+    if (write.exception) return std::nullopt;
+    return Write_Range {write.table, static_cast<std::size_t>(write.index), static_cast<std::size_t>(write.nb)};
+}
+
+Table_Access get_table_access(std::uint8_t function_code) noexcept {
+    using namespace shm::control;
+
+    Table_Access access;
+    switch (function_code) {
+        case MODBUS_FC_READ_COILS: access.read = 1U << DO; break;
+        case MODBUS_FC_READ_DISCRETE_INPUTS: access.read = 1U << DI; break;
+        case MODBUS_FC_READ_HOLDING_REGISTERS: access.read = 1U << AO; break;
+        case MODBUS_FC_READ_INPUT_REGISTERS: access.read = 1U << AI; break;
+        case MODBUS_FC_WRITE_SINGLE_COIL:
+        case MODBUS_FC_WRITE_MULTIPLE_COILS: access.write = 1U << DO; break;
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        case MODBUS_FC_MASK_WRITE_REGISTER:
+        case MODBUS_FC_WRITE_AND_READ_REGISTERS: access.write = 1U << AO; break;  // read and write part: AO
+        default: break;
+    }
+    return access;
+}
+
+/*! \brief set the MBAP length field and shrink the reply buffer to the reply
+ *
+ * @param reply reply buffer
+ * @param offset offset of the reply in the buffer
+ * @param length size of the reply
+ */
+static void finish_reply(std::vector<std::uint8_t> &reply, std::size_t offset, std::size_t length) {
+    auto *rsp = reply.data() + offset;  // NOLINT
+
+    // MBAP length field: unit id + PDU
+    const auto mbap_length = length - MBAP_LENGTH_OFFSET;
+    rsp[LENGTH]            = static_cast<std::uint8_t>(mbap_length >> BYTE_BITS);  // NOLINT
+    rsp[LENGTH + 1]        = static_cast<std::uint8_t>(mbap_length);               // NOLINT
+
+    reply.resize(offset + length);
+}
+
+void execute(request_t request, const Register_Tables &tables, std::vector<std::uint8_t> &reply) {
+    const auto offset = reply.size();
+    reply.resize(offset + MODBUS_TCP_MAX_ADU_LENGTH);
+
+    const auto length = HANDLERS[request[FC]](request, tables, reply.data() + offset);  // NOLINT
+    finish_reply(reply, offset, length);
+}
+
+void reply_exception(request_t request, std::uint8_t exception_code, std::vector<std::uint8_t> &reply) {
+    const auto offset = reply.size();
+    reply.resize(offset + MODBUS_TCP_MAX_ADU_LENGTH);
+
+    const auto length = exception(request, reply.data() + offset, exception_code);  // NOLINT
+    finish_reply(reply, offset, length);
+}
+
+}  // namespace Modbus::PDU
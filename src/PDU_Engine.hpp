@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Register_Tables.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+/*! \brief built-in execution of Modbus requests
+ *
+ * Executes requests directly on a modbus_mapping_t and encodes the replies into an output buffer.
+ * Replies (including exception responses) are byte-identical to the replies of libmodbus (modbus_reply).
+ * In contrast to libmodbus, the reply is not sent and invalid requests do not cause a delay.
+ */
+namespace Modbus::PDU {
+
+/*! \brief check if a function code is handled by the built-in execution
+ *
+ * @param function_code Modbus function code
+ * @return false: the request has to be handled by libmodbus (modbus_reply)
+ */
+[[nodiscard]] bool is_supported(std::uint8_t function_code) noexcept;
+
+/*! \brief execute a request and encode the reply
+ *
+ * @param request complete Modbus/TCP request (MBAP header + PDU). The function code must be supported.
+ * @param tables register storage
+ * @param reply the reply (MBAP header + PDU) is appended to this buffer
+ */
+void execute(std::span<const std::uint8_t> request, const Register_Tables &tables, std::vector<std::uint8_t> &reply);
+
+/*! \brief encode an exception response to a request
+ *
+ * @param request complete Modbus/TCP request (MBAP header + PDU). Any function code.
+ * @param exception_code Modbus exception code (e.g. MODBUS_EXCEPTION_SLAVE_OR_SERVER_BUSY)
+ * @param reply the reply (MBAP header + PDU) is appended to this buffer
+ */
+void reply_exception(std::span<const std::uint8_t> request,
+                     std::uint8_t                  exception_code,
+                     std::vector<std::uint8_t>    &reply);
+
+/*! \brief get the register tables that are accessed by a function code
+ *
+ * @details applicable to requests that are handled by libmodbus as well
+ *
+ * @param function_code Modbus function code
+ * @return accessed tables (tables that are read and written are only reported as written)
+ */
+[[nodiscard]] Table_Access get_table_access(std::uint8_t function_code) noexcept;
+
+/*! \brief get the registers that are modified by a request
+ *
+ * @details the request is decoded by the same code as in execute. Requests that are answered with an exception do
+ *          not modify registers. Applicable to requests that are handled by libmodbus as well.
+ *
+ * @param request complete Modbus/TCP request (MBAP header + PDU)
+ * @param tables register storage
+ * @return written registers (std::nullopt: no registers are modified)
+ */
+[[nodiscard]] std::optional<Write_Range> get_write_range(std::span<const std::uint8_t> request,
+                                                         const Register_Tables        &tables) noexcept;
+
+}  // namespace Modbus::PDU
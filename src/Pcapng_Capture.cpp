@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Pcapng_Capture.hpp"
+
+#include "Log.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <system_error>
+
+namespace Modbus {
+
+//* pcapng block types (see https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html)
+static constexpr std::uint32_t SECTION_HEADER_BLOCK  = 0x0A0D0D0A;
+static constexpr std::uint32_t INTERFACE_BLOCK       = 0x00000001;
+static constexpr std::uint32_t ENHANCED_PACKET_BLOCK = 0x00000006;
+
+//* pcapng option codes
+static constexpr std::uint16_t OPTION_END          = 0;
+static constexpr std::uint16_t OPTION_IF_NAME      = 2;
+static constexpr std::uint16_t OPTION_SHB_USERAPPL = 4;
+static constexpr std::uint16_t OPTION_IF_TSRESOL   = 9;
+
+//* byte order magic of the section header block
+static constexpr std::uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+
+//* if_tsresol: timestamps in nanoseconds
+static constexpr std::uint8_t TSRESOL_NANOSECONDS = 9;
+
+//* link type: IPv4 or IPv6 packet without link layer header
+static constexpr std::uint16_t LINKTYPE_RAW = 101;
+
+//* pcapng blocks and options are padded to a multiple of 4 bytes
+static constexpr std::size_t PCAPNG_ALIGNMENT = 4;
+
+//* synthesized IP and TCP headers
+static constexpr std::size_t   IPV4_HEADER_SIZE  = 20;
+static constexpr std::size_t   IPV6_HEADER_SIZE  = 40;
+static constexpr std::size_t   TCP_HEADER_SIZE   = 20;
+static constexpr std::uint8_t  IP_PROTOCOL_TCP   = 6;
+static constexpr std::uint8_t  IP_TTL            = 64;
+static constexpr std::uint8_t  TCP_FLAGS_PSH_ACK = 0x18;
+static constexpr std::uint16_t TCP_WINDOW        = 0xFFFF;
+
+//* size of the stdio buffer of the capture file
+static constexpr std::size_t FILE_BUFFER_SIZE = 0x10000;
+
+//* time the writer thread waits if the ring buffers are empty
+static constexpr auto IDLE_INTERVAL = std::chrono::milliseconds(10);
+
+//* name of the application in the section header block
+static constexpr const char *APPLICATION = "modbus-tcp-client-shm";
+
+/**
+ * @brief append a value in native byte order (pcapng blocks)
+ */
+template <typename T>
+static void append(std::vector<std::uint8_t> &block, T value) {
+    const auto size = block.size();
+    block.resize(size + sizeof(value));
+    std::memcpy(block.data() + size, &value, sizeof(value));
+}
+
+/**
+ * @brief append a value in network byte order (IP and TCP headers)
+ */
+template <typename T>
+static void append_be(std::vector<std::uint8_t> &block, T value) {
+    for (std::size_t i = sizeof(value); i > 0; --i)
+        block.push_back(static_cast<std::uint8_t>(value >> ((i - 1) * 8)));
+}
+
+/**
+ * @brief append zeros until the block size is a multiple of 4
+ */
+static void pad(std::vector<std::uint8_t> &block) {
+    block.resize((block.size() + PCAPNG_ALIGNMENT - 1) / PCAPNG_ALIGNMENT * PCAPNG_ALIGNMENT, 0);
+}
+
+/**
+ * @brief start a pcapng block (the length is set by finish_block)
+ */
+static void begin_block(std::vector<std::uint8_t> &block, std::uint32_t type) {
+    block.clear();
+    append(block, type);
+    append(block, std::uint32_t(0));
+}
+
+/**
+ * @brief append a pcapng option
+ */
+static void append_option(std::vector<std::uint8_t> &block, std::uint16_t code, std::span<const std::uint8_t> value) {
+    append(block, code);
+    append(block, static_cast<std::uint16_t>(value.size()));
+    block.insert(block.end(), value.begin(), value.end());
+    pad(block);
+}
+
+/**
+ * @brief append the trailing block length and set the leading one
+ */
+static void finish_block(std::vector<std::uint8_t> &block) {
+    pad(block);
+    const auto length = static_cast<std::uint32_t>(block.size() + sizeof(std::uint32_t));
+    append(block, length);
+    std::memcpy(block.data() + sizeof(std::uint32_t), &length, sizeof(length));
+}
+
+/**
+ * @brief get a span of the characters of a string (pcapng options)
+ */
+static std::span<const std::uint8_t> bytes(const char *string) {
+    return {reinterpret_cast<const std::uint8_t *>(string), std::strlen(string)};  // NOLINT
+}
+
+/**
+ * @brief calculate the checksum of an IPv4 header
+ */
+static std::uint16_t ipv4_checksum(std::span<const std::uint8_t> header) {
+    std::uint32_t sum = 0;
+    for (std::size_t i = 0; i + 1 < header.size(); i += 2)
+        sum += static_cast<std::uint32_t>(header[i] << 8 | header[i + 1]);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<std::uint16_t>(~sum);
+}
+
+Pcapng_Capture::Pcapng_Capture(const std::string &path,
+                               std::size_t        ring_size,
+                               std::size_t        max_file_size,
+                               std::size_t        max_files)
+    : path(path), ring_size(ring_size), max_file_size(max_file_size), max_files(max_files) {
+    if (max_files == 0) throw std::invalid_argument("invalid number of capture files: 0");
+    open_file();
+}
+
+Pcapng_Capture::~Pcapng_Capture() {
+    stop_writer();
+    if (file) std::fclose(file);
+}
+
+Capture_Ring &Pcapng_Capture::add_ring() {
+    if (writer.joinable()) throw std::logic_error("capture ring buffers must be added before the capture is started");
+    rings.emplace_back(std::make_unique<Capture_Ring>(ring_size));
+    return *rings.back();
+}
+
+void Pcapng_Capture::start() {
+    writer = std::thread(&Pcapng_Capture::run, this);
+}
+
+void Pcapng_Capture::stop_writer() {
+    stop.store(true, std::memory_order_release);
+    if (writer.joinable()) writer.join();
+    if (file) std::fflush(file);
+}
+
+void Pcapng_Capture::run() {
+    while (!stop.load(std::memory_order_acquire)) {
+        if (drain() != 0) continue;
+
+        // makes the packets visible in the file while the server is running
+        if (file) std::fflush(file);
+        std::this_thread::sleep_for(IDLE_INTERVAL);
+    }
+
+    // packets that were captured before the capture was stopped
+    drain();
+}
+
+std::size_t Pcapng_Capture::drain() {
+    std::size_t records = 0;
+    for (auto &ring : rings) {
+        records += ring->drain([this](const Capture_Ring::record_t &record, std::span<const std::uint8_t> adu) {
+            if (failed) return;
+
+            try {
+                write_packet(record, adu);
+            } catch (const std::exception &e) {
+                Log::error() << "capture stopped: " << e.what();
+                failed = true;
+                if (file) std::fclose(file);
+                file = nullptr;
+            }
+        });
+    }
+    return records;
+}
+
+void Pcapng_Capture::open_file() {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) throw std::system_error(errno, std::generic_category(), "Failed to create capture file " + path);
+    std::setvbuf(file, nullptr, _IOFBF, FILE_BUFFER_SIZE);
+    file_size = 0;
+
+    begin_block(block, SECTION_HEADER_BLOCK);
+    append(block, BYTE_ORDER_MAGIC);
+    append(block, std::uint16_t(1));  // major version
+    append(block, std::uint16_t(0));  // minor version
+    append(block, std::int64_t(-1));  // section length: not specified
+    append_option(block, OPTION_SHB_USERAPPL, bytes(APPLICATION));
+    append_option(block, OPTION_END, {});
+    finish_block(block);
+    write_block();
+
+    begin_block(block, INTERFACE_BLOCK);
+    append(block, LINKTYPE_RAW);
+    append(block, std::uint16_t(0));  // reserved
+    append(block, std::uint32_t(0));  // snap length: no limit
+    append_option(block, OPTION_IF_NAME, bytes("modbus"));
+    append_option(block, OPTION_IF_TSRESOL, std::span<const std::uint8_t>(&TSRESOL_NANOSECONDS, 1));
+    append_option(block, OPTION_END, {});
+    finish_block(block);
+    write_block();
+}
+
+void Pcapng_Capture::rotate() {
+    std::fclose(file);
+    file = nullptr;
+
+    // <path>.n-1 --> <path>.n, ..., <path> --> <path>.1 (the oldest file is replaced)
+    for (std::size_t i = max_files - 1; i > 0; --i) {
+        const auto from = i == 1 ? path : path + '.' + std::to_string(i - 1);
+        const auto to   = path + '.' + std::to_string(i);
+        if (std::rename(from.c_str(), to.c_str()) != 0 && errno != ENOENT)
+            throw std::system_error(errno, std::generic_category(), "Failed to rename capture file " + from);
+    }
+
+    // sequence numbers start again in each file
+    sequence.clear();
+    open_file();
+}
+
+void Pcapng_Capture::write_packet(const Capture_Ring::record_t &record, std::span<const std::uint8_t> adu) {
+    const auto &flow    = record.flow;
+    const bool  request = record.direction == Capture_Ring::REQUEST;
+    const bool  ipv4    = flow.family == AF_INET;
+    if (!ipv4 && flow.family != AF_INET6) return;  // connection without address (e.g. unix socket)
+
+    // TCP sequence number of this direction and of the opposite direction (acknowledgement)
+    std::string key(reinterpret_cast<const char *>(&flow), sizeof(flow));  // NOLINT
+    key.push_back(static_cast<char>(record.direction));
+    auto &seq  = sequence[key];
+    key.back() = static_cast<char>(request ? Capture_Ring::REPLY : Capture_Ring::REQUEST);
+    const auto ack = sequence[key];
+
+    const auto &src_addr = request ? flow.client_addr : flow.server_addr;
+    const auto &dst_addr = request ? flow.server_addr : flow.client_addr;
+    const auto  src_port = request ? flow.client_port : flow.server_port;
+    const auto  dst_port = request ? flow.server_port : flow.client_port;
+
+    const auto ip_header_size = ipv4 ? IPV4_HEADER_SIZE : IPV6_HEADER_SIZE;
+    const auto packet_size    = static_cast<std::uint32_t>(ip_header_size + TCP_HEADER_SIZE + adu.size());
+
+    begin_block(block, ENHANCED_PACKET_BLOCK);
+    append(block, std::uint32_t(0));  // interface id
+    append(block, static_cast<std::uint32_t>(record.timestamp >> 32));
+    append(block, static_cast<std::uint32_t>(record.timestamp));
+    append(block, packet_size);  // captured length
+    append(block, packet_size);  // original length
+
+    const auto ip_header = block.size();
+    if (ipv4) {
+        append_be(block, std::uint8_t(0x45));  // version 4, header length 5 * 4 bytes
+        append_be(block, std::uint8_t(0));     // type of service
+        append_be(block, static_cast<std::uint16_t>(packet_size));
+        append_be(block, std::uint16_t(0));       // identification
+        append_be(block, std::uint16_t(0x4000));  // don't fragment
+        append_be(block, IP_TTL);
+        append_be(block, IP_PROTOCOL_TCP);
+        append_be(block, std::uint16_t(0));  // checksum (set below)
+        block.insert(block.end(), src_addr.begin(), src_addr.begin() + 4);
+        block.insert(block.end(), dst_addr.begin(), dst_addr.begin() + 4);
+
+        const auto checksum = ipv4_checksum(std::span(block).subspan(ip_header, IPV4_HEADER_SIZE));
+        block[ip_header + 10] = static_cast<std::uint8_t>(checksum >> 8);    // NOLINT
+        block[ip_header + 11] = static_cast<std::uint8_t>(checksum & 0xFF);  // NOLINT
+    } else {
+        append_be(block, std::uint32_t(0x60000000));  // version 6
+        append_be(block, static_cast<std::uint16_t>(TCP_HEADER_SIZE + adu.size()));
+        append_be(block, IP_PROTOCOL_TCP);
+        append_be(block, IP_TTL);
+        block.insert(block.end(), src_addr.begin(), src_addr.end());
+        block.insert(block.end(), dst_addr.begin(), dst_addr.end());
+    }
+
+    append_be(block, src_port);
+    append_be(block, dst_port);
+    append_be(block, seq);
+    append_be(block, ack);
+    append_be(block, std::uint8_t(0x50));  // header length 5 * 4 bytes
+    append_be(block, TCP_FLAGS_PSH_ACK);
+    append_be(block, TCP_WINDOW);
+    append_be(block, std::uint16_t(0));  // checksum (not calculated)
+    append_be(block, std::uint16_t(0));  // urgent pointer
+    block.insert(block.end(), adu.begin(), adu.end());
+    finish_block(block);
+
+    write_block();
+    seq += static_cast<std::uint32_t>(adu.size());
+    written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (file_size >= max_file_size) rotate();
+}
+
+void Pcapng_Capture::write_block() {
+    if (std::fwrite(block.data(), 1, block.size(), file) != block.size())
+        throw std::system_error(errno, std::generic_category(), "Failed to write capture file " + path);
+    file_size += block.size();
+}
+
+}  // namespace Modbus
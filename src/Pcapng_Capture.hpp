@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Capture_Ring.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Modbus {
+
+/*! \brief writes the ADUs of capture ring buffers to rotating pcapng files (--capture)
+ *
+ * Each thread that handles requests gets its own ring buffer (add_ring).
+ * A background thread drains the ring buffers and writes the ADUs as IPv4/IPv6 + TCP packets (link type RAW) to the
+ * file. Wireshark decodes them as Modbus/TCP (port 502 or "Decode As").
+ *
+ * If the file exceeds the maximum size, it is renamed to <path>.1 (<path>.1 to <path>.2, ...) and a new file is
+ * created. At most max_files files are kept.
+ */
+class Pcapng_Capture final {
+private:
+    std::string path;           //!< path of the current capture file
+    std::size_t ring_size;      //!< size of each ring buffer in bytes
+    std::size_t max_file_size;  //!< size of a file that triggers the rotation
+    std::size_t max_files;      //!< maximum number of files (including the current one)
+
+    std::vector<std::unique_ptr<Capture_Ring>> rings;  //!< one ring buffer per producer thread
+
+    std::FILE  *file      = nullptr;  //!< current capture file
+    std::size_t file_size = 0;        //!< bytes written to the current file
+    bool        failed    = false;    //!< a write operation failed (records are discarded)
+
+    std::vector<std::uint8_t> block;  //!< buffer of the encoded block (reused for each packet)
+
+    //! next TCP sequence number of each direction of each connection (reset on rotation)
+    std::unordered_map<std::string, std::uint32_t> sequence;
+
+    std::atomic<std::uint64_t> written {0};  //!< number of written packets
+    std::atomic<bool>          stop {false};  //!< terminates the writer thread
+    std::thread                writer;        //!< drains the ring buffers
+
+public:
+    /**
+     * @brief create the capture file
+     *
+     * @param path path of the capture file
+     * @param ring_size size of each ring buffer in bytes
+     * @param max_file_size size of a file that triggers the rotation in bytes
+     * @param max_files maximum number of files (including the current one)
+     */
+    Pcapng_Capture(const std::string &path, std::size_t ring_size, std::size_t max_file_size, std::size_t max_files);
+
+    ~Pcapng_Capture();
+
+    Pcapng_Capture(const Pcapng_Capture &other)            = delete;
+    Pcapng_Capture(Pcapng_Capture &&other)                 = delete;
+    Pcapng_Capture &operator=(const Pcapng_Capture &other) = delete;
+    Pcapng_Capture &operator=(Pcapng_Capture &&other)      = delete;
+
+    /**
+     * @brief create a ring buffer for a producer thread
+     *
+     * @details must not be called after start
+     */
+    Capture_Ring &add_ring();
+
+    /**
+     * @brief start the writer thread
+     */
+    void start();
+
+    /**
+     * @brief write the remaining packets and stop the writer thread
+     *
+     * @details called by the destructor
+     */
+    void stop_writer();
+
+    [[nodiscard]] std::uint64_t get_written() const noexcept { return written.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] const std::string &get_path() const noexcept { return path; }
+
+private:
+    void run();
+
+    std::size_t drain();
+
+    void open_file();
+
+    void rotate();
+
+    void write_packet(const Capture_Ring::record_t &record, std::span<const std::uint8_t> adu);
+
+    void write_block();
+};
+
+}  // namespace Modbus
@@ -10,10 +10,24 @@
 
 Print_Time Print_Time::iso("%F_%T");  // NOLINT
 
+std::string_view Print_Time::at(std::time_t time) const {
+    thread_local const Print_Time                                *cached_format = nullptr;
+    thread_local std::time_t                                      cached_time   = 0;
+    thread_local std::array<char, sizeof "1234-25-78T90:12:34Z"> buf {};
+    thread_local std::size_t                                      length        = 0;
+
+    if (cached_format != this || cached_time != time) {
+        struct tm tm {};
+        gmtime_r(&time, &tm);  // thread safe (used by multiple worker threads)
+        length        = strftime(buf.data(), buf.size(), format.c_str(), &tm);
+        cached_format = this;
+        cached_time   = time;
+    }
+
+    return {buf.data(), length};
+}
+
 std::ostream &operator<<(std::ostream &o, const Print_Time &p) {
-    auto                                            now = time(nullptr);
-    std::array<char, sizeof "1234-25-78T90:12:34Z"> buf {};
-    strftime(buf.data(), buf.size(), p.format.c_str(), gmtime(&now));
-    o << buf.data();
+    o << p.at(time(nullptr));
     return o;
 }
@@ -5,8 +5,10 @@
 
 #pragma once
 
+#include <ctime>
 #include <ostream>
 #include <string>
+#include <string_view>
 
 class Print_Time {
 public:
@@ -18,5 +20,13 @@ private:
 public:
     explicit Print_Time(std::string format) : format(std::move(format)) {}
 
+    /**
+     * @brief format a time
+     *
+     * @details the formatted time is cached per thread: strftime is only called once per second
+     * @return formatted time (valid until the next call in the same thread)
+     */
+    [[nodiscard]] std::string_view at(std::time_t time) const;
+
     friend std::ostream &operator<<(std::ostream &o, const Print_Time &p);
 };
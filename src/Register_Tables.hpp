@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Address_Map.hpp"
+#include "Shm_Control_Layout.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <modbus/modbus.h>
+
+namespace Modbus {
+
+namespace shm {
+class Shm_Control;
+}
+
+//! registers that are modified by a request
+struct Write_Range {
+    shm::control::table_index_t table;    //!< DO or AO
+    std::size_t                 address;  //!< index of the first written register (relative to the table start)
+    std::size_t                 count;    //!< number of written registers
+};
+
+//! register tables that are accessed by a request (bit n: table n, see shm::control::table_index_t)
+struct Table_Access {
+    std::uint8_t read  = 0;  //!< tables that are read
+    std::uint8_t write = 0;  //!< tables that are written
+};
+
+/*! \brief register storage of one client id
+ *
+ * Describes how the tables of a modbus_mapping_t are stored.
+ */
+struct Register_Tables {
+    modbus_mapping_t *mapping = nullptr;  //!< register storage (sizes and table addresses)
+
+    /*! \brief tab_bits and tab_input_bits store 8 coils per byte (bit n at byte n / 8, bit n % 8)
+     *
+     * @details packed tables can only be accessed by the built-in PDU engine (not by modbus_reply)
+     */
+    bool packed_bits = false;
+
+    //! synchronization with other processes that access the tables (nullptr: disabled)
+    shm::Shm_Control *control = nullptr;
+
+    /*! \brief sparse address windows of the tables (indexed by shm::control::table_index_t, nullptr: address n is
+     *         stored at index n)
+     *
+     * @details tables with address windows can only be accessed by the built-in PDU engine (not by modbus_reply)
+     */
+    std::array<const Address_Map *, shm::control::TABLE_COUNT> windows {};
+
+    //! check if the tables can only be accessed by the built-in PDU engine
+    [[nodiscard]] bool builtin_only() const noexcept {
+        return packed_bits || windows[0] || windows[1] || windows[2] || windows[3];
+    }
+};
+
+}  // namespace Modbus
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*! \brief layout of the arena shared memory object (<name-prefix>ARENA, --arena)
+ *
+ * The arena contains the register tables of all client ids in one shared memory object.
+ * This header only depends on the standard library and POSIX system headers. It can be used by the processes that
+ * access the register tables.
+ *
+ * The arena starts with header_t, followed by header_t::entry_count entries (entry_t) that describe the register
+ * tables: client id, table, element type, number of registers, offset and size. Every table starts at a multiple of
+ * header_t::page_size (and therefore of the cache line size).
+ * The register tables of the client id ANY_CLIENT_ID are used for all client ids without own register tables.
+ *
+ * The magic number is written last. A process that maps the arena while it is initialized has to wait until ready()
+ * returns true.
+ */
+namespace Modbus::shm::arena {
+
+//! identifies an arena ("MBAR")
+static constexpr std::uint32_t MAGIC = 0x4D424152;
+
+//! layout version
+static constexpr std::uint16_t VERSION = 1;
+
+//! entry_t::client_id of the register tables that are used for all client ids without own register tables
+static constexpr std::uint16_t ANY_CLIENT_ID = 0xFFFF;
+
+//! register tables
+enum table_index_t : std::uint8_t { DO, DI, AO, AI, TABLE_COUNT };
+
+//! storage of the registers of a table
+enum element_type_t : std::uint8_t {
+    ELEMENT_BIT         = 0,  //!< one byte per register (0 or 1)
+    ELEMENT_PACKED_BITS = 1,  //!< 8 registers per byte (register n: bit n % 8 of byte n / 8)
+    ELEMENT_U16         = 2   //!< one 16 bit register in native byte order per 2 bytes
+};
+
+//! header at offset 0 of the arena
+struct header_t {
+    std::uint32_t magic;           //!< MAGIC
+    std::uint16_t version;         //!< VERSION
+    std::uint16_t header_size;     //!< sizeof(header_t)
+    std::uint16_t entry_size;      //!< sizeof(entry_t)
+    std::uint16_t reserved;        //!< 0
+    std::uint32_t entry_count;     //!< number of entries
+    std::uint64_t entries_offset;  //!< offset of the first entry
+    std::uint64_t size;            //!< size of the arena in bytes
+    std::uint32_t page_size;       //!< alignment of the register tables
+    std::uint32_t reserved2;       //!< 0
+};
+
+//! description of one register table
+struct entry_t {
+    std::uint16_t client_id;     //!< client id (ANY_CLIENT_ID: all client ids without own register tables)
+    std::uint8_t  table;         //!< table_index_t
+    std::uint8_t  element_type;  //!< element_type_t
+    std::uint32_t registers;     //!< number of registers
+    std::uint64_t offset;        //!< offset of the table in the arena
+    std::uint64_t size;          //!< size of the table in bytes
+    std::uint32_t alignment;     //!< alignment of offset
+    std::uint32_t reserved;      //!< 0
+};
+
+/**
+ * @brief check if the arena is completely initialized
+ *
+ * @param arena address of the arena
+ * @return true if the arena can be used
+ */
+inline bool ready(void *arena) noexcept {
+    auto *header = static_cast<header_t *>(arena);
+    return std::atomic_ref<std::uint32_t>(header->magic).load(std::memory_order_acquire) == MAGIC &&
+           header->version == VERSION;
+}
+
+/**
+ * @brief get the entries of the arena
+ *
+ * @param arena address of the arena
+ * @return pointer to the first of header_t::entry_count entries
+ */
+inline const entry_t *entries(const void *arena) noexcept {
+    const auto *header = static_cast<const header_t *>(arena);
+    return reinterpret_cast<const entry_t *>(static_cast<const std::uint8_t *>(arena) +  // NOLINT
+                                             header->entries_offset);
+}
+
+/**
+ * @brief find the register table of a client id
+ *
+ * @param arena address of the arena
+ * @param client_id client id
+ * @param table register table
+ * @return entry of the table (the table of ANY_CLIENT_ID if the client id has no own tables) or nullptr
+ */
+inline const entry_t *find(const void *arena, std::uint16_t client_id, table_index_t table) noexcept {
+    const auto *header   = static_cast<const header_t *>(arena);
+    const auto *entry    = entries(arena);
+    const auto *fallback = static_cast<const entry_t *>(nullptr);
+
+    for (std::uint32_t i = 0; i < header->entry_count; ++i) {
+        const auto &e = entry[i];  // NOLINT
+        if (e.table != table) continue;
+        if (e.client_id == client_id) return &e;
+        if (e.client_id == ANY_CLIENT_ID) fallback = &e;
+    }
+
+    return fallback;
+}
+
+/**
+ * @brief get the storage of a register table
+ *
+ * @tparam T std::uint8_t (ELEMENT_BIT, ELEMENT_PACKED_BITS) or std::uint16_t (ELEMENT_U16)
+ * @param arena address of the arena
+ * @param entry entry of the table
+ * @return address of the first register
+ */
+template <typename T>
+T *table(void *arena, const entry_t &entry) noexcept {
+    return reinterpret_cast<T *>(static_cast<std::uint8_t *>(arena) + entry.offset);  // NOLINT
+}
+
+/**
+ * @brief map an arena
+ *
+ * @param name name of the shared memory object
+ * @param writable map the arena writable
+ * @param size size of the mapping
+ * @return address of the arena or nullptr on error (errno is set, EAGAIN: the arena is not initialized yet)
+ */
+inline void *map(const std::string &name, bool writable, std::size_t &size) noexcept {
+    const int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+    if (fd == -1) return nullptr;
+
+    struct stat st {};
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return nullptr;
+    }
+
+    size       = static_cast<std::size_t>(st.st_size);
+    void *addr = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return nullptr;  // NOLINT
+
+    if (size < sizeof(header_t) || !ready(addr)) {
+        munmap(addr, size);
+        errno = EAGAIN;
+        return nullptr;
+    }
+
+    return addr;
+}
+
+}  // namespace Modbus::shm::arena
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Shm_Control.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace Modbus::shm {
+
+//* bytes of table storage per version counter (one cache line: 32 AO registers)
+static constexpr std::size_t BLOCK_SIZE = control::CACHE_LINE;
+
+//* bits per byte
+static constexpr std::size_t BYTE_BITS = 8;
+
+static constexpr std::size_t align(std::size_t value) {
+    return (value + control::CACHE_LINE - 1) / control::CACHE_LINE * control::CACHE_LINE;
+}
+
+/**
+ * @brief get the server that created an existing control object
+ *
+ * @param name name of the shared memory object
+ * @return process id or 0 (the object does not exist or has an unknown layout)
+ */
+static pid_t get_owner(const std::string &name) {
+    const int fd = shm_open(('/' + name).c_str(), O_RDONLY, 0);
+    if (fd == -1) return 0;
+
+    pid_t       owner = 0;
+    struct stat st {};
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(control::header_t)) {
+        void *addr = mmap(nullptr, sizeof(control::header_t), PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {  // NOLINT
+            const auto *header = static_cast<const control::header_t *>(addr);
+            if (header->magic == control::MAGIC && header->version == control::VERSION &&
+                header->header_size == sizeof(control::header_t))
+                owner = header->owner_pid;
+            munmap(addr, sizeof(control::header_t));
+        }
+    }
+
+    close(fd);
+    return owner;
+}
+
+Shm_Control::Shm_Control(const std::string      &name,
+                         const modbus_mapping_t &mapping,
+                         bool                    packed_bits,  // NOLINT
+                         std::uint32_t           features,
+                         bool                    force,
+                         mode_t                  permissions)
+    : packed_bits(packed_bits) {
+    const auto bits_size = [packed_bits](int nb) {
+        const auto n = static_cast<std::size_t>(nb);
+        return packed_bits ? (n + BYTE_BITS - 1) / BYTE_BITS : n;
+    };
+
+    control::header_t tmp {};
+    tmp.magic       = control::MAGIC;
+    tmp.version     = control::VERSION;
+    tmp.header_size = sizeof(control::header_t);
+    tmp.features    = features;
+    tmp.flags       = packed_bits ? control::FLAG_PACKED_BITS : 0;
+    tmp.block_size  = BLOCK_SIZE;
+    tmp.owner_pid   = getpid();
+
+    tmp.table_size[control::DO] = static_cast<std::uint32_t>(bits_size(mapping.nb_bits));
+    tmp.table_size[control::DI] = static_cast<std::uint32_t>(bits_size(mapping.nb_input_bits));
+    tmp.table_size[control::AO] = static_cast<std::uint32_t>(2 * static_cast<std::size_t>(mapping.nb_registers));
+    tmp.table_size[control::AI] = static_cast<std::uint32_t>(2 * static_cast<std::size_t>(mapping.nb_input_registers));
+
+    tmp.registers[control::DO] = static_cast<std::uint32_t>(mapping.nb_bits);
+    tmp.registers[control::DI] = static_cast<std::uint32_t>(mapping.nb_input_bits);
+    tmp.registers[control::AO] = static_cast<std::uint32_t>(mapping.nb_registers);
+    tmp.registers[control::AI] = static_cast<std::uint32_t>(mapping.nb_input_registers);
+
+    // regions behind the header (cache line aligned)
+    std::size_t size = align(sizeof(control::header_t));
+
+    if (features & control::FEATURE_SEQLOCK) {
+        for (const auto table : {control::DO, control::AO}) {
+            const std::size_t blocks = (tmp.table_size[table] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            tmp.seq_offset[table]    = static_cast<std::uint32_t>(size);
+            size += align(blocks * sizeof(std::uint32_t));
+        }
+    }
+
+    if (features & control::FEATURE_DIRTY) {
+        const auto words = [](std::size_t bits) {
+            return (bits + control::DIRTY_WORD_BITS - 1) / control::DIRTY_WORD_BITS;
+        };
+
+        for (const auto table : {control::DO, control::AO}) {
+            const std::size_t bitmap_words = words(tmp.registers[table]);
+            tmp.dirty_offset[table]        = static_cast<std::uint32_t>(size);
+            size += align(bitmap_words * sizeof(std::uint64_t));
+            tmp.summary_offset[table] = static_cast<std::uint32_t>(size);
+            size += align(words(bitmap_words) * sizeof(std::uint64_t));
+        }
+    }
+
+    if (features & control::FEATURE_NOTIFY) {
+        tmp.notify_offset = static_cast<std::uint32_t>(size);
+        size += align(sizeof(control::notify_t));
+    }
+
+    if (features & control::FEATURE_TABLE_LOCKS) {
+        tmp.lock_offset = static_cast<std::uint32_t>(size);
+        size += align(control::TABLE_COUNT * sizeof(control::table_lock_t));
+    }
+
+    if (force) check_unused(name);
+
+    shm    = std::make_unique<cxxshm::SharedMemory>(name, size, false, !force, permissions);
+    header = static_cast<control::header_t *>(shm->get_addr());
+
+    std::memset(shm->get_addr(), 0, size);
+    std::memcpy(header, &tmp, sizeof(tmp));
+
+    if (features & control::FEATURE_TABLE_LOCKS) {
+        pthread_rwlockattr_t attr;  // NOLINT
+        int                  ret = pthread_rwlockattr_init(&attr);
+        if (ret == 0) ret = pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __GLIBC__
+        // Modbus masters that poll continuously must not starve writers
+        if (ret == 0) ret = pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        for (std::size_t i = 0; ret == 0 && i < control::TABLE_COUNT; ++i)
+            ret = pthread_rwlock_init(control::table_lock(header, static_cast<control::table_index_t>(i)), &attr);
+        pthread_rwlockattr_destroy(&attr);
+        if (ret != 0) throw std::system_error(ret, std::generic_category(), "Failed to initialize table locks");
+    }
+}
+
+void Shm_Control::check_unused(const std::string &name) {
+    // the table locks and version counters of an object that is in use must not be reinitialized
+    // (a process may hold or wait for a lock)
+    const auto owner = get_owner(name);
+    if (owner != 0 && (kill(owner, 0) == 0 || errno == EPERM)) {
+        throw std::runtime_error("shared memory '" + name + "' is in use by process " + std::to_string(owner) +
+                                 " (--force requires that the process is terminated)");
+    }
+}
+
+int Shm_Control::lock_tables(const Table_Access &access, const struct timespec *timeout) noexcept {
+    // one deadline for all tables
+    struct timespec deadline {};
+    if (timeout) deadline = control::abs_timeout(*timeout);
+
+    // ascending table order: processes that lock multiple tables cannot deadlock
+    for (std::size_t i = 0; i < control::TABLE_COUNT; ++i) {
+        const auto table = static_cast<control::table_index_t>(i);
+        const auto mask  = 1U << i;
+        auto      *lock  = control::table_lock(header, table);
+
+        int ret = 0;
+        if (access.write & mask)
+            ret = timeout ? pthread_rwlock_timedwrlock(lock, &deadline) : pthread_rwlock_wrlock(lock);
+        else if (access.read & mask)
+            ret = timeout ? pthread_rwlock_timedrdlock(lock, &deadline) : pthread_rwlock_rdlock(lock);
+
+        if (ret != 0) {
+            // release the tables that are already locked
+            const auto   locked = mask - 1;
+            Table_Access acquired;
+            acquired.read  = static_cast<std::uint8_t>(access.read & locked);
+            acquired.write = static_cast<std::uint8_t>(access.write & locked);
+            unlock_tables(acquired);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+void Shm_Control::unlock_tables(const Table_Access &access) noexcept {
+    for (std::size_t i = 0; i < control::TABLE_COUNT; ++i) {
+        if ((access.read | access.write) & (1U << i)) control::unlock(header, static_cast<control::table_index_t>(i));
+    }
+}
+
+std::size_t Shm_Control::first_byte(const Write_Range &range) const noexcept {
+    if (range.table == control::AO) return 2 * range.address;
+    return packed_bits ? range.address / BYTE_BITS : range.address;
+}
+
+std::size_t Shm_Control::last_byte(const Write_Range &range) const noexcept {
+    const auto last = range.address + range.count - 1;
+    if (range.table == control::AO) return 2 * last + 1;
+    return packed_bits ? last / BYTE_BITS : last;
+}
+
+void Shm_Control::begin_write(const Write_Range &range) noexcept {
+    if (header->seq_offset[range.table] != 0) {
+        // ascending order: writers of overlapping ranges cannot deadlock
+        for (std::size_t i = first_byte(range) / BLOCK_SIZE; i <= last_byte(range) / BLOCK_SIZE; ++i)
+            control::write_begin(control::block_version(header, range.table, i * BLOCK_SIZE));
+    }
+}
+
+void Shm_Control::end_write(const Write_Range &range) noexcept {
+    if (header->seq_offset[range.table] != 0) {
+        for (std::size_t i = first_byte(range) / BLOCK_SIZE; i <= last_byte(range) / BLOCK_SIZE; ++i)
+            control::write_end(control::block_version(header, range.table, i * BLOCK_SIZE));
+    }
+
+    if (header->dirty_offset[range.table] != 0) control::mark_dirty(header, range.table, range.address, range.count);
+    if (header->notify_offset != 0) control::notify(header);
+}
+
+void Shm_Control::signal_eventfds() noexcept {
+    if (!has_eventfds()) return;
+
+    static constexpr std::uint64_t EVENT = 1;
+    std::lock_guard                lock(event_fds_mutex);
+    for (const int fd : event_fds) {
+        // the eventfd is non-blocking: a full counter (never reached in practice) is ignored
+        [[maybe_unused]] const auto tmp = write(fd, &EVENT, sizeof(EVENT));
+    }
+}
+
+void Shm_Control::add_eventfd(int fd) {
+    std::lock_guard lock(event_fds_mutex);
+    event_fds.push_back(fd);
+    event_fd_count.store(event_fds.size(), std::memory_order_relaxed);
+}
+
+void Shm_Control::remove_eventfd(int fd) {
+    std::lock_guard lock(event_fds_mutex);
+    event_fds.erase(std::remove(event_fds.begin(), event_fds.end(), fd), event_fds.end());
+    event_fd_count.store(event_fds.size(), std::memory_order_relaxed);
+}
+
+}  // namespace Modbus::shm
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Register_Tables.hpp"
+#include "Shm_Control_Layout.hpp"
+#include "cxxshm.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Modbus::shm {
+
+/*! \brief control shared memory object (<name-prefix>CTL) of a Shm_Mapping
+ *
+ * Provides synchronization data to the processes that access the register tables (see Shm_Control_Layout.hpp).
+ */
+class Shm_Control final {
+private:
+    std::unique_ptr<cxxshm::SharedMemory> shm;
+    control::header_t                    *header      = nullptr;
+    bool                                  packed_bits = false;
+
+    std::mutex               event_fds_mutex;     //!< protects event_fds
+    std::vector<int>         event_fds;           //!< eventfds that are signaled after every write request
+    std::atomic<std::size_t> event_fd_count = 0;  //!< number of event_fds (checked without the mutex)
+
+public:
+    /*! \brief create the control object
+     *
+     * @param name name of the shared memory object
+     * @param mapping register tables that are controlled
+     * @param packed_bits layout of DO and DI (see Register_Tables::packed_bits)
+     * @param features enabled features (control::FEATURE_*)
+     * @param force do not fail if the shared memory exist, but reinitialize the existing shared memory
+     *              (fails if the server that created it is still running, see check_unused)
+     * @param permissions shared memory file permissions
+     */
+    Shm_Control(const std::string      &name,
+                const modbus_mapping_t &mapping,
+                bool                    packed_bits,
+                std::uint32_t           features,
+                bool                    force,
+                mode_t                  permissions);
+
+    ~Shm_Control() = default;
+
+    Shm_Control(const Shm_Control &other)            = delete;
+    Shm_Control(Shm_Control &&other)                 = delete;
+    Shm_Control &operator=(const Shm_Control &other) = delete;
+    Shm_Control &operator=(Shm_Control &&other)      = delete;
+
+    /*! \brief check that an existing control object can be reinitialized
+     *
+     * @details throws if the server that created the object is still running
+     *
+     * @param name name of the shared memory object
+     */
+    static void check_unused(const std::string &name);
+
+    /*! \brief must be called before registers are written
+     *
+     * @param range written registers
+     */
+    void begin_write(const Write_Range &range) noexcept;
+
+    /*! \brief must be called after registers are written
+     *
+     * @details wakes the consumers that wait in control::wait_notify. The eventfds are signaled separately (see
+     *          signal_eventfds).
+     *
+     * @param range written registers (same as begin_write)
+     */
+    void end_write(const Write_Range &range) noexcept;
+
+    /*! \brief signal the eventfds (see add_eventfd)
+     *
+     * @details should be called after write requests, once all locks are released. Thread safe.
+     */
+    void signal_eventfds() noexcept;
+
+    /*! \brief check if eventfds are registered
+     *
+     * @return true: signal_eventfds has to be called after write requests
+     */
+    [[nodiscard]] bool has_eventfds() const noexcept { return event_fd_count.load(std::memory_order_relaxed) != 0; }
+
+    /*! \brief check if the register tables have reader/writer locks
+     *
+     * @return true: lock_tables and unlock_tables must be used
+     */
+    [[nodiscard]] bool has_table_locks() const noexcept { return header->lock_offset != 0; }
+
+    /*! \brief acquire the locks of the register tables that are accessed by a request
+     *
+     * @details tables that are written are locked exclusively, tables that are only read are locked shared.
+     *          The locks are acquired in ascending table order. Requires has_table_locks().
+     *
+     * @param access accessed tables
+     * @param timeout relative timeout for all tables together (nullptr: infinite)
+     * @return 0 or error number (ETIMEDOUT: timeout). On error, no table is locked.
+     */
+    int lock_tables(const Table_Access &access, const struct timespec *timeout) noexcept;
+
+    /*! \brief release the locks of the register tables
+     *
+     * @param access accessed tables (same as lock_tables)
+     */
+    void unlock_tables(const Table_Access &access) noexcept;
+
+    /*! \brief signal an eventfd after every write request
+     *
+     * @details thread safe. The eventfd is not closed by this object.
+     *
+     * @param fd eventfd
+     */
+    void add_eventfd(int fd);
+
+    /*! \brief stop signaling an eventfd
+     *
+     * @details thread safe. The eventfd can be closed after this function returned.
+     *
+     * @param fd eventfd
+     */
+    void remove_eventfd(int fd);
+
+private:
+    [[nodiscard]] std::size_t first_byte(const Write_Range &range) const noexcept;
+    [[nodiscard]] std::size_t last_byte(const Write_Range &range) const noexcept;
+};
+
+}  // namespace Modbus::shm
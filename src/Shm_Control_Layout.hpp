@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*! \brief layout of the control shared memory object (<name-prefix>CTL)
+ *
+ * The control object contains synchronization data for the register tables of one name prefix.
+ * This header only depends on the standard library and linux system headers. It can be used by the processes that
+ * access the register tables.
+ *
+ * Seqlock: the storage of DO and AO is divided into blocks of header_t::block_size bytes. Each block has a version
+ * counter that is odd while the block is written. A reader retries if the counter was odd or changed while reading.
+ *
+ * Dirty bitmap: DO and AO have one bit per register that is set after a Modbus master wrote the register. A summary
+ * with one bit per 64 bit word of the bitmap allows a consumer to find the set bits without scanning the bitmap.
+ *
+ * Notification: a 32 bit sequence number is incremented after every write request of a Modbus master. Consumers can
+ * wait for a change with wait_notify (futex) or receive an eventfd from the notify socket (connect_notify).
+ *
+ * Table locks: each register table has a process-shared reader/writer lock (writers are preferred). The server takes
+ * shared locks for read requests and exclusive locks for write requests. Locks of multiple tables must be acquired
+ * in ascending table order (DO, DI, AO, AI).
+ * The table locks are not robust: if a process terminates while it holds a table lock, the table stays locked until
+ * the server is restarted and the requests of the Modbus masters that access the table fail (exception 0x06 after
+ * the lock timeout of the server). Consumers should keep the locked sections short, use a timeout for every lock
+ * and read with the seqlock instead of a lock where possible. A server that is started with --force reinitializes
+ * the control object, but only if the process in header_t::owner_pid does not exist any more. Consumers must not
+ * hold or acquire table locks while no server is running.
+ */
+namespace Modbus::shm::control {
+
+//! identifies a control object ("MBCL")
+static constexpr std::uint32_t MAGIC = 0x4D42434C;
+
+//! layout version
+static constexpr std::uint16_t VERSION = 1;
+
+//! alignment of the regions in the control object
+static constexpr std::size_t CACHE_LINE = 64;
+
+//! maximum number of blocks that can be read consistently with read()
+static constexpr std::size_t MAX_READ_BLOCKS = 8;
+
+//! register tables
+enum table_index_t : std::uint8_t { DO, DI, AO, AI, TABLE_COUNT };
+
+//! header_t::features: version counters for DO and AO
+static constexpr std::uint32_t FEATURE_SEQLOCK = 1U << 0;
+
+//! header_t::features: dirty bitmaps for DO and AO
+static constexpr std::uint32_t FEATURE_DIRTY = 1U << 1;
+
+//! header_t::features: write notification (futex)
+static constexpr std::uint32_t FEATURE_NOTIFY = 1U << 2;
+
+//! header_t::features: reader/writer lock per register table
+static constexpr std::uint32_t FEATURE_TABLE_LOCKS = 1U << 3;
+
+//! header_t::flags: DO and DI store 8 registers per byte
+static constexpr std::uint32_t FLAG_PACKED_BITS = 1U << 0;
+
+//! header at offset 0 of the control object
+struct header_t {
+    std::uint32_t magic;        //!< MAGIC
+    std::uint16_t version;      //!< VERSION
+    std::uint16_t header_size;  //!< sizeof(header_t)
+    std::uint32_t features;     //!< enabled features (FEATURE_*)
+    std::uint32_t flags;        //!< layout of the register tables (FLAG_*)
+    std::uint32_t block_size;   //!< bytes of table storage per version counter
+
+    std::array<std::uint32_t, TABLE_COUNT> table_size;      //!< size of the register tables in bytes
+    std::array<std::uint32_t, TABLE_COUNT> registers;       //!< number of registers of the register tables
+    std::array<std::uint32_t, TABLE_COUNT> seq_offset;      //!< offset of the version counters of a table (0: none)
+    std::array<std::uint32_t, TABLE_COUNT> dirty_offset;    //!< offset of the dirty bitmap of a table (0: none)
+    std::array<std::uint32_t, TABLE_COUNT> summary_offset;  //!< offset of the dirty summary of a table (0: none)
+    std::uint32_t                          notify_offset;   //!< offset of notify_t (0: none)
+    std::uint32_t                          lock_offset;     //!< offset of the table_lock_t array (0: none)
+    std::int32_t                           owner_pid;       //!< process id of the server that created the object
+};
+
+//! reader/writer lock of a register table (own cache line)
+struct alignas(CACHE_LINE) table_lock_t {
+    pthread_rwlock_t lock;  //!< process-shared, writers are preferred
+};
+
+//! write notification (own cache line)
+struct notify_t {
+    std::uint32_t sequence;  //!< incremented after every write request (futex word)
+    std::uint32_t waiters;   //!< number of consumers that wait in wait_notify
+};
+
+//! bits per word of the dirty bitmap and the dirty summary
+static constexpr std::size_t DIRTY_WORD_BITS = 64;
+
+/*! \brief get the version counter of a block
+ *
+ * @param control address of the control object
+ * @param table DO or AO
+ * @param byte_offset offset of a byte of the register table
+ * @return version counter of the block that contains the byte
+ */
+inline std::atomic_ref<std::uint32_t> block_version(void *control, table_index_t table, std::size_t byte_offset) {
+    auto       *base     = static_cast<std::uint8_t *>(control);
+    const auto *header   = static_cast<const header_t *>(control);
+    auto       *counters = reinterpret_cast<std::uint32_t *>(base + header->seq_offset[table]);  // NOLINT
+    return std::atomic_ref<std::uint32_t>(counters[byte_offset / header->block_size]);           // NOLINT
+}
+
+/*! \brief mark a block as being written
+ *
+ * @details waits if the block is written by another writer
+ *
+ * @param version version counter of the block
+ */
+inline void write_begin(std::atomic_ref<std::uint32_t> version) noexcept {
+    std::uint32_t value = version.load(std::memory_order_relaxed);
+    while (true) {
+        if (!(value & 1U) && version.compare_exchange_weak(value, value + 1, std::memory_order_acquire)) break;
+        if (value & 1U) value = version.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+/*! \brief mark a block as completely written
+ *
+ * @param version version counter of the block (write_begin must have been called)
+ */
+inline void write_end(std::atomic_ref<std::uint32_t> version) noexcept {
+    version.fetch_add(1, std::memory_order_release);
+}
+
+/*! \brief read a range of a register table consistently
+ *
+ * @param control address of the control object
+ * @param table DO or AO
+ * @param table_addr address of the register table
+ * @param byte_offset offset of the first byte to read
+ * @param size number of bytes to read
+ * @param dst destination
+ * @return false: the range covers more than MAX_READ_BLOCKS blocks
+ */
+inline bool read(void         *control,
+                 table_index_t table,
+                 const void   *table_addr,
+                 std::size_t   byte_offset,
+                 std::size_t   size,
+                 void         *dst) noexcept {
+    const auto       *header = static_cast<const header_t *>(control);
+    const std::size_t first  = byte_offset / header->block_size;
+    const std::size_t blocks = (byte_offset + size - 1) / header->block_size - first + 1;
+    if (blocks > MAX_READ_BLOCKS) return false;
+
+    std::array<std::uint32_t, MAX_READ_BLOCKS> versions {};
+    while (true) {
+        for (std::size_t i = 0; i < blocks; ++i) {
+            auto version = block_version(control, table, (first + i) * header->block_size);
+            do {
+                versions[i] = version.load(std::memory_order_acquire);  // NOLINT
+            } while (versions[i] & 1U);                                 // NOLINT
+        }
+
+        std::memcpy(dst, static_cast<const std::uint8_t *>(table_addr) + byte_offset, size);  // NOLINT
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        bool changed = false;
+        for (std::size_t i = 0; i < blocks; ++i) {
+            auto version = block_version(control, table, (first + i) * header->block_size);
+            changed      = changed || version.load(std::memory_order_relaxed) != versions[i];  // NOLINT
+        }
+        if (!changed) return true;
+    }
+}
+
+/*! \brief get a word of the dirty bitmap or the dirty summary
+ *
+ * @param control address of the control object
+ * @param offset header_t::dirty_offset or header_t::summary_offset of the table
+ * @param index index of the word
+ * @return word
+ */
+inline std::atomic_ref<std::uint64_t> dirty_word(void *control, std::uint32_t offset, std::size_t index) {
+    auto *words = reinterpret_cast<std::uint64_t *>(static_cast<std::uint8_t *>(control) + offset);  // NOLINT
+    return std::atomic_ref<std::uint64_t>(words[index]);                                           // NOLINT
+}
+
+/*! \brief mark registers as written
+ *
+ * @details must be called after the registers are written
+ *
+ * @param control address of the control object
+ * @param table DO or AO
+ * @param address first register
+ * @param count number of registers (> 0)
+ */
+inline void mark_dirty(void *control, table_index_t table, std::size_t address, std::size_t count) noexcept {
+    const auto       *header = static_cast<const header_t *>(control);
+    const std::size_t last   = address + count - 1;
+
+    for (std::size_t i = address / DIRTY_WORD_BITS; i <= last / DIRTY_WORD_BITS; ++i) {
+        const std::size_t   first_bit = i == address / DIRTY_WORD_BITS ? address % DIRTY_WORD_BITS : 0;
+        const std::size_t   last_bit  = i == last / DIRTY_WORD_BITS ? last % DIRTY_WORD_BITS : DIRTY_WORD_BITS - 1;
+        const std::size_t   bits      = last_bit - first_bit + 1;
+        const std::uint64_t mask      = (~std::uint64_t {0} >> (DIRTY_WORD_BITS - bits)) << first_bit;
+        dirty_word(control, header->dirty_offset[table], i).fetch_or(mask, std::memory_order_release);
+
+        // the summary bit is set after the bitmap bit: a consumer that sees it also sees the bitmap bit
+        dirty_word(control, header->summary_offset[table], i / DIRTY_WORD_BITS)
+                .fetch_or(std::uint64_t {1} << (i % DIRTY_WORD_BITS), std::memory_order_release);
+    }
+}
+
+/*! \brief get and clear the written registers of a table
+ *
+ * @details The callback is called with (first register, number of registers) for each range of written registers.
+ * The new register values are visible when the callback is called.
+ * The costs depend on the number of written registers, not on the size of the table.
+ *
+ * @param control address of the control object
+ * @param table DO or AO
+ * @param callback function that is called for each range of written registers
+ * @return number of written registers
+ */
+template <typename Callback>
+std::size_t fetch_and_clear_dirty(void *control, table_index_t table, Callback &&callback) {
+    const auto       *header  = static_cast<const header_t *>(control);
+    const std::size_t words   = (header->registers[table] + DIRTY_WORD_BITS - 1) / DIRTY_WORD_BITS;
+    std::size_t       changed = 0;
+
+    for (std::size_t s = 0; s * DIRTY_WORD_BITS < words; ++s) {
+        auto summary_word = dirty_word(control, header->summary_offset[table], s);
+        if (summary_word.load(std::memory_order_relaxed) == 0) continue;
+        std::uint64_t summary = summary_word.exchange(0, std::memory_order_acq_rel);
+
+        while (summary != 0) {
+            const std::size_t index = s * DIRTY_WORD_BITS + static_cast<std::size_t>(std::countr_zero(summary));
+            summary &= summary - 1;
+
+            auto          word = dirty_word(control, header->dirty_offset[table], index);
+            std::uint64_t bits = word.exchange(0, std::memory_order_acq_rel);
+            while (bits != 0) {
+                const auto first = static_cast<std::size_t>(std::countr_zero(bits));
+                const auto count = static_cast<std::size_t>(std::countr_one(bits >> first));
+                callback(index * DIRTY_WORD_BITS + first, count);
+                changed += count;
+                if (first + count == DIRTY_WORD_BITS) break;
+                bits &= ~std::uint64_t {0} << (first + count);
+            }
+        }
+    }
+
+    return changed;
+}
+
+/*! \brief get the write notification of the control object
+ *
+ * @param control address of the control object
+ * @return notification (header_t::notify_offset must not be 0)
+ */
+inline notify_t *notify_data(void *control) {
+    const auto *header = static_cast<const header_t *>(control);
+    return reinterpret_cast<notify_t *>(static_cast<std::uint8_t *>(control) + header->notify_offset);  // NOLINT
+}
+
+/*! \brief get the current notification sequence number
+ *
+ * @param control address of the control object
+ * @return sequence number
+ */
+inline std::uint32_t notify_sequence(void *control) {
+    return std::atomic_ref<std::uint32_t>(notify_data(control)->sequence).load(std::memory_order_acquire);
+}
+
+/*! \brief increment the sequence number and wake all waiting consumers
+ *
+ * @details called by the server after every write request. Only wakes (syscall) if consumers are waiting.
+ *
+ * @param control address of the control object
+ */
+inline void notify(void *control) noexcept {
+    auto *data = notify_data(control);
+    std::atomic_ref<std::uint32_t>(data->sequence).fetch_add(1, std::memory_order_seq_cst);
+
+    // seq_cst: either the waiter sees the new sequence or the writer sees the waiter
+    if (std::atomic_ref<std::uint32_t>(data->waiters).load(std::memory_order_seq_cst) != 0)
+        syscall(SYS_futex, &data->sequence, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);  // NOLINT
+}
+
+/*! \brief wait until a Modbus master wrote to the register tables
+ *
+ * @param control address of the control object
+ * @param sequence last known sequence number (see notify_sequence)
+ * @param timeout relative timeout (nullptr: infinite)
+ * @return current sequence number (equal to sequence: timeout or interrupted by a signal)
+ */
+inline std::uint32_t wait_notify(void *control, std::uint32_t sequence, const struct timespec *timeout) noexcept {
+    auto                          *data = notify_data(control);
+    std::atomic_ref<std::uint32_t> current(data->sequence);
+    std::atomic_ref<std::uint32_t> waiters(data->waiters);
+
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    if (current.load(std::memory_order_seq_cst) == sequence)
+        syscall(SYS_futex, &data->sequence, FUTEX_WAIT, sequence, timeout, nullptr, 0);  // NOLINT
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+
+    return current.load(std::memory_order_acquire);
+}
+
+/*! \brief get the reader/writer lock of a register table
+ *
+ * @param control address of the control object
+ * @param table register table
+ * @return lock (header_t::lock_offset must not be 0)
+ */
+inline pthread_rwlock_t *table_lock(void *control, table_index_t table) {
+    const auto *header = static_cast<const header_t *>(control);
+    auto       *base   = static_cast<std::uint8_t *>(control);
+    auto       *locks  = reinterpret_cast<table_lock_t *>(base + header->lock_offset);  // NOLINT
+    return &locks[table].lock;                                                          // NOLINT
+}
+
+/*! \brief convert a relative timeout to an absolute CLOCK_REALTIME timeout
+ *
+ * @param timeout relative timeout
+ * @return absolute timeout
+ */
+inline struct timespec abs_timeout(const struct timespec &timeout) noexcept {
+    static constexpr long NS_PER_S = 1'000'000'000;
+
+    struct timespec result {};
+    clock_gettime(CLOCK_REALTIME, &result);
+    result.tv_sec += timeout.tv_sec;
+    result.tv_nsec += timeout.tv_nsec;
+    if (result.tv_nsec >= NS_PER_S) {
+        result.tv_nsec -= NS_PER_S;
+        ++result.tv_sec;
+    }
+    return result;
+}
+
+/*! \brief acquire the lock of a register table for reading (shared)
+ *
+ * @param control address of the control object
+ * @param table register table
+ * @param timeout relative timeout (nullptr: infinite)
+ * @return 0 or error number (ETIMEDOUT: timeout)
+ */
+inline int read_lock(void *control, table_index_t table, const struct timespec *timeout) noexcept {
+    if (timeout == nullptr) return pthread_rwlock_rdlock(table_lock(control, table));
+    const auto abs = abs_timeout(*timeout);
+    return pthread_rwlock_timedrdlock(table_lock(control, table), &abs);
+}
+
+/*! \brief acquire the lock of a register table for writing (exclusive)
+ *
+ * @param control address of the control object
+ * @param table register table
+ * @param timeout relative timeout (nullptr: infinite)
+ * @return 0 or error number (ETIMEDOUT: timeout)
+ */
+inline int write_lock(void *control, table_index_t table, const struct timespec *timeout) noexcept {
+    if (timeout == nullptr) return pthread_rwlock_wrlock(table_lock(control, table));
+    const auto abs = abs_timeout(*timeout);
+    return pthread_rwlock_timedwrlock(table_lock(control, table), &abs);
+}
+
+/*! \brief release the lock of a register table (read or write)
+ *
+ * @param control address of the control object
+ * @param table register table
+ */
+inline void unlock(void *control, table_index_t table) noexcept {
+    pthread_rwlock_unlock(table_lock(control, table));
+}
+
+/*! \brief get an eventfd that is signaled after every write request
+ *
+ * @details Connects to the notify socket of the server (--notify-socket) and requests an eventfd for the register
+ * tables with the specified name prefix. The eventfd is non-blocking and can be used with poll/epoll.
+ * Reading it returns the number of write requests since the last read. The socket must be kept open as long as the
+ * eventfd is used (the server stops signaling the eventfd when the socket is closed).
+ *
+ * @param socket_path path of the notify socket (starts with '@': abstract socket)
+ * @param name_prefix name prefix of the register tables (e.g. "modbus_")
+ * @param socket_fd the connected socket (output)
+ * @return eventfd or -1 on error (errno is set)
+ */
+inline int connect_notify(const std::string &socket_path, const std::string &name_prefix, int &socket_fd) {
+    struct sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    std::memcpy(addr.sun_path, socket_path.data(), socket_path.size());  // NOLINT
+    if (socket_path.front() == '@') addr.sun_path[0] = '\0';              // NOLINT
+    const auto addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + socket_path.size());
+
+    socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd == -1) return -1;
+
+    const std::string request = name_prefix + '\n';
+    char              status  = 0;
+
+    std::array<char, CMSG_SPACE(sizeof(int))> control_buf {};
+    struct iovec                              iov {};
+    iov.iov_base = &status;
+    iov.iov_len  = sizeof(status);
+    struct msghdr msg {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control_buf.data();
+    msg.msg_controllen = control_buf.size();
+
+    int event_fd = -1;
+    if (connect(socket_fd, reinterpret_cast<const struct sockaddr *>(&addr), addr_len) == 0 &&  // NOLINT
+        send(socket_fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+        const ssize_t         received = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+        const struct cmsghdr *cmsg     = received == 1 ? CMSG_FIRSTHDR(&msg) : nullptr;
+        if (status == 0 && cmsg != nullptr && cmsg->cmsg_type == SCM_RIGHTS)
+            std::memcpy(&event_fd, CMSG_DATA(cmsg), sizeof(event_fd));  // NOLINT
+        else if (received == 0)
+            errno = ECONNRESET;
+        else if (received == 1)
+            errno = ENOENT;  // unknown name prefix
+    }
+
+    if (event_fd == -1) {
+        const int error = errno;
+        close(socket_fd);
+        socket_fd = -1;
+        errno     = error;
+    }
+    return event_fd;
+}
+
+}  // namespace Modbus::shm::control
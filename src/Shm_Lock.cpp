@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#include "Shm_Lock.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <system_error>
+
+namespace Modbus::shm {
+
+Shm_Lock::Shm_Lock(const std::string &name, bool force, mode_t permissions) {
+    shm    = std::make_unique<cxxshm::SharedMemory>(name, sizeof(lock::header_t), false, !force, permissions);
+    header = static_cast<lock::header_t *>(shm->get_addr());
+    std::memset(header, 0, sizeof(lock::header_t));
+
+    pthread_mutexattr_t attr;  // NOLINT
+    int                 tmp = pthread_mutexattr_init(&attr);
+    if (tmp == 0) tmp = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    if (tmp == 0) tmp = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (tmp == 0) tmp = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    if (tmp == 0) tmp = pthread_mutex_init(&header->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (tmp != 0) throw std::system_error(tmp, std::generic_category(), "Failed to initialize mutex '" + name + '\'');
+
+    // the header is written last: other processes may wait for the magic number
+    header->version     = lock::VERSION;
+    header->header_size = sizeof(lock::header_t);
+    std::atomic_ref<std::uint32_t>(header->magic).store(lock::MAGIC, std::memory_order_release);
+}
+
+}  // namespace Modbus::shm
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include "Shm_Lock_Layout.hpp"
+#include "cxxshm.hpp"
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+namespace Modbus::shm {
+
+/*! \brief lock shared memory object (--lock)
+ *
+ * Creates a shared memory object that contains a robust, process-shared mutex with priority inheritance
+ * (see Shm_Lock_Layout.hpp).
+ */
+class Shm_Lock final {
+private:
+    std::unique_ptr<cxxshm::SharedMemory> shm;
+    lock::header_t                       *header = nullptr;
+
+public:
+    /*! \brief create the lock object
+     *
+     * @param name name of the shared memory object
+     * @param force do not fail if the shared memory exist, but use (and reinitialize) the existing shared memory
+     * @param permissions shared memory file permissions
+     */
+    Shm_Lock(const std::string &name, bool force, mode_t permissions);
+
+    ~Shm_Lock() = default;
+
+    Shm_Lock(const Shm_Lock &other)            = delete;
+    Shm_Lock(Shm_Lock &&other)                 = delete;
+    Shm_Lock &operator=(const Shm_Lock &other) = delete;
+    Shm_Lock &operator=(Shm_Lock &&other)      = delete;
+
+    /*! \brief acquire the mutex
+     *
+     * @param timeout relative timeout (nullptr: infinite)
+     * @param spins adaptive spin count of the calling thread
+     * @return result
+     */
+    lock::result_t lock(const struct timespec *timeout, std::uint32_t &spins) noexcept {
+        return lock::lock(header, timeout, spins);
+    }
+
+    //! release the mutex
+    void unlock() noexcept { lock::unlock(header); }
+
+    /*! \brief get the name of the shared memory object
+     *
+     * @return name
+     */
+    [[nodiscard]] const std::string &get_name() const noexcept { return shm->get_name(); }
+};
+
+}  // namespace Modbus::shm
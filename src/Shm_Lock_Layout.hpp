@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <pthread.h>
+
+/*! \brief layout of the lock shared memory object (--lock)
+ *
+ * The lock object contains a process-shared, robust mutex with priority inheritance that protects the register
+ * tables. This header only depends on the standard library and POSIX headers. It can be used by the processes that
+ * access the register tables.
+ *
+ * lock() spins for a short, adaptive time before it blocks in the kernel (futex). If the owner of the mutex
+ * terminates without releasing it, the next lock() recovers the mutex (result_t::recovered).
+ */
+namespace Modbus::shm::lock {
+
+//! identifies a lock object ("MBLK")
+static constexpr std::uint32_t MAGIC = 0x4D424C4B;
+
+//! layout version
+static constexpr std::uint16_t VERSION = 1;
+
+//! maximum number of spin iterations before blocking
+static constexpr std::uint32_t MAX_SPINS = 1000;
+
+//! header at offset 0 of the lock object
+struct header_t {
+    std::uint32_t magic;        //!< MAGIC
+    std::uint16_t version;      //!< VERSION
+    std::uint16_t header_size;  //!< sizeof(header_t)
+
+    alignas(64) pthread_mutex_t mutex;  //!< robust, process-shared mutex with priority inheritance
+};
+
+//! result of lock()
+enum class result_t : std::uint8_t {
+    acquired,   //!< the mutex was acquired
+    recovered,  //!< the mutex was acquired, but the previous owner terminated while holding it
+    timeout,    //!< the mutex could not be acquired within the timeout
+    error       //!< the mutex could not be acquired (errno is set)
+};
+
+//! pause instruction for spin loops
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/*! \brief acquire the mutex
+ *
+ * @param lock address of the lock object
+ * @param timeout relative timeout (nullptr: infinite)
+ * @param spins adaptive spin count. Updated by each call. Should be owned by the calling thread (initial value: 0).
+ * @return result
+ */
+inline result_t lock(header_t *lock, const struct timespec *timeout, std::uint32_t &spins) noexcept {
+    const auto finish = [lock](int rc) {
+        if (rc == 0) return result_t::acquired;
+        if (rc == EOWNERDEAD) {
+            // previous owner terminated: the protected data may be inconsistent, but the mutex is usable again
+            pthread_mutex_consistent(&lock->mutex);
+            return result_t::recovered;
+        }
+        if (rc == ETIMEDOUT) return result_t::timeout;
+        errno = rc;
+        return result_t::error;
+    };
+
+    // moving average of the required spin iterations
+    const auto adapt = [&spins](std::uint32_t count) {
+        const auto diff = static_cast<std::int64_t>(count) - static_cast<std::int64_t>(spins);
+        spins           = static_cast<std::uint32_t>(static_cast<std::int64_t>(spins) + diff / 8);  // NOLINT
+    };
+
+    // adaptive spinning (like PTHREAD_MUTEX_ADAPTIVE_NP, which cannot be combined with priority inheritance)
+    const std::uint32_t max_spins = std::min(MAX_SPINS, 2 * spins + 10);  // NOLINT
+    for (std::uint32_t i = 0; i < max_spins; ++i) {
+        const int rc = pthread_mutex_trylock(&lock->mutex);
+        if (rc != EBUSY) {
+            adapt(i);
+            return finish(rc);
+        }
+        cpu_relax();
+    }
+    adapt(max_spins);
+
+    if (timeout == nullptr) return finish(pthread_mutex_lock(&lock->mutex));
+
+    // priority inheriting mutexes only support CLOCK_REALTIME
+    struct timespec abs_timeout {};
+    clock_gettime(CLOCK_REALTIME, &abs_timeout);
+    static constexpr long NS_PER_S = 1'000'000'000;
+    abs_timeout.tv_sec += timeout->tv_sec;
+    abs_timeout.tv_nsec += timeout->tv_nsec;
+    if (abs_timeout.tv_nsec >= NS_PER_S) {
+        abs_timeout.tv_nsec -= NS_PER_S;
+        ++abs_timeout.tv_sec;
+    }
+
+    return finish(pthread_mutex_timedlock(&lock->mutex, &abs_timeout));
+}
+
+/*! \brief release the mutex
+ *
+ * @param lock address of the lock object
+ */
+inline void unlock(header_t *lock) noexcept {
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+}  // namespace Modbus::shm::lock
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#ifdef IO_URING_ENABLED
+
+#    include "Uring.hpp"
+
+#    include <array>
+#    include <cerrno>
+#    include <memory>
+#    include <poll.h>
+#    include <stdexcept>
+#    include <system_error>
+
+namespace Modbus::TCP {
+
+static constexpr unsigned OP_SHIFT         = 56;
+static constexpr unsigned GENERATION_SHIFT = 32;
+static constexpr uint64_t GENERATION_MASK  = 0xFF'FFFF;
+static constexpr uint64_t FD_MASK          = 0xFFFF'FFFF;
+
+//* milliseconds per second
+static constexpr long MS_PER_S = 1000;
+
+//* nanoseconds per millisecond
+static constexpr long NS_PER_MS = 1000 * 1000;
+
+static inline std::uint64_t encode_user_data(Uring::op_t op, int fd, std::uint32_t generation) {
+    return static_cast<std::uint64_t>(op) << OP_SHIFT | (generation & GENERATION_MASK) << GENERATION_SHIFT |
+           (static_cast<std::uint64_t>(fd) & FD_MASK);
+}
+
+static inline Uring::completion_t decode_completion(const struct io_uring_cqe *cqe) {
+    const auto user_data = io_uring_cqe_get_data64(cqe);
+
+    Uring::completion_t ret {};
+    ret.op         = static_cast<Uring::op_t>(user_data >> OP_SHIFT);
+    ret.generation = static_cast<std::uint32_t>(user_data >> GENERATION_SHIFT & GENERATION_MASK);
+    ret.fd         = static_cast<int>(user_data & FD_MASK);
+    ret.res        = cqe->res;
+    ret.flags      = cqe->flags;
+    return ret;
+}
+
+Uring::Uring() : buffers(static_cast<std::size_t>(BUFFER_COUNT) * BUFFER_SIZE) {
+    int tmp = io_uring_queue_init(QUEUE_DEPTH, &ring, 0);
+    if (tmp < 0) throw std::system_error(-tmp, std::generic_category(), "io_uring_queue_init failed");
+
+    // multishot receive requires linux 6.0, which is also the first version that provides IORING_OP_SEND_ZC
+    std::unique_ptr<struct io_uring_probe, decltype(&io_uring_free_probe)> probe(io_uring_get_probe_ring(&ring),
+                                                                                 &io_uring_free_probe);
+    if (!probe || !io_uring_opcode_supported(probe.get(), IORING_OP_SEND_ZC)) {
+        io_uring_queue_exit(&ring);
+        throw std::system_error(ENOSYS, std::generic_category(), "io_uring multishot receive not supported");
+    }
+
+    buf_ring = io_uring_setup_buf_ring(&ring, BUFFER_COUNT, BUFFER_GROUP, 0, &tmp);
+    if (buf_ring == nullptr) {
+        io_uring_queue_exit(&ring);
+        throw std::system_error(-tmp, std::generic_category(), "io_uring_setup_buf_ring failed");
+    }
+
+    const auto mask = io_uring_buf_ring_mask(BUFFER_COUNT);
+    for (unsigned i = 0; i < BUFFER_COUNT; ++i) {
+        io_uring_buf_ring_add(buf_ring,
+                              buffers.data() + static_cast<std::size_t>(i) * BUFFER_SIZE,  // NOLINT
+                              BUFFER_SIZE,
+                              static_cast<unsigned short>(i),
+                              mask,
+                              static_cast<int>(i));
+    }
+    io_uring_buf_ring_advance(buf_ring, BUFFER_COUNT);
+
+    completions.reserve(QUEUE_DEPTH);
+}
+
+Uring::~Uring() {
+    io_uring_free_buf_ring(&ring, buf_ring, BUFFER_COUNT, BUFFER_GROUP);
+    io_uring_queue_exit(&ring);
+}
+
+struct io_uring_sqe *Uring::get_sqe() {
+    auto *sqe = io_uring_get_sqe(&ring);
+    if (sqe == nullptr) {
+        // submission queue full
+        const int tmp = io_uring_submit(&ring);
+        if (tmp < 0) throw std::system_error(-tmp, std::generic_category(), "io_uring_submit failed");
+        sqe = io_uring_get_sqe(&ring);
+        if (sqe == nullptr) throw std::runtime_error("io_uring submission queue full");
+    }
+    return sqe;
+}
+
+void Uring::accept_multishot(int server_socket) {
+    auto *sqe = get_sqe();
+    io_uring_prep_multishot_accept(sqe, server_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::accept, server_socket, 0));
+}
+
+void Uring::cancel_accept(int server_socket) {
+    auto *sqe = get_sqe();
+    io_uring_prep_cancel64(sqe, encode_user_data(op_t::accept, server_socket, 0), 0);
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::cancel, server_socket, 0));
+}
+
+void Uring::recv_multishot(int fd, std::uint32_t generation) {
+    auto *sqe = get_sqe();
+    io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::recv, fd, generation));
+}
+
+void Uring::send(int fd, std::uint32_t generation, std::span<const std::uint8_t> data) {
+    auto *sqe = get_sqe();
+    io_uring_prep_send(sqe, fd, data.data(), data.size(), MSG_NOSIGNAL);
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::send, fd, generation));
+}
+
+void Uring::poll_signal(int signal_fd) {
+    auto *sqe = get_sqe();
+    io_uring_prep_poll_add(sqe, signal_fd, POLLIN);
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::signal, signal_fd, 0));
+}
+
+void Uring::poll(int fd, std::uint32_t generation, std::uint32_t events) {
+    auto *sqe = get_sqe();
+    io_uring_prep_poll_add(sqe, fd, events);
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::poll, fd, generation));
+}
+
+void Uring::cancel(int fd) {
+    auto *sqe = get_sqe();
+    io_uring_prep_cancel_fd(sqe, fd, IORING_ASYNC_CANCEL_ALL);
+    io_uring_sqe_set_data64(sqe, encode_user_data(op_t::cancel, fd, 0));
+
+    const int tmp = io_uring_submit(&ring);
+    if (tmp < 0) throw std::system_error(-tmp, std::generic_category(), "io_uring_submit failed");
+}
+
+int Uring::submit_and_wait(int timeout) {
+    completions.clear();
+
+    struct __kernel_timespec  ts {};
+    struct __kernel_timespec *ts_ptr = nullptr;
+    if (timeout >= 0) {
+        ts.tv_sec  = timeout / MS_PER_S;
+        ts.tv_nsec = (timeout % MS_PER_S) * NS_PER_MS;
+        ts_ptr     = &ts;
+    }
+
+    struct io_uring_cqe *cqe = nullptr;
+    const int            tmp = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, ts_ptr, nullptr);
+    if (tmp < 0) return tmp;
+
+    std::array<struct io_uring_cqe *, QUEUE_DEPTH> cqes {};
+    unsigned                                       count = 0;
+    while ((count = io_uring_peek_batch_cqe(&ring, cqes.data(), QUEUE_DEPTH)) != 0) {
+        for (unsigned i = 0; i < count; ++i)
+            completions.emplace_back(decode_completion(cqes[i]));  // NOLINT
+        io_uring_cq_advance(&ring, count);
+    }
+
+    return 0;
+}
+
+std::span<const std::uint8_t> Uring::get_buffer(const completion_t &completion) const noexcept {
+    const auto id = static_cast<std::size_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+    return {buffers.data() + id * BUFFER_SIZE, static_cast<std::size_t>(completion.res)};  // NOLINT
+}
+
+void Uring::recycle_buffer(const completion_t &completion) {
+    const auto id = static_cast<unsigned short>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+    io_uring_buf_ring_add(buf_ring,
+                          buffers.data() + static_cast<std::size_t>(id) * BUFFER_SIZE,  // NOLINT
+                          BUFFER_SIZE,
+                          id,
+                          io_uring_buf_ring_mask(BUFFER_COUNT),
+                          0);
+    io_uring_buf_ring_advance(buf_ring, 1);
+}
+
+}  // namespace Modbus::TCP
+
+#endif
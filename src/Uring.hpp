@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#ifdef IO_URING_ENABLED
+
+#    include <cstddef>
+#    include <cstdint>
+#    include <liburing.h>
+#    include <span>
+#    include <vector>
+
+namespace Modbus::TCP {
+
+/*! \brief io_uring instance with a ring of provided receive buffers
+ *
+ * Each submitted operation is tagged with its type, the file descriptor and a connection generation.
+ * The generation is used to detect completions that belong to an already closed connection whose file descriptor
+ * has been reused.
+ */
+class Uring final {
+public:
+    //! type of a submitted operation
+    enum class op_t : std::uint8_t { accept, recv, send, signal, cancel, poll };
+
+    //! completion of a submitted operation
+    struct completion_t {
+        op_t          op;          //!< type of the operation
+        int           fd;          //!< file descriptor
+        std::uint32_t generation;  //!< connection generation
+        int           res;         //!< result (see io_uring_cqe)
+        std::uint32_t flags;       //!< flags (see io_uring_cqe)
+    };
+
+private:
+    static constexpr unsigned       QUEUE_DEPTH  = 256;
+    static constexpr unsigned       BUFFER_COUNT = 256;  //!< number of provided receive buffers (power of 2)
+    static constexpr unsigned       BUFFER_SIZE  = 1024;
+    static constexpr unsigned short BUFFER_GROUP = 0;
+
+    struct io_uring           ring {};
+    struct io_uring_buf_ring *buf_ring = nullptr;
+    std::vector<std::uint8_t> buffers;
+
+    std::vector<completion_t> completions;
+
+public:
+    /*! \brief create io_uring instance
+     *
+     * @details requires multishot accept, multishot receive and provided buffer rings (linux >= 6.0)
+     *
+     * @exception std::system_error io_uring or one of the required features is not available
+     */
+    Uring();
+
+    ~Uring();
+
+    Uring(const Uring &other)            = delete;
+    Uring(Uring &&other)                 = delete;
+    Uring &operator=(const Uring &other) = delete;
+    Uring &operator=(Uring &&other)      = delete;
+
+    /*! \brief accept connections until the operation is canceled
+     *
+     * @param server_socket listening socket
+     */
+    void accept_multishot(int server_socket);
+
+    /*! \brief cancel the multishot accept operation
+     *
+     * @param server_socket listening socket
+     */
+    void cancel_accept(int server_socket);
+
+    /*! \brief receive data into the provided buffers until the operation is canceled or the connection is closed
+     *
+     * @param fd connected socket
+     * @param generation connection generation
+     */
+    void recv_multishot(int fd, std::uint32_t generation);
+
+    /*! \brief send data
+     *
+     * @param fd connected socket
+     * @param generation connection generation
+     * @param data data to send. Must remain valid until the operation is completed.
+     */
+    void send(int fd, std::uint32_t generation, std::span<const std::uint8_t> data);
+
+    /*! \brief wait until the signal fd is readable
+     *
+     * @param signal_fd signal file descriptor
+     */
+    void poll_signal(int signal_fd);
+
+    /*! \brief wait until a file descriptor is ready or an error occurred
+     *
+     * @details the result of the completion is the poll event mask (see man 2 poll)
+     *
+     * @param fd file descriptor
+     * @param generation registration generation
+     * @param events events to wait for (POLLIN, POLLOUT)
+     */
+    void poll(int fd, std::uint32_t generation, std::uint32_t events);
+
+    /*! \brief cancel all operations of a file descriptor
+     *
+     * @details the cancellation is submitted immediately. The file descriptor can be closed afterwards.
+     *
+     * @param fd file descriptor
+     */
+    void cancel(int fd);
+
+    /*! \brief submit all prepared operations and wait for completions
+     *
+     * @param timeout timeout in milliseconds (-1: infinite)
+     * @return 0 on success or a negative error number (-ETIME: timeout, -EINTR: interrupted)
+     */
+    int submit_and_wait(int timeout);
+
+    /*! \brief get the completions collected by the last call of submit_and_wait
+     *
+     * @return completions
+     */
+    [[nodiscard]] const std::vector<completion_t> &get_completions() const noexcept { return completions; }
+
+    /*! \brief get the provided buffer that holds the data of a receive completion
+     *
+     * @param completion completion of a receive operation with IORING_CQE_F_BUFFER set
+     * @return received data
+     */
+    [[nodiscard]] std::span<const std::uint8_t> get_buffer(const completion_t &completion) const noexcept;
+
+    /*! \brief return a provided buffer to the kernel
+     *
+     * @param completion completion of a receive operation with IORING_CQE_F_BUFFER set
+     */
+    void recycle_buffer(const completion_t &completion);
+
+private:
+    struct io_uring_sqe *get_sqe();
+};
+
+}  // namespace Modbus::TCP
+
+#endif
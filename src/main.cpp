@@ -3,7 +3,13 @@
  * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
  */
 
+#include "Address_Map.hpp"
+#include "Histogram.hpp"
+#include "Log.hpp"
+#include "Metrics_Server.hpp"
 #include "Modbus_TCP_Client_poll.hpp"
+#include "Notify_Socket.hpp"
+#include "Pcapng_Capture.hpp"
 #include "Print_Time.hpp"
 #include "generated/version_info.hpp"
 #include "license.hpp"
@@ -16,7 +22,10 @@
 #include <cxxshm_version_info.hpp>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <modbus/modbus-version.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <sys/signalfd.h>
@@ -128,13 +137,77 @@ int main(int argc, char **argv) {
             "ao-registers", "number of analog output registers", cxxopts::value<std::size_t>()->default_value("65536"));
     options.add_options("modbus")(
             "ai-registers", "number of analog input registers", cxxopts::value<std::size_t>()->default_value("65536"));
-    options.add_options("modbus")("m,monitor", "output all incoming and outgoing packets to stdout");
+    options.add_options("modbus")(
+            "do-windows",
+            "sparse address windows of the digital output registers (start:count, e.g. 1000:100,30000:200). "
+            "Requests outside of the windows are answered with the exception 0x02 (illegal data address). "
+            "The shared memory only contains the registers of the windows (in ascending order of the addresses). "
+            "Replaces --do-registers.",
+            cxxopts::value<std::vector<std::string>>());
+    options.add_options("modbus")("di-windows",
+                                  "like --do-windows, but for the digital input registers",
+                                  cxxopts::value<std::vector<std::string>>());
+    options.add_options("modbus")("ao-windows",
+                                  "like --do-windows, but for the analog output registers",
+                                  cxxopts::value<std::vector<std::string>>());
+    options.add_options("modbus")("ai-windows",
+                                  "like --do-windows, but for the analog input registers",
+                                  cxxopts::value<std::vector<std::string>>());
+    options.add_options("modbus")("m,monitor",
+                                  "log all incoming and outgoing packets (one line per ADU, slow, see --capture)");
+#ifdef MULTITHREADING_ENABLED
+    options.add_options("modbus")("capture",
+                                  "write all received requests and sent replies with timestamps and addresses to a "
+                                  "pcapng file (e.g. for Wireshark). The packets are copied to a ring buffer and "
+                                  "written by a background thread. Replies of libmodbus are not captured.",
+                                  cxxopts::value<std::string>());
+    options.add_options("modbus")("capture-size",
+                                  "maximum size of a capture file in MiB. Full files are renamed to <file>.1, "
+                                  "<file>.2, ...",
+                                  cxxopts::value<std::size_t>()->default_value("100"));
+    options.add_options("modbus")("capture-files",
+                                  "maximum number of capture files (including the current one)",
+                                  cxxopts::value<std::size_t>()->default_value("10"));
+    options.add_options("modbus")("capture-buffer",
+                                  "size of the capture ring buffer of each thread in KiB. Packets that do not fit into "
+                                  "it are dropped and counted.",
+                                  cxxopts::value<std::size_t>()->default_value("4096"));
+#endif
+    options.add_options("modbus")("libmodbus-reply",
+                                  "handle all requests with libmodbus instead of the built-in request handling. "
+                                  "Slower, but may be used as fallback.");
     options.add_options("network")("c,connections",
                                    "number of allowed simultaneous Modbus Server connections.",
                                    cxxopts::value<std::size_t>()->default_value("1"));
     options.add_options("network")("r,reconnect", "do not terminate if no Modbus Server is connected anymore.");
+#ifdef MULTITHREADING_ENABLED
+    options.add_options("network")(
+            "threads",
+            "number of worker threads. Each thread has its own listening socket (SO_REUSEPORT) and accepts up to "
+            "--connections connections. The kernel distributes new connections between the threads. "
+            "Values > 1 require --reconnect.",
+            cxxopts::value<std::size_t>()->default_value("1"));
+#endif
+#ifdef OS_LINUX
+    options.add_options("network")("epoll",
+                                   "use epoll instead of poll to wait for network events. "
+                                   "Recommended if many simultaneous connections are allowed.");
+#endif
+#ifdef IO_URING_ENABLED
+    options.add_options("network")("io-uring",
+                                   "use io_uring to accept connections and receive requests. "
+                                   "Falls back to poll if io_uring is not supported by the kernel "
+                                   "(requires linux 6.0).");
+#endif
+    options.add_options("network")(
+            "metrics",
+            "provide request, traffic, connection, latency and lock statistics in the Prometheus text format via HTTP. "
+            "Address of the metrics socket: port (127.0.0.1), host:port or unix socket (path or @name for an "
+            "abstract socket). The socket is handled by the event loop of the first thread.",
+            cxxopts::value<std::string>());
     options.add_options("modbus")("byte-timeout",
                                   "timeout interval in seconds between two consecutive bytes of the same message. "
+                                  "Connections that exceed it are closed. "
                                   "In most cases it is sufficient to set the response timeout. "
                                   "Fractional values are possible.",
                                   cxxopts::value<double>());
@@ -168,6 +241,61 @@ int main(int argc, char **argv) {
     options.add_options("shared memory")("separate-all",
                                          "like --separate, but for all client ids (creates 1028 shared memory files! "
                                          "check/set 'ulimit -n' before using this option.)");
+    options.add_options("shared memory")(
+            "separate-lazy",
+            "like --separate-all, but the shared memories of a client id are created on the first request with this "
+            "client id. The shared memories of the client ids specified with --separate are created at startup.");
+    options.add_options("shared memory")(
+            "deny-unknown-ids",
+            "answer requests with client ids that have no separate shared memory (see --separate) with the exception "
+            "0x0B (gateway target device failed to respond) instead of using the shared memory without client id.");
+    options.add_options("shared memory")(
+            "packed-bits",
+            "store 8 digital registers per byte in the DO and DI shared memories with the specified name prefix "
+            "(e.g. modbus_ or modbus_01_) instead of one register per byte. "
+            "You can specify multiple prefixes by separating them with ','. "
+            "Requests to these registers are always handled by the built-in request handling.",
+            cxxopts::value<std::vector<std::string>>());
+    options.add_options("shared memory")(
+            "seqlock",
+            "create the control shared memory <name-prefix>CTL with version counters for each 64 byte block of DO "
+            "and AO. The counters are incremented before and after every write. "
+            "Other processes can use them to read consistent values without the semaphore.");
+    options.add_options("shared memory")(
+            "dirty-bitmap",
+            "create the control shared memory <name-prefix>CTL with a bitmap that marks the DO and AO registers "
+            "written by a Modbus master. Other processes can fetch and clear it to process only changed registers.");
+    options.add_options("shared memory")(
+            "notify",
+            "create the control shared memory <name-prefix>CTL with a sequence number that is incremented after every "
+            "write request of a Modbus master. Other processes can wait for it (futex) instead of polling.");
+    options.add_options("shared memory")(
+            "notify-socket",
+            "unix socket (path or @name for an abstract socket) that provides eventfds that are signaled after every "
+            "write request (for processes that use poll/epoll). Implies --notify.",
+            cxxopts::value<std::string>());
+    options.add_options("shared memory")(
+            "table-locks",
+            "create the control shared memory <name-prefix>CTL with a process-shared reader/writer lock for each "
+            "register table. Requests only lock the tables they access, so other processes can read one table while "
+            "a Modbus master writes to another one.");
+    options.add_options("shared memory")(
+            "hugetlbfs",
+            "store the register tables in files in the specified hugetlbfs mount (e.g. /dev/hugepages) instead of "
+            "shared memory objects. The files have the same names as the shared memories. "
+            "Huge pages must be reserved (/proc/sys/vm/nr_hugepages).",
+            cxxopts::value<std::string>());
+    options.add_options("shared memory")("prefault",
+                                         "allocate all pages of the register tables on creation to avoid page faults "
+                                         "on the first access.");
+    options.add_options("shared memory")("mlock",
+                                         "lock the register tables in memory to prevent them from being swapped out. "
+                                         "Requires a sufficient 'ulimit -l' or the capability CAP_IPC_LOCK.");
+    options.add_options("shared memory")(
+            "arena",
+            "store the register tables of all client ids in one shared memory <name-prefix>ARENA instead of one shared "
+            "memory per table and client id. The arena starts with a header that describes the location of the "
+            "tables (see Shm_Arena_Layout.hpp). Cannot be used with --separate-lazy.");
     options.add_options("shared memory")("semaphore",
                                          "protect the shared memory with a named semaphore against simultaneous access",
                                          cxxopts::value<std::string>());
@@ -177,9 +305,38 @@ int main(int argc, char **argv) {
             "Do not use this option per default! "
             "It should only be used if the semaphore of an improperly terminated instance continues "
             "to exist as an orphan and is no longer used.");
+    options.add_options("shared memory")(
+            "lock",
+            "protect the shared memory with a robust, process-shared mutex with priority inheritance that is stored in "
+            "the shared memory with the specified name (alternative to --semaphore). "
+            "The mutex is recovered if a process terminates while holding it.",
+            cxxopts::value<std::string>());
+    options.add_options("shared memory")(
+            "lock-timeout",
+            "maximum time in seconds to wait for the semaphore or lock (and the table locks). Requests that cannot "
+            "acquire them are answered with the exception 0x06 (server device busy). Fractional values are possible.",
+            cxxopts::value<double>()->default_value("0.1"));
+    options.add_options("shared memory")(
+            "lock-batch",
+            "maximum number of requests that are handled with one acquisition of the semaphore or lock. "
+            "Requests of all connections that are received at the same time are handled together and the replies are "
+            "sent after the semaphore or lock is released.",
+            cxxopts::value<std::size_t>()->default_value("1"));
+    options.add_options("shared memory")(
+            "lock-batch-time",
+            "maximum time in seconds the semaphore or lock is held by a batch of requests (see --lock-batch). "
+            "Fractional values are possible.",
+            cxxopts::value<double>()->default_value("0.001"));
     options.add_options("shared memory")("b,permissions",
                                          "permission bits that are applied when creating a shared memory.",
                                          cxxopts::value<std::string>()->default_value("0640"));
+#ifdef MULTITHREADING_ENABLED
+    options.add_options("other")("log-buffer",
+                                 "maximum number of log messages that are queued for the background thread that "
+                                 "writes them to stderr. Messages that do not fit into the queue are dropped and "
+                                 "counted.",
+                                 cxxopts::value<std::size_t>()->default_value("4096"));
+#endif
     options.add_options("other")("h,help", "print usage");
     options.add_options("version information")("version", "print version and exit");
     options.add_options("version information")("longversion",
@@ -316,12 +473,61 @@ int main(int argc, char **argv) {
         return exit_usage();
     }
 
+    // number of registers and sparse address windows (indexed by Modbus::shm::control::table_index_t)
+    std::array<std::size_t, 4> registers {args["do-registers"].as<std::size_t>(),
+                                          args["di-registers"].as<std::size_t>(),
+                                          args["ao-registers"].as<std::size_t>(),
+                                          args["ai-registers"].as<std::size_t>()};
+
+    std::array<std::unique_ptr<Modbus::Address_Map>, 4> address_maps;
+    std::array<const Modbus::Address_Map *, 4>          address_windows {};
+    {
+        static constexpr std::array<const char *, 4> WINDOW_OPTIONS {
+                "do-windows", "di-windows", "ao-windows", "ai-windows"};
+        for (std::size_t i = 0; i < WINDOW_OPTIONS.size(); ++i) {
+            const auto *option = WINDOW_OPTIONS[i];  // NOLINT
+            if (!args.count(option)) continue;
+
+            try {
+                address_maps[i] = std::make_unique<Modbus::Address_Map>(  // NOLINT
+                        Modbus::Address_Map::parse(args[option].as<std::vector<std::string>>()));
+            } catch (const std::invalid_argument &e) {
+                std::cerr << Print_Time::iso << " ERROR: --" << option << ": " << e.what() << '\n';
+                return exit_usage();
+            }
+            address_windows[i] = address_maps[i].get();        // NOLINT
+            registers[i]       = address_maps[i]->get_size();  // NOLINT
+        }
+    }
+
     const auto CONNECTIONS = args["connections"].as<std::size_t>();
     if (CONNECTIONS == 0) {
         std::cerr << Print_Time::iso << " ERROR: The number of connections must not be 0" << '\n';
         return exit_usage();
     }
 
+    const auto RECONNECT = args.count("reconnect") != 0;
+
+#ifdef MULTITHREADING_ENABLED
+    const auto THREADS = args["threads"].as<std::size_t>();
+    if (THREADS == 0) {
+        std::cerr << Print_Time::iso << " ERROR: The number of threads must not be 0" << '\n';
+        return exit_usage();
+    }
+
+    if (THREADS > 1 && !RECONNECT) {
+        std::cerr << Print_Time::iso << " ERROR: The option --threads requires --reconnect" << '\n';
+        return exit_usage();
+    }
+#else
+    static constexpr std::size_t THREADS = 1;
+#endif
+
+    if (args.count("semaphore") && args.count("lock")) {
+        std::cerr << Print_Time::iso << " ERROR: The options --semaphore and --lock cannot be used together." << '\n';
+        return EX_USAGE;
+    }
+
     const auto SEPARATE     = args.count("separate");
     const auto SEPARATE_ALL = args.count("separate-all");
     if (SEPARATE && SEPARATE_ALL) {
@@ -330,6 +536,32 @@ int main(int argc, char **argv) {
         return EX_USAGE;
     }
 
+    const auto SEPARATE_LAZY = args.count("separate-lazy");
+    const auto DENY_UNKNOWN  = args.count("deny-unknown-ids");
+    if (SEPARATE_LAZY && SEPARATE_ALL) {
+        std::cerr << Print_Time::iso
+                  << " ERROR: The options --separate-lazy and --separate-all cannot be used together." << '\n';
+        return EX_USAGE;
+    }
+    const auto ARENA = args.count("arena");
+    if (ARENA && SEPARATE_LAZY) {
+        std::cerr << Print_Time::iso << " ERROR: The options --arena and --separate-lazy cannot be used together."
+                  << '\n';
+        return EX_USAGE;
+    }
+    if (DENY_UNKNOWN && (!SEPARATE || SEPARATE_LAZY)) {
+        std::cerr << Print_Time::iso << " ERROR: The option --deny-unknown-ids requires --separate "
+                  << "and cannot be used with --separate-lazy." << '\n';
+        return EX_USAGE;
+    }
+
+#ifdef IO_URING_ENABLED
+    if (args.count("epoll") && args.count("io-uring")) {
+        std::cerr << Print_Time::iso << " ERROR: The options --epoll and --io-uring cannot be used together." << '\n';
+        return EX_USAGE;
+    }
+#endif
+
     const auto FORCE_SHM = args.count("force") > 0;
 
     mode_t shm_permissions = DEFAULT_SHM_PERMISSIONS;
@@ -349,15 +581,31 @@ int main(int argc, char **argv) {
         }
     }
 
+    // features of the control shared memory
+    std::uint32_t control_features = 0;
+    if (args.count("seqlock")) control_features |= Modbus::shm::control::FEATURE_SEQLOCK;
+    if (args.count("dirty-bitmap")) control_features |= Modbus::shm::control::FEATURE_DIRTY;
+    if (args.count("notify") || args.count("notify-socket")) control_features |= Modbus::shm::control::FEATURE_NOTIFY;
+    if (args.count("table-locks")) control_features |= Modbus::shm::control::FEATURE_TABLE_LOCKS;
+
     // check ulimit
 
-    static constexpr std::size_t NUM_INTERNAL_FILES = 5;       // stderr + stdout + stdin + signal_fd + server socket
-    std::size_t min_files = CONNECTIONS + NUM_INTERNAL_FILES;  // number of connections + NUM_INTERNAL_FILES
-    if (SEPARATE) min_files += SEPARATE * 4;
+    static constexpr std::size_t NUM_INTERNAL_FILES = 5;  // stderr + stdout + stdin + signal_fd + server socket
+    std::size_t min_files = THREADS * (CONNECTIONS + 1) + NUM_INTERNAL_FILES - 1;  // connections + server sockets
+
+    // DO + DI + AO + AI (+ CTL), --arena: CTL (+ ARENA once)
+    const std::size_t files_per_mapping = (control_features ? 1 : 0) + (ARENA ? 0 : 4);
+    if (ARENA) ++min_files;
+    if (SEPARATE) min_files += SEPARATE * files_per_mapping;
     else if (SEPARATE_ALL)
-        min_files += Modbus::TCP::Client_Poll::MAX_CLIENT_IDS * 4;
+        min_files += Modbus::TCP::Client_Poll::MAX_CLIENT_IDS * files_per_mapping;
     else
-        min_files += 4;
+        min_files += files_per_mapping;
+    // shared memories of --separate-lazy are created on demand and are not included
+    if (args.count("notify-socket")) ++min_files;  // consumers of the notify socket are not included
+    if (args.count("metrics")) ++min_files;        // scrapers are not included
+    if (args.count("capture")) ++min_files;
+    if (args.count("lock")) ++min_files;
     struct rlimit limit;  // NOLINT
     if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
         perror("getrlimit");
@@ -370,90 +618,170 @@ int main(int argc, char **argv) {
                   << std::endl;  // NOLINT
     }
 
+    // shared memories with packed digital registers
+    std::unordered_set<std::string> packed_prefixes;
+    if (args.count("packed-bits")) {
+        const auto prefix_list = args["packed-bits"].as<std::vector<std::string>>();
+        packed_prefixes.insert(prefix_list.begin(), prefix_list.end());
+    }
+    std::unordered_set<std::string> unused_packed_prefixes = packed_prefixes;
+
+    auto is_packed = [&](const std::string &prefix) {
+        unused_packed_prefixes.erase(prefix);
+        return packed_prefixes.contains(prefix);
+    };
+
+    // memory options of the register tables
+    Modbus::shm::Memory_Options memory_options;
+    if (args.count("hugetlbfs")) memory_options.hugetlbfs = args["hugetlbfs"].as<std::string>();
+    memory_options.prefault = args.count("prefault");
+    memory_options.lock     = args.count("mlock");
+
+    // name prefix of the shared memories of a client id
+    auto separate_prefix = [&args](std::size_t client_id) {
+        std::ostringstream sstr;
+        sstr << args["name-prefix"].as<std::string>() << std::setfill('0') << std::hex << std::setw(2) << client_id
+             << '_';
+        return sstr.str();
+    };
+
+    std::unordered_set<uint8_t> separate_ids;
+    if (SEPARATE) {
+        auto id_list = args["separate"].as<std::vector<uint8_t>>();
+        separate_ids.insert(id_list.begin(), id_list.end());
+    }
+
+    const bool FALLBACK = !SEPARATE_ALL && !SEPARATE_LAZY && !DENY_UNKNOWN;
+
+    // --arena: one shared memory for all register tables
+    std::unique_ptr<Modbus::shm::Shm_Arena> arena;
+    if (ARENA) {
+        std::vector<Modbus::shm::Shm_Arena::table_set_t> table_sets;
+        if (FALLBACK) {
+            table_sets.push_back(
+                    {Modbus::shm::arena::ANY_CLIENT_ID, registers, is_packed(args["name-prefix"].as<std::string>())});
+        }
+        if (SEPARATE_ALL) {
+            for (std::uint16_t i = 0; i < Modbus::TCP::Client_Poll::MAX_CLIENT_IDS; ++i)
+                table_sets.push_back({i, registers, is_packed(separate_prefix(i))});
+        }
+        for (auto a : separate_ids)
+            table_sets.push_back({a, registers, is_packed(separate_prefix(a))});
+
+        try {
+            arena = std::make_unique<Modbus::shm::Shm_Arena>(args["name-prefix"].as<std::string>() + "ARENA",
+                                                             table_sets,
+                                                             FORCE_SHM,
+                                                             shm_permissions,
+                                                             memory_options);
+        } catch (const std::system_error &e) {
+            std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+            return EX_OSERR;
+        }
+    }
+
+    // create the register tables of a client id (at startup)
+    auto create_mapping = [&](std::uint16_t client_id, const std::string &prefix) {
+        std::unique_ptr<Modbus::shm::Shm_Mapping> mapping;
+        if (arena) {
+            mapping = std::make_unique<Modbus::shm::Shm_Mapping>(
+                    *arena, client_id, prefix, FORCE_SHM, shm_permissions, control_features);
+        } else {
+            mapping = std::make_unique<Modbus::shm::Shm_Mapping>(registers[Modbus::shm::control::DO],
+                                                                 registers[Modbus::shm::control::DI],
+                                                                 registers[Modbus::shm::control::AO],
+                                                                 registers[Modbus::shm::control::AI],
+                                                                 prefix,
+                                                                 FORCE_SHM,
+                                                                 shm_permissions,
+                                                                 is_packed(prefix),
+                                                                 control_features,
+                                                                 memory_options);
+        }
+        mapping->set_address_windows(address_windows);
+        return mapping;
+    };
+
     // create shared memory object for modbus registers
     std::unique_ptr<Modbus::shm::Shm_Mapping> fallback_mapping;
-    if (args.count("separate-all") == 0) {
+    if (FALLBACK) {
         try {
-            fallback_mapping = std::make_unique<Modbus::shm::Shm_Mapping>(args["do-registers"].as<std::size_t>(),
-                                                                          args["di-registers"].as<std::size_t>(),
-                                                                          args["ao-registers"].as<std::size_t>(),
-                                                                          args["ai-registers"].as<std::size_t>(),
-                                                                          args["name-prefix"].as<std::string>(),
-                                                                          FORCE_SHM,
-                                                                          shm_permissions);
+            fallback_mapping = create_mapping(Modbus::shm::arena::ANY_CLIENT_ID, args["name-prefix"].as<std::string>());
         } catch (const std::system_error &e) {
             std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
             return EX_OSERR;
         }
     }
 
-    std::array<modbus_mapping_t *, Modbus::TCP::Client_Poll::MAX_CLIENT_IDS> mb_mappings {};
-    std::vector<std::unique_ptr<Modbus::shm::Shm_Mapping>>                   separate_mappings;
+    std::array<Modbus::Register_Tables, Modbus::TCP::Client_Poll::MAX_CLIENT_IDS> mb_tables {};
+    std::vector<std::unique_ptr<Modbus::shm::Shm_Mapping>>                        separate_mappings;
+
+    // --separate-lazy: register tables that were created on demand
+    std::mutex                                                                            lazy_mutex;
+    std::array<const Modbus::Register_Tables *, Modbus::TCP::Client_Poll::MAX_CLIENT_IDS> lazy_tables {};
 
     if (SEPARATE_ALL) {
         for (std::size_t i = 0; i < Modbus::TCP::Client_Poll::MAX_CLIENT_IDS; ++i) {
-            std::ostringstream sstr;
-            sstr << args["name-prefix"].as<std::string>() << std::setfill('0') << std::hex << std::setw(2) << i << '_';
+            const auto prefix = separate_prefix(i);
 
             try {
-                separate_mappings.emplace_back(
-                        std::make_unique<Modbus::shm::Shm_Mapping>(args["do-registers"].as<std::size_t>(),
-                                                                   args["di-registers"].as<std::size_t>(),
-                                                                   args["ao-registers"].as<std::size_t>(),
-                                                                   args["ai-registers"].as<std::size_t>(),
-                                                                   sstr.str(),
-                                                                   FORCE_SHM,
-                                                                   shm_permissions));
-                mb_mappings[i] = separate_mappings.back()->get_mapping();  // NOLINT
+                separate_mappings.emplace_back(create_mapping(static_cast<std::uint16_t>(i), prefix));
+                mb_tables[i] = separate_mappings.back()->get_tables();  // NOLINT
             } catch (const std::system_error &e) {
                 std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
                 return EX_OSERR;
             }
         }
-    } else {
-        mb_mappings.fill(fallback_mapping->get_mapping());
+    } else if (fallback_mapping) {
+        mb_tables.fill(fallback_mapping->get_tables());
     }
 
-    if (SEPARATE) {
-        auto                        id_list = args["separate"].as<std::vector<uint8_t>>();
-        std::unordered_set<uint8_t> id_set(id_list.begin(), id_list.end());
+    for (auto a : separate_ids) {
+        const auto prefix = separate_prefix(a);
 
-        for (auto a : id_set) {
-            std::ostringstream sstr;
-            sstr << args["name-prefix"].as<std::string>() << std::setfill('0') << std::hex << std::setw(2)
-                 << static_cast<unsigned>(a) << '_';
+        try {
+            separate_mappings.emplace_back(create_mapping(a, prefix));
+            mb_tables[a] = separate_mappings.back()->get_tables();  // NOLINT
+        } catch (const std::system_error &e) {
+            std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+            return EX_OSERR;
+        }
+    }
 
-            try {
-                separate_mappings.emplace_back(
-                        std::make_unique<Modbus::shm::Shm_Mapping>(args["do-registers"].as<std::size_t>(),
-                                                                   args["di-registers"].as<std::size_t>(),
-                                                                   args["ao-registers"].as<std::size_t>(),
-                                                                   args["ai-registers"].as<std::size_t>(),
-                                                                   sstr.str(),
-                                                                   FORCE_SHM,
-                                                                   shm_permissions));
-                mb_mappings[a] = separate_mappings.back()->get_mapping();  // NOLINT
-            } catch (const std::system_error &e) {
-                std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
-                return EX_OSERR;
-            }
+    // the prefixes of --separate-lazy may be used later
+    if (!unused_packed_prefixes.empty() && !SEPARATE_LAZY) {
+        for (const auto &prefix : unused_packed_prefixes) {
+            std::cerr << Print_Time::iso << " ERROR: --packed-bits: no shared memory with the name prefix \"" << prefix
+                      << "\" is used." << '\n';
         }
+        return EX_USAGE;
     }
 
 
-    // create modbus client
-    std::unique_ptr<Modbus::TCP::Client_Poll> client;
+    // create modbus client(s) (one per thread)
+    std::vector<std::unique_ptr<Modbus::TCP::Client_Poll>> clients;
     try {
-        client = std::make_unique<Modbus::TCP::Client_Poll>(args["host"].as<std::string>(),
-                                                            args["service"].as<std::string>(),
-                                                            mb_mappings,
+        for (std::size_t i = 0; i < THREADS; ++i) {
+            auto client = std::make_unique<Modbus::TCP::Client_Poll>(args["host"].as<std::string>(),
+                                                                     args["service"].as<std::string>(),
+                                                                     mb_tables,
 #ifdef OS_LINUX
-                                                            args["tcp-timeout"].as<std::size_t>(),
+                                                                     args["tcp-timeout"].as<std::size_t>(),
 #else
-                                                            0,
+                                                                     0,
+#endif
+                                                                     CONNECTIONS,
+                                                                     THREADS > 1);
+            client->set_debug(args.count("monitor"));
+            client->set_libmodbus_reply(args.count("libmodbus-reply"));
+#ifdef OS_LINUX
+            if (args.count("epoll")) client->set_backend(Modbus::TCP::Client_Poll::backend_t::epoll);
 #endif
-                                                            CONNECTIONS);
-        client->set_debug(args.count("monitor"));
+#ifdef IO_URING_ENABLED
+            if (args.count("io-uring")) client->set_backend(Modbus::TCP::Client_Poll::backend_t::io_uring);
+#endif
+            clients.emplace_back(std::move(client));
+        }
     } catch (const std::runtime_error &e) {
         std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
         return EX_SOFTWARE;
@@ -461,9 +789,11 @@ int main(int argc, char **argv) {
 
     // set timeouts if required
     try {
-        if (args.count("response-timeout")) { client->set_response_timeout(args["response-timeout"].as<double>()); }
+        for (auto &client : clients) {
+            if (args.count("response-timeout")) { client->set_response_timeout(args["response-timeout"].as<double>()); }
 
-        if (args.count("byte-timeout")) { client->set_byte_timeout(args["byte-timeout"].as<double>()); }
+            if (args.count("byte-timeout")) { client->set_byte_timeout(args["byte-timeout"].as<double>()); }
+        }
     } catch (const std::runtime_error &e) {
         std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
         return EX_SOFTWARE;
@@ -471,39 +801,262 @@ int main(int argc, char **argv) {
 
     // add semaphore if required
     try {
-        if (args.count("semaphore")) {
-            client->enable_semaphore(args["semaphore"].as<std::string>(), args.count("semaphore-force"));
+        if (args.count("semaphore") || args.count("lock")) {
+            if (args.count("semaphore"))
+                clients.front()->enable_semaphore(args["semaphore"].as<std::string>(), args.count("semaphore-force"));
+            else
+                clients.front()->enable_lock(args["lock"].as<std::string>(), FORCE_SHM, shm_permissions);
+
+            for (std::size_t i = 1; i < clients.size(); ++i)
+                clients[i]->share_semaphore(*clients.front());
+        }
+
+        for (auto &client : clients) {
+            client->set_lock_timeout(args["lock-timeout"].as<double>());
+            client->set_lock_batch(args["lock-batch"].as<std::size_t>(), args["lock-batch-time"].as<double>());
         }
-    } catch (const std::system_error &e) {
+    } catch (const std::exception &e) {
         std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
         return EX_SOFTWARE;
     }
 
-    auto RECONNECT = args.count("reconnect") != 0;
+    // notify socket (handled by the event loop of the first client)
+    std::unique_ptr<Modbus::shm::Notify_Socket> notify_socket;
+    if (args.count("notify-socket")) {
+        try {
+            notify_socket = std::make_unique<Modbus::shm::Notify_Socket>(
+                    args["notify-socket"].as<std::string>(), FORCE_SHM, shm_permissions);
+            if (fallback_mapping) {
+                notify_socket->add_control(fallback_mapping->get_name_prefix(),
+                                           *fallback_mapping->get_tables().control);
+            }
+            for (const auto &mapping : separate_mappings)
+                notify_socket->add_control(mapping->get_name_prefix(), *mapping->get_tables().control);
+            notify_socket->attach(*clients.front());
+        } catch (const std::exception &e) {
+            std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+            return EX_OSERR;
+        }
+        std::cerr << Print_Time::iso << " INFO: Notify socket available on " << notify_socket->get_path() << '.'
+                  << std::endl;  // NOLINT
+    }
 
-    std::cerr << Print_Time::iso << " INFO: Listening on " << client->get_listen_addr() << " for connections."
-              << std::endl;  // NOLINT
+    // metrics socket (handled by the event loop of the first client)
+    std::unique_ptr<Modbus::Metrics_Server> metrics_server;
+    if (args.count("metrics")) {
+        try {
+            metrics_server = std::make_unique<Modbus::Metrics_Server>(
+                    args["metrics"].as<std::string>(), FORCE_SHM, shm_permissions);
+            for (const auto &client : clients)
+                metrics_server->add_source(*client);
+            metrics_server->attach(*clients.front());
+        } catch (const std::exception &e) {
+            std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+            return EX_OSERR;
+        }
+        std::cerr << Print_Time::iso << " INFO: Metrics available on " << metrics_server->get_address() << '.'
+                  << std::endl;  // NOLINT
+    }
 
-    try {
-        [&]() {
+#ifdef MULTITHREADING_ENABLED
+    // traffic capture (one ring buffer per client, written by a background thread)
+    std::unique_ptr<Modbus::Pcapng_Capture> capture;
+    if (args.count("capture")) {
+        static constexpr std::size_t KIB = 1024;
+        try {
+            capture = std::make_unique<Modbus::Pcapng_Capture>(args["capture"].as<std::string>(),
+                                                               args["capture-buffer"].as<std::size_t>() * KIB,
+                                                               args["capture-size"].as<std::size_t>() * KIB * KIB,
+                                                               args["capture-files"].as<std::size_t>());
+            for (auto &client : clients)
+                client->set_capture(&capture->add_ring());
+            capture->start();
+        } catch (const std::exception &e) {
+            std::cerr << Print_Time::iso << " ERROR: " << e.what() << '\n';
+            return EX_OSERR;
+        }
+        std::cerr << Print_Time::iso << " INFO: Capturing Modbus/TCP traffic to " << capture->get_path() << '.'
+                  << std::endl;  // NOLINT
+    }
+#endif
+
+    // create the shared memories of unknown client ids on the first request (or deny them)
+    if (SEPARATE_LAZY || DENY_UNKNOWN) {
+        auto factory = [&](std::uint8_t client_id) -> const Modbus::Register_Tables * {
+            if (!SEPARATE_LAZY) return nullptr;
+
+            // called by all threads
+            std::lock_guard<std::mutex> guard(lazy_mutex);
+            auto                       &tables = lazy_tables[client_id];  // NOLINT
+            if (tables) return tables;
+
+            const auto prefix = separate_prefix(client_id);
+
+            auto mapping = std::make_unique<Modbus::shm::Shm_Mapping>(registers[Modbus::shm::control::DO],
+                                                                      registers[Modbus::shm::control::DI],
+                                                                      registers[Modbus::shm::control::AO],
+                                                                      registers[Modbus::shm::control::AI],
+                                                                      prefix,
+                                                                      FORCE_SHM,
+                                                                      shm_permissions,
+                                                                      packed_prefixes.contains(prefix),
+                                                                      control_features,
+                                                                      memory_options);
+            mapping->set_address_windows(address_windows);
+            if (notify_socket) notify_socket->add_control(prefix, *mapping->get_tables().control);
+            tables = &mapping->get_tables();
+            separate_mappings.emplace_back(std::move(mapping));
+
+            Modbus::Log::info() << "Created shared memories " << prefix << "* for client id "
+                                << static_cast<unsigned>(client_id) << '.';
+            return tables;
+        };
+
+        for (auto &client : clients)
+            client->set_mapping_factory(factory);
+    }
+
+    std::cerr << Print_Time::iso << " INFO: Listening on " << clients.front()->get_listen_addr() << " for connections";
+    if (THREADS > 1) std::cerr << " (" << THREADS << " threads)";
+    std::cerr << '.' << std::endl;  // NOLINT
+
+#ifdef MULTITHREADING_ENABLED
+    // messages of the event loops are written by a background thread from here on
+    Modbus::Log::start(args["log-buffer"].as<std::size_t>());
+#endif
+
+    auto run_client = [RECONNECT](Modbus::TCP::Client_Poll &client, int term_fd) {
+        try {
             while (true) {
-                auto ret = client->run(signal_fd, RECONNECT, -1);
+                auto ret = client.run(term_fd, RECONNECT, -1);
 
                 switch (ret) {
                     case Modbus::TCP::Client_Poll::run_t::ok: continue;
-                    case Modbus::TCP::Client_Poll::run_t::semaphore:
                     case Modbus::TCP::Client_Poll::run_t::term_signal: return;
                     case Modbus::TCP::Client_Poll::run_t::term_nocon:
-                        std::cerr << Print_Time::iso << " INFO: No more active connections." << std::endl;  // NOLINT
+                        Modbus::Log::info() << "No more active connections.";
                         return;
                     case Modbus::TCP::Client_Poll::run_t::timeout:
                     case Modbus::TCP::Client_Poll::run_t::interrupted: continue;
                 }
             }
-        }();
-    } catch (const std::exception &e) {
-        if (!terminate) std::cerr << Print_Time::iso << " ERROR: " << e.what() << std::endl;  // NOLINT
+        } catch (const std::exception &e) {
+            if (!terminate) Modbus::Log::error() << e.what();
+        }
+    };
+
+    if (THREADS == 1) {
+        run_client(*clients.front(), signal_fd);
+    }
+#ifdef MULTITHREADING_ENABLED
+    else {
+        // readable as soon as one worker terminated or a termination signal was received
+        const int stop_fd = eventfd(0, EFD_CLOEXEC);
+        if (stop_fd == -1) {
+            perror("eventfd");
+            return EX_OSERR;
+        }
+
+        auto request_stop = [stop_fd]() {
+            const std::uint64_t value = 1;
+            if (write(stop_fd, &value, sizeof(value)) == -1) perror("write (eventfd)");
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(clients.size());
+        for (auto &client : clients) {
+            workers.emplace_back([&run_client, &request_stop, &client, stop_fd]() {
+                run_client(*client, stop_fd);
+                request_stop();
+            });
+        }
+
+        std::array<struct pollfd, 2> fds {};
+        fds[0].fd     = signal_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = stop_fd;
+        fds[1].events = POLLIN;
+        while (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        request_stop();
+        for (auto &worker : workers)
+            worker.join();
+        close(stop_fd);
     }
+#endif
+
+#ifdef MULTITHREADING_ENABLED
+    // write the remaining packets and log messages (including the number of dropped ones) before the statistics
+    if (capture) capture->stop_writer();
+    Modbus::Log::stop();
+#endif
 
     std::cerr << Print_Time::iso << " INFO: Terminating...\n";
+
+    auto print_histogram = [](const char *name, const Modbus::Histogram &histogram) {
+        static constexpr double NS_PER_US = 1000.0;
+        std::cerr << name << " p50 " << static_cast<double>(histogram.percentile(0.5)) / NS_PER_US << "us, p99 "
+                  << static_cast<double>(histogram.percentile(0.99)) / NS_PER_US << "us, max "
+                  << static_cast<double>(histogram.max()) / NS_PER_US << "us";
+    };
+
+    // lock contention statistics (combined for all threads)
+    if (args.count("semaphore") || args.count("lock") || args.count("table-locks")) {
+        Modbus::Histogram wait;
+        Modbus::Histogram hold;
+        std::uint64_t     timeouts       = 0;
+        std::uint64_t     table_timeouts = 0;
+        std::uint64_t     busy           = 0;
+        for (const auto &client : clients) {
+            const auto &stats = client->get_lock_stats();
+            wait.merge(stats.wait);
+            hold.merge(stats.hold);
+            timeouts += stats.timeouts;
+            table_timeouts += stats.table_timeouts;
+            busy += stats.busy;
+        }
+
+        std::cerr << Print_Time::iso << " INFO: lock statistics: " << wait.count() << " acquisitions,";
+        print_histogram(" wait", wait);
+        print_histogram(", hold", hold);
+        std::cerr << ", " << timeouts << " semaphore/lock timeouts, " << table_timeouts << " table lock timeouts, "
+                  << busy << " requests answered with exception 0x06" << std::endl;  // NOLINT
+    }
+
+    // request latency per function code (combined for all threads)
+    using latency_t = Modbus::TCP::Client_Poll::latency_stats_t;
+    for (std::size_t function = 0; function <= latency_t::OTHER_FUNCTIONS; ++function) {
+        std::array<Modbus::Histogram, latency_t::PHASE_COUNT> phases;
+        for (std::size_t phase = 0; phase < latency_t::PHASE_COUNT; ++phase)
+            for (const auto &client : clients)
+                phases[phase].merge(client->get_latency_stats().functions[function][phase]);  // NOLINT
+        if (phases[latency_t::TOTAL].count() == 0) continue;
+
+        std::cerr << Print_Time::iso << " INFO: latency of function code ";
+        if (function < latency_t::OTHER_FUNCTIONS)
+            std::cerr << static_cast<unsigned>(latency_t::FUNCTION_CODES[function]);  // NOLINT
+        else
+            std::cerr << "(other)";
+        std::cerr << ": " << phases[latency_t::TOTAL].count() << " requests,";
+        print_histogram(" total", phases[latency_t::TOTAL]);
+        print_histogram(", queue", phases[latency_t::QUEUE]);
+        print_histogram(", execute", phases[latency_t::EXECUTE]);
+        print_histogram(", send", phases[latency_t::SEND]);
+        std::cerr << std::endl;  // NOLINT
+    }
+
+#ifdef MULTITHREADING_ENABLED
+    // the writer was stopped before the statistics: all packets are written
+    if (capture) {
+        std::uint64_t dropped = 0;
+        for (const auto &client : clients)
+            dropped += client->get_traffic_stats().capture_dropped;
+        std::cerr << Print_Time::iso << " INFO: capture: " << capture->get_written() << " packets written, "
+                  << dropped << " packets dropped (ring buffer full)" << std::endl;  // NOLINT
+    }
+#endif
 }
@@ -5,19 +5,95 @@
 
 #include "modbus_shm.hpp"
 
+#include <atomic>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
 
 namespace Modbus::shm {
 
 static constexpr std::size_t MAX_MODBUS_REGISTERS = 0x10000;
 
-Shm_Mapping::Shm_Mapping(std::size_t        nb_bits,             // NOLINT
-                         std::size_t        nb_input_bits,       // NOLINT
-                         std::size_t        nb_registers,        // NOLINT
-                         std::size_t        nb_input_registers,  // NOLINT
-                         const std::string &prefix,
-                         bool               force,
-                         mode_t             permissions) {
+static constexpr std::size_t BYTE_BITS = 8;
+
+//* name suffixes of the register tables (order of Shm_Mapping::reg_index_t)
+static constexpr std::array<const char *, 4> SUFFIXES {"DO", "DI", "AO", "AI"};
+
+/**
+ * @brief allocate all pages of a shared memory object
+ *
+ * @details avoids page faults on the first access of the server or other processes
+ *
+ * @param addr mapped address (page aligned)
+ * @param size size in bytes
+ */
+static void prefault(void *addr, std::size_t size) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(addr, size, MADV_POPULATE_WRITE) == 0) return;
+#endif
+
+    // fallback (kernel < 5.14): touch every page without modifying its content
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto      *data      = static_cast<volatile std::uint8_t *>(addr);
+    for (std::size_t i = 0; i < size; i += page_size)
+        data[i] = data[i];  // NOLINT
+}
+
+/**
+ * @brief create the memory of register tables (POSIX shared memory object or hugetlbfs file)
+ *
+ * @param name name of the shared memory object
+ * @param size size in bytes
+ * @param force do not fail if the shared memory exist, but use the existing shared memory
+ * @param permissions shared memory file permissions
+ * @param memory memory options
+ * @param shm created shared memory object (if Memory_Options::hugetlbfs is empty)
+ * @param huge created hugetlbfs file (if Memory_Options::hugetlbfs is set)
+ * @return mapped address
+ */
+static void *create_memory(const std::string                     &name,
+                           std::size_t                            size,
+                           bool                                   force,
+                           mode_t                                 permissions,
+                           const Memory_Options                  &memory,
+                           std::unique_ptr<cxxshm::SharedMemory> &shm,
+                           std::unique_ptr<Hugetlb_File>         &huge) {
+    void *addr = nullptr;
+    if (memory.hugetlbfs.empty()) {
+        shm  = std::make_unique<cxxshm::SharedMemory>(name, size, false, !force, permissions);
+        addr = shm->get_addr();
+        if (memory.prefault) prefault(addr, size);
+    } else {
+        huge = std::make_unique<Hugetlb_File>(memory.hugetlbfs, name, size, !force, permissions, memory.prefault);
+        addr = huge->get_addr();
+    }
+
+    if (memory.lock && mlock(addr, size) == -1) {
+        throw std::system_error(errno,
+                                std::generic_category(),
+                                "Failed to lock " + name + " in memory (check 'ulimit -l' or CAP_IPC_LOCK)");
+    }
+
+    return addr;
+}
+
+Shm_Mapping::Shm_Mapping(std::size_t           nb_bits,             // NOLINT
+                         std::size_t           nb_input_bits,       // NOLINT
+                         std::size_t           nb_registers,        // NOLINT
+                         std::size_t           nb_input_registers,  // NOLINT
+                         const std::string    &prefix,
+                         bool                  force,
+                         mode_t                permissions,
+                         bool                  packed_bits,
+                         std::uint32_t         control_features,
+                         const Memory_Options &memory)
+    : name_prefix(prefix) {
+    // before the register tables are opened
+    if (force && control_features) Shm_Control::check_unused(prefix + "CTL");
+
     // check argument ranges
     if (nb_bits > MAX_MODBUS_REGISTERS || !nb_bits)
         throw std::invalid_argument("invalid number of digital output registers.");
@@ -34,18 +110,141 @@ Shm_Mapping::Shm_Mapping(std::size_t        nb_bits,             // NOLINT
     mapping.nb_registers       = static_cast<int>(nb_registers);
     mapping.nb_input_registers = static_cast<int>(nb_input_registers);
 
+    // packed layout: 8 digital registers per byte
+    const std::size_t do_size = packed_bits ? (nb_bits + BYTE_BITS - 1) / BYTE_BITS : nb_bits;
+    const std::size_t di_size = packed_bits ? (nb_input_bits + BYTE_BITS - 1) / BYTE_BITS : nb_input_bits;
+
     // create shm objects
-    shm_data[DO] = std::make_unique<cxxshm::SharedMemory>(prefix + "DO", nb_bits, false, !force, permissions);
-    shm_data[DI] = std::make_unique<cxxshm::SharedMemory>(prefix + "DI", nb_input_bits, false, !force, permissions);
-    shm_data[AO] = std::make_unique<cxxshm::SharedMemory>(prefix + "AO", 2 * nb_registers, false, !force, permissions);
-    shm_data[AI] =
-            std::make_unique<cxxshm::SharedMemory>(prefix + "AI", 2 * nb_input_registers, false, !force, permissions);
+    const std::array<std::size_t, REG_COUNT> sizes {do_size, di_size, 2 * nb_registers, 2 * nb_input_registers};
+    std::array<void *, REG_COUNT>            addr {};
+    for (std::size_t i = 0; i < REG_COUNT; ++i) {
+        addr[i] = create_memory(prefix + SUFFIXES[i],  // NOLINT
+                                sizes[i],
+                                force,
+                                permissions,
+                                memory,
+                                shm_data[i],
+                                huge_data[i]);
+    }
 
     // set shm objects as modbus register storage
-    mapping.tab_bits            = static_cast<uint8_t *>(shm_data[DO]->get_addr());
-    mapping.tab_input_bits      = static_cast<uint8_t *>(shm_data[DI]->get_addr());
-    mapping.tab_registers       = static_cast<uint16_t *>(shm_data[AO]->get_addr());
-    mapping.tab_input_registers = static_cast<uint16_t *>(shm_data[AI]->get_addr());
+    mapping.tab_bits            = static_cast<uint8_t *>(addr[DO]);
+    mapping.tab_input_bits      = static_cast<uint8_t *>(addr[DI]);
+    mapping.tab_registers       = static_cast<uint16_t *>(addr[AO]);
+    mapping.tab_input_registers = static_cast<uint16_t *>(addr[AI]);
+
+    init_tables(packed_bits, control_features, force, permissions);
+}
+
+Shm_Mapping::Shm_Mapping(Shm_Arena         &arena,
+                         std::uint16_t      client_id,
+                         const std::string &prefix,
+                         bool               force,
+                         mode_t             permissions,
+                         std::uint32_t      control_features)
+    : name_prefix(prefix) {
+    std::array<const arena::entry_t *, REG_COUNT> entries {};
+    for (std::size_t i = 0; i < REG_COUNT; ++i) {
+        entries[i] = arena.find(client_id, static_cast<arena::table_index_t>(i));  // NOLINT
+        if (!entries[i]) throw std::invalid_argument("arena does not contain the register tables of " + prefix);
+    }
+
+    // set register count
+    mapping.nb_bits            = static_cast<int>(entries[DO]->registers);
+    mapping.nb_input_bits      = static_cast<int>(entries[DI]->registers);
+    mapping.nb_registers       = static_cast<int>(entries[AO]->registers);
+    mapping.nb_input_registers = static_cast<int>(entries[AI]->registers);
+
+    // set arena tables as modbus register storage
+    mapping.tab_bits            = arena.get_table<uint8_t>(*entries[DO]);
+    mapping.tab_input_bits      = arena.get_table<uint8_t>(*entries[DI]);
+    mapping.tab_registers       = arena.get_table<uint16_t>(*entries[AO]);
+    mapping.tab_input_registers = arena.get_table<uint16_t>(*entries[AI]);
+
+    init_tables(entries[DO]->element_type == arena::ELEMENT_PACKED_BITS, control_features, force, permissions);
+}
+
+void Shm_Mapping::init_tables(bool packed_bits, std::uint32_t control_features, bool force, mode_t permissions) {
+    tables.mapping     = &mapping;
+    tables.packed_bits = packed_bits;
+
+    if (control_features) {
+        control = std::make_unique<Shm_Control>(
+                name_prefix + "CTL", mapping, packed_bits, control_features, force, permissions);
+        tables.control = control.get();
+    }
+}
+
+Shm_Arena::Shm_Arena(const std::string              &name,
+                     const std::vector<table_set_t> &table_sets,
+                     bool                            force,
+                     mode_t                          permissions,
+                     const Memory_Options           &memory) {
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const auto align     = [page_size](std::size_t value) { return (value + page_size - 1) / page_size * page_size; };
+
+    // layout: header, entries, register tables (page aligned)
+    const std::size_t entry_count = table_sets.size() * arena::TABLE_COUNT;
+    std::size_t       offset      = align(sizeof(arena::header_t) + entry_count * sizeof(arena::entry_t));
+
+    entries.reserve(entry_count);
+    for (const auto &set : table_sets) {
+        for (std::size_t i = 0; i < arena::TABLE_COUNT; ++i) {
+            const auto registers = set.registers[i];  // NOLINT
+            if (registers > MAX_MODBUS_REGISTERS || !registers)
+                throw std::invalid_argument(std::string("invalid number of registers (") + SUFFIXES[i] +  // NOLINT
+                                            ").");
+
+            arena::entry_t entry {};
+            entry.client_id = set.client_id;
+            entry.table     = static_cast<std::uint8_t>(i);
+            if (i == arena::AO || i == arena::AI) {
+                entry.element_type = arena::ELEMENT_U16;
+                entry.size         = 2 * registers;
+            } else if (set.packed_bits) {
+                entry.element_type = arena::ELEMENT_PACKED_BITS;
+                entry.size         = (registers + BYTE_BITS - 1) / BYTE_BITS;
+            } else {
+                entry.element_type = arena::ELEMENT_BIT;
+                entry.size         = registers;
+            }
+            entry.registers = static_cast<std::uint32_t>(registers);
+            entry.offset    = offset;
+            entry.alignment = static_cast<std::uint32_t>(page_size);
+            entries.emplace_back(entry);
+
+            offset = align(offset + entry.size);
+        }
+    }
+
+    addr = create_memory(name, offset, force, permissions, memory, shm, huge);
+
+    // an existing arena (force) is not valid until the header is written
+    auto *header = static_cast<arena::header_t *>(addr);
+    std::atomic_ref<std::uint32_t>(header->magic).store(0, std::memory_order_relaxed);
+
+    header->version        = arena::VERSION;
+    header->header_size    = sizeof(arena::header_t);
+    header->entry_size     = sizeof(arena::entry_t);
+    header->reserved       = 0;
+    header->entry_count    = static_cast<std::uint32_t>(entry_count);
+    header->entries_offset = sizeof(arena::header_t);
+    header->size           = offset;
+    header->page_size      = static_cast<std::uint32_t>(page_size);
+    header->reserved2      = 0;
+    std::memcpy(static_cast<std::uint8_t *>(addr) + header->entries_offset,  // NOLINT
+                entries.data(),
+                entries.size() * sizeof(arena::entry_t));
+
+    // the magic number is written last: other processes may wait for it
+    std::atomic_ref<std::uint32_t>(header->magic).store(arena::MAGIC, std::memory_order_release);
+}
+
+const arena::entry_t *Shm_Arena::find(std::uint16_t client_id, arena::table_index_t table) const noexcept {
+    for (const auto &entry : entries) {
+        if (entry.client_id == client_id && entry.table == table) return &entry;
+    }
+    return nullptr;
 }
 
 }  // namespace Modbus::shm
@@ -5,6 +5,10 @@
 
 #pragma once
 
+#include "Hugetlb_File.hpp"
+#include "Register_Tables.hpp"
+#include "Shm_Arena_Layout.hpp"
+#include "Shm_Control.hpp"
 #include "cxxshm.hpp"
 #include "modbus/modbus.h"
 #include <array>
@@ -12,10 +16,79 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 
 namespace Modbus::shm {
 
+//! memory options of the register tables
+struct Memory_Options {
+    std::string hugetlbfs;         //!< mount point of a hugetlbfs (empty: POSIX shared memory objects)
+    bool        prefault = false;  //!< allocate all pages on creation
+    bool        lock     = false;  //!< lock the pages in memory (mlock)
+};
+
+/*! \brief shared memory object that contains the register tables of multiple client ids (--arena)
+ *
+ * The layout is described in Shm_Arena_Layout.hpp. The arena is created on construction and deleted on destruction.
+ * The register tables are used by Shm_Mapping objects.
+ */
+class Shm_Arena final {
+public:
+    //! register tables of one client id
+    struct table_set_t {
+        std::uint16_t              client_id;    //!< client id (arena::ANY_CLIENT_ID: all other client ids)
+        std::array<std::size_t, 4> registers;    //!< number of registers (DO, DI, AO, AI)
+        bool                       packed_bits;  //!< store 8 digital registers per byte in DO and DI
+    };
+
+private:
+    std::unique_ptr<cxxshm::SharedMemory> shm;             //!< shared memory object
+    std::unique_ptr<Hugetlb_File>         huge;            //!< hugetlbfs file (instead of shm)
+    void                                 *addr = nullptr;  //!< mapped address
+    std::vector<arena::entry_t>           entries;         //!< layout of the register tables
+
+public:
+    /*! \brief create the arena
+     *
+     * @param name name of the shared memory object
+     * @param table_sets register tables in the arena
+     * @param force do not fail if the shared memory exist, but use the existing shared memory
+     * @param permissions shared memory file permissions
+     * @param memory memory options
+     */
+    Shm_Arena(const std::string              &name,
+              const std::vector<table_set_t> &table_sets,
+              bool                            force,
+              mode_t                          permissions,
+              const Memory_Options           &memory = Memory_Options());
+
+    ~Shm_Arena() = default;
+
+    Shm_Arena(const Shm_Arena &other)            = delete;
+    Shm_Arena(Shm_Arena &&other)                 = delete;
+    Shm_Arena &operator=(const Shm_Arena &other) = delete;
+    Shm_Arena &operator=(Shm_Arena &&other)      = delete;
+
+    /*! \brief find a register table
+     *
+     * @param client_id client id (exact match)
+     * @param table register table
+     * @return entry of the register table or nullptr
+     */
+    [[nodiscard]] const arena::entry_t *find(std::uint16_t client_id, arena::table_index_t table) const noexcept;
+
+    /*! \brief get the storage of a register table
+     *
+     * @param entry entry of the register table
+     * @return address of the first register
+     */
+    template <typename T>
+    T *get_table(const arena::entry_t &entry) const noexcept {
+        return arena::table<T>(addr, entry);
+    }
+};
+
 /*! \brief class that creates a modbus_mapping_t object that uses shared memory (shm) objects.
  *
  * All required shm objects are created on construction and and deleted on destruction.
@@ -32,12 +105,24 @@ private:
         void       *addr = nullptr;        //!< mapped address
     };
 
+    //! name prefix of the shared memory objects
+    std::string name_prefix;
+
     //! modbus lib storage object
     modbus_mapping_t mapping {};
 
+    //! storage layout of the mapping
+    Register_Tables tables;
+
     //! info for all shared memory objects
     std::array<std::unique_ptr<cxxshm::SharedMemory>, reg_index_t::REG_COUNT> shm_data;
 
+    //! huge page files (instead of shm_data if Memory_Options::hugetlbfs is set)
+    std::array<std::unique_ptr<Hugetlb_File>, reg_index_t::REG_COUNT> huge_data;
+
+    //! control object (only if control features are enabled)
+    std::unique_ptr<Shm_Control> control;
+
 public:
     /*! \brief creates a new modbus_mapping_t. Like modbus_mapping_new(), but creates shared memory objects to store its
      * data.
@@ -48,6 +133,11 @@ public:
      *      - <shm_name_prefix>AO
      *      - <shm_name_prefix>AI
      *
+     * if control features are enabled, the control object <shm_name_prefix>CTL is created as well.
+     *
+     * if Memory_Options::hugetlbfs is set, the register tables are files with the same names in the hugetlbfs mount
+     * instead of shared memory objects.
+     *
      * @param nb_bits number of digital output registers (DO)
      * @param nb_input_bits number of digital input registers (DI)
      * @param nb_registers number of analog output registers (AO)
@@ -55,14 +145,20 @@ public:
      * @param shm_name_prefix name prefix of the created shared memory object
      * @param force do not fail if the shared memory exist, but use the existing shared memory
      * @param permissions shared memory file permissions
+     * @param packed_bits store 8 digital registers per byte in DO and DI (instead of one per byte like libmodbus)
+     * @param control_features features of the control object (control::FEATURE_*, 0: no control object)
+     * @param memory memory options of the register tables
      */
-    Shm_Mapping(std::size_t        nb_bits,
-                std::size_t        nb_input_bits,
-                std::size_t        nb_registers,
-                std::size_t        nb_input_registers,
-                const std::string &shm_name_prefix,
-                bool               force,
-                mode_t             permissions);
+    Shm_Mapping(std::size_t           nb_bits,
+                std::size_t           nb_input_bits,
+                std::size_t           nb_registers,
+                std::size_t           nb_input_registers,
+                const std::string    &shm_name_prefix,
+                bool                  force,
+                mode_t                permissions,
+                bool                  packed_bits      = false,
+                std::uint32_t         control_features = 0,
+                const Memory_Options &memory           = Memory_Options());
 
     ~Shm_Mapping() = default;
 
@@ -71,11 +167,49 @@ public:
     Shm_Mapping &operator=(const Shm_Mapping &other) = delete;
     Shm_Mapping &operator=(Shm_Mapping &&other)      = delete;
 
+    /*! \brief creates a new modbus_mapping_t that uses the register tables of an arena
+     *
+     * @param arena arena that contains the register tables (must exist until this object is destroyed)
+     * @param client_id client id of the register tables in the arena
+     * @param shm_name_prefix name prefix (only used for the control object <shm_name_prefix>CTL)
+     * @param force do not fail if the control object exist, but use the existing shared memory
+     * @param permissions shared memory file permissions
+     * @param control_features features of the control object (control::FEATURE_*, 0: no control object)
+     */
+    Shm_Mapping(Shm_Arena         &arena,
+                std::uint16_t      client_id,
+                const std::string &shm_name_prefix,
+                bool               force,
+                mode_t             permissions,
+                std::uint32_t      control_features = 0);
+
     /*! \brief get a pointer to the created modbus_mapping_t object
      *
      * @return pointer to modbus_mapping_t object
      */
     modbus_mapping_t *get_mapping() { return &mapping; }
+
+    /*! \brief get the storage layout of the created modbus_mapping_t object
+     *
+     * @return register tables
+     */
+    [[nodiscard]] const Register_Tables &get_tables() const noexcept { return tables; }
+
+    /*! \brief set the sparse address windows of the register tables
+     *
+     * @param windows address windows (see Register_Tables::windows). The number of registers of a table with address
+     *                windows must be Address_Map::get_size(). The objects must exist until this object is destroyed.
+     */
+    void set_address_windows(const std::array<const Address_Map *, 4> &windows) noexcept { tables.windows = windows; }
+
+    /*! \brief get the name prefix of the shared memory objects
+     *
+     * @return name prefix
+     */
+    [[nodiscard]] const std::string &get_name_prefix() const noexcept { return name_prefix; }
+
+private:
+    void init_tables(bool packed_bits, std::uint32_t control_features, bool force, mode_t permissions);
 };
 
 }  // namespace Modbus::shm
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+/*! \file
+ * \brief tests of the sparse address windows (Address_Map)
+ */
+
+#include "Address_Map.hpp"
+#include "test_check.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Modbus::Address_Map;
+using Modbus::Address_Window;
+
+//* number of Modbus addresses
+constexpr int ADDRESSES = 0x10000;
+
+//! check that the construction of a mapping fails
+void check_invalid(const std::vector<Address_Window> &windows, const std::string &context) {
+    try {
+        Address_Map map(windows);
+        CHECK_CTX(false, context);
+    } catch (const std::invalid_argument &) {}
+}
+
+//! check that parsing fails
+void check_parse_invalid(const std::string &window) {
+    try {
+        static_cast<void>(Address_Map::parse({window}));
+        CHECK_CTX(false, window);
+    } catch (const std::invalid_argument &) {}
+}
+
+/**
+ * @brief compare translate with a reference for all addresses
+ *
+ * @details reference: a range is valid if all its addresses are inside a window (adjacent windows are stored
+ *          consecutively, so the table indices of a valid range are consecutive as well)
+ */
+void check_exhaustive(const std::vector<Address_Window> &windows, const std::string &context) {
+    const Address_Map map(windows);
+
+    // table index of each address (-1: no window)
+    std::vector<int> index(ADDRESSES, -1);
+    int              size = 0;
+    for (int address = 0; address < ADDRESSES; ++address)
+        for (const auto &window : windows)
+            if (static_cast<std::size_t>(address) >= window.start &&
+                static_cast<std::size_t>(address) < window.start + window.count)
+                index[static_cast<std::size_t>(address)] = size++;
+    CHECK_CTX(map.get_size() == static_cast<std::size_t>(size), context);
+
+    for (const int nb : {1, 2, 7, 125, 2000}) {
+        int failures = 0;
+        for (int address = -1; address < ADDRESSES; ++address) {
+            bool mapped = address >= 0 && address + nb <= ADDRESSES;
+            for (int i = 0; mapped && i < nb; ++i)
+                mapped = index[static_cast<std::size_t>(address + i)] >= 0;
+            const int expected = mapped ? index[static_cast<std::size_t>(address)] : -1;
+            if (map.translate(address, nb) != expected) ++failures;
+        }
+        CHECK_CTX(failures == 0, context + ", " + std::to_string(nb) + " registers");
+    }
+}
+
+//! ranges at the edges of separate windows
+void test_edges() {
+    const Address_Map map({{200, 5}, {100, 10}, {0xFFF0, 16}});
+    CHECK(map.get_size() == 31);
+
+    // first window (table index 0 .. 9)
+    CHECK(map.translate(100, 1) == 0);
+    CHECK(map.translate(100, 10) == 0);
+    CHECK(map.translate(109, 1) == 9);
+    CHECK(map.translate(105, 5) == 5);
+    CHECK(map.translate(99, 1) == -1);
+    CHECK(map.translate(99, 2) == -1);
+    CHECK(map.translate(100, 11) == -1);
+    CHECK(map.translate(105, 6) == -1);
+    CHECK(map.translate(110, 1) == -1);
+
+    // second window (table index 10 .. 14)
+    CHECK(map.translate(200, 5) == 10);
+    CHECK(map.translate(204, 1) == 14);
+    CHECK(map.translate(199, 2) == -1);
+    CHECK(map.translate(204, 2) == -1);
+    CHECK(map.translate(205, 1) == -1);
+
+    // requests can not span the gap between windows
+    CHECK(map.translate(109, 92) == -1);
+
+    // last window at the end of the address space (table index 15 .. 30)
+    CHECK(map.translate(0xFFF0, 16) == 15);
+    CHECK(map.translate(0xFFFF, 1) == 30);
+    CHECK(map.translate(0xFFFF, 2) == -1);
+
+    // addresses in front of the first window (the PDU engine passes address - start address)
+    CHECK(map.translate(0, 1) == -1);
+    CHECK(map.translate(-1, 1) == -1);
+}
+
+//! adjacent windows are merged: requests may span both windows
+void test_adjacent() {
+    const Address_Map map({{15, 5}, {10, 5}, {20, 1}});
+    CHECK(map.get_size() == 11);
+    CHECK(map.translate(10, 11) == 0);
+    CHECK(map.translate(12, 6) == 2);
+    CHECK(map.translate(19, 2) == 9);
+    CHECK(map.translate(20, 1) == 10);
+    CHECK(map.translate(20, 2) == -1);
+    CHECK(map.translate(9, 2) == -1);
+
+    const Address_Map complete({{0, ADDRESSES}});
+    CHECK(complete.translate(0, 2000) == 0);
+    CHECK(complete.translate(ADDRESSES - 1, 1) == ADDRESSES - 1);
+    CHECK(complete.translate(ADDRESSES - 1, 2) == -1);
+}
+
+void test_invalid() {
+    check_invalid({}, "no windows");
+    check_invalid({{100, 0}}, "count 0");
+    check_invalid({{ADDRESSES, 1}}, "start behind the address space");
+    check_invalid({{ADDRESSES - 1, 2}}, "end behind the address space");
+    check_invalid({{100, 10}, {109, 5}}, "overlapping windows");
+    check_invalid({{100, 10}, {90, 11}}, "overlapping windows (unsorted)");
+    check_invalid({{100, 10}, {100, 10}}, "identical windows");
+}
+
+void test_parse() {
+    const auto map = Address_Map::parse({"0x100:0x10", "1000:100"});
+    CHECK(map.get_size() == 116);
+    CHECK(map.translate(0x100, 16) == 0);
+    CHECK(map.translate(1000, 100) == 16);
+    CHECK(map.translate(0x110, 1) == -1);
+
+    check_parse_invalid("100");
+    check_parse_invalid("a:1");
+    check_parse_invalid("1:2x");
+    check_parse_invalid("1:");
+    check_parse_invalid(":1");
+    check_parse_invalid("1:0");
+    check_parse_invalid("65535:2");
+}
+
+}  // namespace
+
+int main() {
+    test_edges();
+    test_adjacent();
+    test_invalid();
+    test_parse();
+
+    check_exhaustive({{200, 5}, {100, 10}, {0xFFF0, 16}}, "separate windows");
+    check_exhaustive({{0, 1}, {1, 1}, {3, 1}, {5, 3000}, {3005, 7}, {40000, 2001}}, "adjacent windows");
+    check_exhaustive({{0, ADDRESSES}}, "complete address space");
+
+    return Test::result();
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+/*! \file
+ * \brief tests of the incremental Modbus/TCP framer (ADU_Framer)
+ */
+
+#include "ADU_Framer.hpp"
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Modbus::TCP::ADU_Framer;
+using result_t = ADU_Framer::result_t;
+
+/**
+ * @brief create an ADU
+ *
+ * @param transaction_id transaction id
+ * @param pdu_size size of the PDU (function code + data)
+ * @param protocol_id protocol id (0: Modbus)
+ * @return ADU with a valid length field
+ */
+std::vector<std::uint8_t> make_adu(unsigned transaction_id, std::size_t pdu_size, unsigned protocol_id = 0) {
+    const auto length = pdu_size + 1;
+
+    std::vector<std::uint8_t> adu {static_cast<std::uint8_t>(transaction_id >> 8),
+                                   static_cast<std::uint8_t>(transaction_id),
+                                   static_cast<std::uint8_t>(protocol_id >> 8),
+                                   static_cast<std::uint8_t>(protocol_id),
+                                   static_cast<std::uint8_t>(length >> 8),
+                                   static_cast<std::uint8_t>(length),
+                                   0x01};
+    for (std::size_t i = 0; i < pdu_size; ++i)
+        adu.push_back(static_cast<std::uint8_t>(i + 3));
+    return adu;
+}
+
+//! check that the framer returns the ADU
+void check_next(ADU_Framer &framer, const std::vector<std::uint8_t> &expected, const std::string &context) {
+    std::span<const std::uint8_t> adu;
+    CHECK_CTX(framer.next(adu) == result_t::complete, context);
+    CHECK_CTX(std::equal(adu.begin(), adu.end(), expected.begin(), expected.end()), context);
+}
+
+//! ADUs that are received in two parts (split at every position)
+void test_split() {
+    for (const std::size_t pdu_size : {1U, 5U, 253U}) {
+        const auto request = make_adu(0x0102, pdu_size);
+
+        for (std::size_t split = 1; split < request.size(); ++split) {
+            const auto context = "PDU size " + std::to_string(pdu_size) + ", split at " + std::to_string(split);
+
+            ADU_Framer                          framer;
+            std::span<const std::uint8_t>       adu;
+            const std::span<const std::uint8_t> data(request);
+
+            CHECK_CTX(framer.append(data.first(split)) == split, context);
+            CHECK_CTX(framer.next(adu) == result_t::incomplete, context);
+            CHECK_CTX(framer.pending(), context);
+
+            CHECK_CTX(framer.append(data.subspan(split)) == request.size() - split, context);
+            check_next(framer, request, context);
+            CHECK_CTX(framer.next(adu) == result_t::incomplete, context);
+            CHECK_CTX(!framer.pending(), context);
+        }
+    }
+}
+
+//! ADUs that are received byte by byte via free_space and commit
+void test_byte_by_byte() {
+    ADU_Framer                    framer;
+    std::span<const std::uint8_t> adu;
+
+    const auto request = make_adu(7, 12);
+    for (std::size_t i = 0; i < request.size(); ++i) {
+        CHECK(framer.next(adu) == result_t::incomplete);
+        auto space = framer.free_space();
+        CHECK(!space.empty());
+        space[0] = request[i];
+        framer.commit(1);
+    }
+    check_next(framer, request, "byte by byte");
+}
+
+//! pipelined ADUs in one receive call, the last one incomplete
+void test_pipelined() {
+    ADU_Framer framer;
+
+    const auto first  = make_adu(1, 5);
+    const auto second = make_adu(2, 253);
+    const auto third  = make_adu(3, 1);
+
+    std::vector<std::uint8_t> data;
+    data.insert(data.end(), first.begin(), first.end());
+    data.insert(data.end(), second.begin(), second.end());
+    data.insert(data.end(), third.begin(), third.end() - 1);
+    CHECK(framer.append(data) == data.size());
+
+    check_next(framer, first, "pipelined: first");
+    check_next(framer, second, "pipelined: second");
+
+    std::span<const std::uint8_t> adu;
+    CHECK(framer.next(adu) == result_t::incomplete);
+    CHECK(framer.append(std::span<const std::uint8_t>(third).last(1)) == 1);
+    check_next(framer, third, "pipelined: third");
+}
+
+//! unget returns the ADU to the buffer
+void test_unget() {
+    ADU_Framer framer;
+
+    const auto first  = make_adu(1, 5);
+    const auto second = make_adu(2, 6);
+    CHECK(framer.append(first) == first.size());
+    CHECK(framer.append(second) == second.size());
+
+    std::span<const std::uint8_t> adu;
+    CHECK(framer.next(adu) == result_t::complete);
+    framer.unget(adu);
+    check_next(framer, first, "unget: first");
+    check_next(framer, second, "unget: second");
+}
+
+//! invalid protocol id and length field
+void test_invalid() {
+    const auto check_invalid = [](const std::vector<std::uint8_t> &request, const std::string &context) {
+        ADU_Framer                    framer;
+        std::span<const std::uint8_t> adu;
+        CHECK_CTX(framer.append(request) == request.size(), context);
+        CHECK_CTX(framer.next(adu) == result_t::invalid, context);
+    };
+
+    check_invalid(make_adu(1, 5, 1), "protocol id 1");
+    check_invalid(make_adu(1, 5, 0x0100), "protocol id 0x100");
+
+    // length field: unit id only (no function code)
+    check_invalid(make_adu(1, 0), "length 1");
+
+    // length field: PDU larger than MODBUS_MAX_PDU_LENGTH
+    check_invalid(make_adu(1, MODBUS_MAX_PDU_LENGTH + 1), "length 255");
+
+    // the header is checked as soon as it is complete (before the ADU is complete)
+    auto request = make_adu(1, 5);
+    request[5]   = 0xFF;
+    request.resize(ADU_Framer::MBAP_HEADER_SIZE);
+    check_invalid(request, "header only, length 255");
+
+    // incomplete header: not yet decidable
+    ADU_Framer                    framer;
+    std::span<const std::uint8_t> adu;
+    const auto                    header = make_adu(1, 5, 1);
+    CHECK(framer.append(std::span<const std::uint8_t>(header).first(ADU_Framer::MBAP_HEADER_SIZE - 1)) ==
+          ADU_Framer::MBAP_HEADER_SIZE - 1);
+    CHECK(framer.next(adu) == result_t::incomplete);
+}
+
+//! data that does not fit into the buffer and compaction of processed data
+void test_full_buffer() {
+    ADU_Framer framer;
+
+    const auto                request = make_adu(1, MODBUS_MAX_PDU_LENGTH);
+    std::vector<std::uint8_t> data;
+    while (data.size() <= ADU_Framer::BUFFER_SIZE)
+        data.insert(data.end(), request.begin(), request.end());
+
+    const auto appended = framer.append(data);
+    CHECK(appended == ADU_Framer::BUFFER_SIZE);
+    CHECK(framer.free_space().empty());
+
+    // processing one ADU makes its space available again
+    check_next(framer, request, "full buffer");
+    CHECK(framer.free_space().size() == request.size());
+    CHECK(framer.append(std::span<const std::uint8_t>(data).subspan(appended)) == request.size());
+
+    std::size_t                   count = 0;
+    std::span<const std::uint8_t> adu;
+    while (framer.next(adu) == result_t::complete)
+        ++count;
+    CHECK(count == ADU_Framer::BUFFER_SIZE / request.size());
+}
+
+}  // namespace
+
+int main() {
+    test_split();
+    test_byte_by_byte();
+    test_pipelined();
+    test_unget();
+    test_invalid();
+    test_full_buffer();
+
+    return Test::result();
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+/*! \file
+ * \brief compares the SIMD kernels of the coil packing (Bit_Pack) with a bit by bit reference
+ *
+ * All kernels that are supported by the cpu are tested at odd bit offsets and lengths, including lengths around the
+ * vector widths.
+ */
+
+#include "Bit_Pack.hpp"
+#include "test_check.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Modbus::PDU::Bits::isa_t;
+
+//* size of the packed test table in bytes
+constexpr std::size_t TABLE_SIZE = 512;
+
+//* value of the destination bytes behind the written range (must not be modified)
+constexpr std::uint8_t GUARD = 0x5A;
+
+//* tested kernels
+constexpr std::array<isa_t, 3> KERNELS {isa_t::scalar, isa_t::sse2, isa_t::avx2};
+
+//! name of a kernel
+const char *name(isa_t isa) {
+    switch (isa) {
+        case isa_t::scalar: return "scalar";
+        case isa_t::sse2: return "sse2";
+        case isa_t::avx2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+//* bit offsets (odd offsets and offsets behind a vector width)
+const std::vector<std::size_t> OFFSETS {0, 1, 3, 5, 7, 8, 9, 15, 17, 255, 257, 1001};
+
+//* bit counts (odd counts and counts around the vector widths of sse2 and avx2)
+const std::vector<std::size_t> COUNTS {1,   2,   7,   8,   9,   15,  16,  17,  31,  63,   64,   65,  127,
+                                       128, 129, 135, 255, 256, 257, 263, 511, 512, 513, 1000, 1968, 2000};
+
+std::uint8_t get_bit(const std::vector<std::uint8_t> &bytes, std::size_t index) {
+    return (bytes[index / 8] >> (index % 8)) & 1U;
+}
+
+void set_bit(std::vector<std::uint8_t> &bytes, std::size_t index, std::uint8_t value) {
+    const auto mask  = static_cast<std::uint8_t>(1U << (index % 8));
+    bytes[index / 8] = static_cast<std::uint8_t>(value ? bytes[index / 8] | mask : bytes[index / 8] & ~mask);
+}
+
+//! bytes with a pseudo random pattern
+std::vector<std::uint8_t> pattern(std::size_t size, unsigned seed) {
+    std::vector<std::uint8_t> bytes(size);
+    for (auto &byte : bytes) {
+        seed = seed * 1103515245U + 12345U;
+        byte = static_cast<std::uint8_t>(seed >> 16);
+    }
+    return bytes;
+}
+
+std::string context(isa_t isa, std::size_t offset, std::size_t nb) {
+    return std::string(name(isa)) + ": offset " + std::to_string(offset) + ", " + std::to_string(nb) + " bits";
+}
+
+void test_extract(isa_t isa) {
+    const auto table = pattern(TABLE_SIZE, 1);
+
+    for (const auto offset : OFFSETS)
+        for (const auto nb : COUNTS) {
+            const auto size = (nb + 7) / 8;
+
+            // reference: copy bit by bit, unused bits of the last byte are 0
+            std::vector<std::uint8_t> expected(size + 1, 0);
+            for (std::size_t i = 0; i < nb; ++i)
+                set_bit(expected, i, get_bit(table, offset + i));
+            expected[size] = GUARD;
+
+            std::vector<std::uint8_t> dst(size + 1, 0xFF);
+            dst[size] = GUARD;
+            Modbus::PDU::Bits::extract(isa, table.data(), offset, nb, dst.data());
+
+            CHECK_CTX(dst == expected, "extract " + context(isa, offset, nb));
+        }
+}
+
+void test_insert(isa_t isa) {
+    const auto original = pattern(TABLE_SIZE, 2);
+
+    for (const auto offset : OFFSETS)
+        for (const auto nb : COUNTS) {
+            // the unused bits of the last source byte are set: they must not be written
+            auto src = pattern((nb + 7) / 8, 3);
+            if (nb % 8) src.back() |= static_cast<std::uint8_t>(0xFF << (nb % 8));
+
+            auto expected = original;
+            for (std::size_t i = 0; i < nb; ++i)
+                set_bit(expected, offset + i, get_bit(src, i));
+
+            auto table = original;
+            Modbus::PDU::Bits::insert(isa, table.data(), offset, nb, src.data());
+
+            CHECK_CTX(table == expected, "insert " + context(isa, offset, nb));
+        }
+}
+
+void test_unpack(isa_t isa) {
+    const auto src = pattern(TABLE_SIZE, 4);
+
+    for (std::size_t nb = 1; nb <= 600; ++nb) {
+        std::vector<std::uint8_t> expected(nb + 1);
+        for (std::size_t i = 0; i < nb; ++i)
+            expected[i] = get_bit(src, i);
+        expected[nb] = GUARD;
+
+        std::vector<std::uint8_t> dst(nb + 1, 0xFF);
+        dst[nb] = GUARD;
+        Modbus::PDU::Bits::unpack(isa, src.data(), nb, dst.data());
+
+        CHECK_CTX(dst == expected, "unpack " + context(isa, 0, nb));
+    }
+}
+
+//! the functions without isa parameter use the selected kernel
+void test_selected() {
+    const auto isa = Modbus::PDU::Bits::selected();
+    CHECK(Modbus::PDU::Bits::is_supported(isa));
+
+    const auto table = pattern(TABLE_SIZE, 5);
+
+    std::vector<std::uint8_t> expected(TABLE_SIZE);
+    std::vector<std::uint8_t> result(TABLE_SIZE);
+    Modbus::PDU::Bits::extract(isa_t::scalar, table.data(), 13, 2000, expected.data());
+    Modbus::PDU::Bits::extract(table.data(), 13, 2000, result.data());
+    CHECK(result == expected);
+
+    auto expected_table = table;
+    auto result_table   = table;
+    Modbus::PDU::Bits::insert(isa_t::scalar, expected_table.data(), 3, 1000, expected.data());
+    Modbus::PDU::Bits::insert(result_table.data(), 3, 1000, expected.data());
+    CHECK(result_table == expected_table);
+
+    Modbus::PDU::Bits::unpack(isa_t::scalar, table.data(), 500, expected.data());
+    Modbus::PDU::Bits::unpack(table.data(), 500, result.data());
+    CHECK(result == expected);
+}
+
+}  // namespace
+
+int main() {
+    for (const auto isa : KERNELS) {
+        if (!Modbus::PDU::Bits::is_supported(isa)) {
+            std::cerr << "kernel " << name(isa) << " not supported by this cpu: skipped\n";
+            continue;
+        }
+
+        test_extract(isa);
+        test_insert(isa);
+        test_unpack(isa);
+    }
+    test_selected();
+
+    return Test::result();
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+/*! \file
+ * \brief compares the register byte swap kernels (Byte_Swap) with the big endian encoding
+ *
+ * All kernels that are supported by the cpu are tested with register counts around the vector widths and with
+ * unaligned wire buffers.
+ */
+
+#include "Byte_Swap.hpp"
+#include "test_check.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Modbus::PDU::Byte_Swap::isa_t;
+
+//* largest tested number of registers
+constexpr std::size_t MAX_REGISTERS = 300;
+
+//* value of the bytes behind the written range (must not be modified)
+constexpr std::uint8_t GUARD = 0x5A;
+
+//* tested kernels
+constexpr std::array<isa_t, 4> KERNELS {isa_t::scalar, isa_t::sse2, isa_t::ssse3, isa_t::avx2};
+
+//! name of a kernel
+const char *name(isa_t isa) {
+    switch (isa) {
+        case isa_t::scalar: return "scalar";
+        case isa_t::sse2: return "sse2";
+        case isa_t::ssse3: return "ssse3";
+        case isa_t::avx2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+//! registers with distinct high and low bytes
+std::vector<std::uint16_t> make_registers(std::size_t nb) {
+    std::vector<std::uint16_t> registers(nb);
+    for (std::size_t i = 0; i < nb; ++i)
+        registers[i] = static_cast<std::uint16_t>(((i * 37 + 1) & 0xFF) << 8 | ((i * 11 + 0x80) & 0xFF));
+    return registers;
+}
+
+//! big endian encoding of the registers, preceded by offset bytes and followed by GUARD
+std::vector<std::uint8_t> encode(const std::vector<std::uint16_t> &registers, std::size_t offset) {
+    std::vector<std::uint8_t> bytes(offset, GUARD);
+    for (const auto value : registers) {
+        bytes.push_back(static_cast<std::uint8_t>(value >> 8));
+        bytes.push_back(static_cast<std::uint8_t>(value));
+    }
+    bytes.push_back(GUARD);
+    return bytes;
+}
+
+void test_kernel(isa_t isa) {
+    for (std::size_t nb = 0; nb <= MAX_REGISTERS; ++nb)
+        for (const std::size_t offset : {0U, 1U}) {
+            const auto context = std::string(name(isa)) + ": " + std::to_string(nb) + " registers, offset " +
+                                 std::to_string(offset);
+            const auto registers = make_registers(nb);
+            const auto expected  = encode(registers, offset);
+
+            // to_wire with an unaligned destination
+            std::vector<std::uint8_t> wire(expected.size(), 0xFF);
+            for (std::size_t i = 0; i < offset; ++i)
+                wire[i] = GUARD;
+            wire.back() = GUARD;
+            Modbus::PDU::Byte_Swap::to_wire(isa, registers.data(), nb, wire.data() + offset);
+            CHECK_CTX(wire == expected, "to_wire " + context);
+
+            // from_wire with an unaligned source
+            std::vector<std::uint16_t> decoded(nb + 1, 0xFFFF);
+            decoded.back() = 0x5A5A;
+            Modbus::PDU::Byte_Swap::from_wire(isa, expected.data() + offset, nb, decoded.data());
+            CHECK_CTX(std::vector<std::uint16_t>(decoded.begin(), decoded.end() - 1) == registers,
+                      "from_wire " + context);
+            CHECK_CTX(decoded.back() == 0x5A5A, "from_wire " + context);
+        }
+}
+
+//! the functions without isa parameter use the selected kernel
+void test_selected() {
+    CHECK(Modbus::PDU::Byte_Swap::is_supported(Modbus::PDU::Byte_Swap::selected()));
+
+    const auto registers = make_registers(MAX_REGISTERS);
+    const auto expected  = encode(registers, 0);
+
+    std::vector<std::uint8_t> wire(expected.size(), GUARD);
+    Modbus::PDU::Byte_Swap::to_wire(registers.data(), registers.size(), wire.data());
+    CHECK(wire == expected);
+
+    std::vector<std::uint16_t> decoded(registers.size());
+    Modbus::PDU::Byte_Swap::from_wire(expected.data(), registers.size(), decoded.data());
+    CHECK(decoded == registers);
+}
+
+}  // namespace
+
+int main() {
+    for (const auto isa : KERNELS) {
+        if (!Modbus::PDU::Byte_Swap::is_supported(isa)) {
+            std::cerr << "kernel " << name(isa) << " not supported by this cpu: skipped\n";
+            continue;
+        }
+
+        test_kernel(isa);
+    }
+    test_selected();
+
+    return Test::result();
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+/*! \brief minimal test helpers
+ *
+ * A test executable records failed checks and returns the result of Test::result() from main.
+ */
+namespace Test {
+
+//! number of failed checks
+inline int failures = 0;
+
+/*! \brief record the result of a check
+ *
+ * @param condition checked condition
+ * @param expression checked expression (printed if the check fails)
+ * @param context test case (printed if the check fails)
+ * @param file source file of the check
+ * @param line source line of the check
+ */
+inline void
+        check(bool condition, std::string_view expression, std::string_view context, const char *file, int line) {
+    if (condition) return;
+
+    ++failures;
+    std::cerr << file << ':' << line << ": check failed: " << expression;
+    if (!context.empty()) std::cerr << " (" << context << ')';
+    std::cerr << '\n';
+}
+
+/*! \brief get the exit code of the test executable
+ *
+ * @return EXIT_SUCCESS if all checks passed
+ */
+inline int result() {
+    if (failures == 0) return EXIT_SUCCESS;
+
+    std::cerr << failures << " check(s) failed\n";
+    return EXIT_FAILURE;
+}
+
+}  // namespace Test
+
+//! check a condition
+#define CHECK(condition) Test::check(static_cast<bool>(condition), #condition, {}, __FILE__, __LINE__)  // NOLINT
+
+//! check a condition (context: description of the test case)
+#define CHECK_CTX(condition, context)                                                                                  \
+    Test::check(static_cast<bool>(condition), #condition, context, __FILE__, __LINE__)  // NOLINT
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2024 Nikolas Koesling <nikolas@koesling.info>.
+ * This program is free software. You can redistribute it and/or modify it under the terms of the GPLv3 License.
+ */
+
+/*! \file
+ * \brief compares the replies of the built-in PDU engine with the replies of libmodbus (modbus_reply)
+ *
+ * Every supported function code is executed with valid requests and with requests that are answered with an exception.
+ * The reply and the register tables after the request must be identical to the result of modbus_reply.
+ */
+
+#include "PDU_Engine.hpp"
+#include "test_check.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <modbus/modbus.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+//* number of registers of each table
+constexpr int NB_REGS = 300;
+
+//* exception flag of the function code in exception responses
+constexpr std::uint8_t EXCEPTION_FLAG = 0x80;
+
+//* offset of the function code in a Modbus/TCP ADU
+constexpr std::size_t FC = 7;
+
+//* largest write data of FC 23 that fits into an ADU (requests with more registers are truncated)
+constexpr unsigned MAX_FC23_DATA = 2 * MODBUS_MAX_WR_WRITE_REGISTERS;
+
+/**
+ * @brief register tables with a deterministic content (one coil per byte)
+ */
+struct Tables {
+    std::array<std::uint8_t, NB_REGS>  bits {};
+    std::array<std::uint8_t, NB_REGS>  input_bits {};
+    std::array<std::uint16_t, NB_REGS> registers {};
+    std::array<std::uint16_t, NB_REGS> input_registers {};
+    modbus_mapping_t                   mapping {};
+
+    /**
+     * @brief create the tables
+     * @param start start address of all tables
+     */
+    explicit Tables(int start) {
+        for (std::size_t i = 0; i < NB_REGS; ++i) {
+            bits[i]            = static_cast<std::uint8_t>(i % 3 == 0);
+            input_bits[i]      = static_cast<std::uint8_t>(i % 5 < 2);
+            registers[i]       = static_cast<std::uint16_t>(0x1000 + i * 7);
+            input_registers[i] = static_cast<std::uint16_t>(0xF000 - i * 13);
+        }
+
+        mapping.start_bits            = start;
+        mapping.start_input_bits      = start;
+        mapping.start_registers       = start;
+        mapping.start_input_registers = start;
+        mapping.nb_bits               = NB_REGS;
+        mapping.nb_input_bits         = NB_REGS;
+        mapping.nb_registers          = NB_REGS;
+        mapping.nb_input_registers    = NB_REGS;
+        mapping.tab_bits              = bits.data();
+        mapping.tab_input_bits        = input_bits.data();
+        mapping.tab_registers         = registers.data();
+        mapping.tab_input_registers   = input_registers.data();
+    }
+
+    Tables(const Tables &)            = delete;
+    Tables &operator=(const Tables &) = delete;
+};
+
+/**
+ * @brief Modbus/TCP request builder
+ */
+class Request {
+private:
+    std::vector<std::uint8_t> adu {0x12, 0x34, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+public:
+    explicit Request(std::uint8_t function_code) { adu.push_back(function_code); }
+
+    //! append a byte
+    Request &u8(unsigned value) {
+        adu.push_back(static_cast<std::uint8_t>(value));
+        return *this;
+    }
+
+    //! append a 16 bit value (big endian)
+    Request &u16(unsigned value) {
+        adu.push_back(static_cast<std::uint8_t>(value >> 8));
+        adu.push_back(static_cast<std::uint8_t>(value));
+        return *this;
+    }
+
+    //! append data bytes with a pattern
+    Request &data(std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i)
+            adu.push_back(static_cast<std::uint8_t>(0xA5 ^ (i * 29)));
+        return *this;
+    }
+
+    //! get the ADU with the MBAP length field set
+    [[nodiscard]] std::vector<std::uint8_t> get() const {
+        auto       result = adu;
+        const auto length = result.size() - 6;
+        result[4]         = static_cast<std::uint8_t>(length >> 8);
+        result[5]         = static_cast<std::uint8_t>(length);
+        return result;
+    }
+};
+
+/**
+ * @brief execute a request with modbus_reply
+ *
+ * @param request complete request
+ * @param mapping register storage
+ * @return reply that was sent by libmodbus
+ */
+std::vector<std::uint8_t> libmodbus_reply(const std::vector<std::uint8_t> &request, modbus_mapping_t *mapping) {
+    std::array<int, 2> sockets {};
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets.data()))
+        throw std::system_error(errno, std::generic_category(), "socketpair");
+
+    modbus_t *ctx = modbus_new_tcp("127.0.0.1", MODBUS_TCP_DEFAULT_PORT);
+    if (!ctx) throw std::runtime_error("modbus_new_tcp failed");
+    modbus_set_socket(ctx, sockets[0]);
+
+    // libmodbus waits for the response timeout before it sends exception responses to invalid requests
+    modbus_set_response_timeout(ctx, 0, 1);
+
+    // libmodbus does not check the request size: the data behind the request is readable
+    if (request.size() > MODBUS_TCP_MAX_ADU_LENGTH) throw std::logic_error("request too large");
+    std::vector<std::uint8_t> buffer(MODBUS_TCP_MAX_ADU_LENGTH, 0);
+    std::copy(request.begin(), request.end(), buffer.begin());
+    const int sent = modbus_reply(ctx, buffer.data(), static_cast<int>(request.size()), mapping);
+
+    std::vector<std::uint8_t> reply(MODBUS_TCP_MAX_ADU_LENGTH);
+    const auto received = sent > 0 ? recv(sockets[1], reply.data(), reply.size(), MSG_DONTWAIT) : 0;
+    reply.resize(received > 0 ? static_cast<std::size_t>(received) : 0);
+
+    modbus_free(ctx);
+    close(sockets[0]);
+    close(sockets[1]);
+    return reply;
+}
+
+/**
+ * @brief check that the PDU engine and libmodbus produce the same result
+ *
+ * @param name test case
+ * @param request complete request
+ * @param start start address of the tables
+ */
+void compare(const std::string &name, const std::vector<std::uint8_t> &request, int start) {
+    const auto context = name + " (start address " + std::to_string(start) + ')';
+
+    Tables engine(start);
+    Tables expected(start);
+    Tables original(start);
+
+    const Modbus::Register_Tables tables {&engine.mapping};
+    const auto                    write_range = Modbus::PDU::get_write_range(request, tables);
+
+    std::vector<std::uint8_t> reply;
+    Modbus::PDU::execute(request, tables, reply);
+
+    CHECK_CTX(reply == libmodbus_reply(request, &expected.mapping), context);
+    CHECK_CTX(engine.bits == expected.bits, context);
+    CHECK_CTX(engine.registers == expected.registers, context);
+
+    // get_write_range: the reported registers are the only registers that may be modified
+    const bool is_exception = reply.size() > FC && (reply[FC] & EXCEPTION_FLAG);
+    const auto access       = Modbus::PDU::get_table_access(request[FC]);
+    CHECK_CTX(write_range.has_value() == (access.write != 0 && !is_exception), context);
+
+    for (std::size_t i = 0; i < NB_REGS; ++i) {
+        const auto in_range = [&](Modbus::shm::control::table_index_t table) {
+            return write_range && write_range->table == table && i >= write_range->address &&
+                   i < write_range->address + write_range->count;
+        };
+        if (!in_range(Modbus::shm::control::DO)) CHECK_CTX(engine.bits[i] == original.bits[i], context);
+        if (!in_range(Modbus::shm::control::AO)) CHECK_CTX(engine.registers[i] == original.registers[i], context);
+    }
+}
+
+/**
+ * @brief check that truncated requests are answered with ILLEGAL_DATA_VALUE
+ *
+ * @details libmodbus can not be used as reference: it expects that the request size matches the function code
+ *
+ * @param name test case
+ * @param request truncated request
+ */
+void check_truncated(const std::string &name, const std::vector<std::uint8_t> &request) {
+    Tables                        engine(0);
+    const Modbus::Register_Tables tables {&engine.mapping};
+
+    CHECK_CTX(!Modbus::PDU::get_write_range(request, tables), name);
+
+    std::vector<std::uint8_t> reply;
+    Modbus::PDU::execute(request, tables, reply);
+    CHECK_CTX(reply.size() == FC + 2, name);
+    if (reply.size() != FC + 2) return;
+    CHECK_CTX(reply[FC] == (request[FC] | EXCEPTION_FLAG), name);
+    CHECK_CTX(reply[FC + 1] == MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, name);
+}
+
+//! read requests (FC 1 .. 4)
+void test_read(int start) {
+    const auto address = static_cast<unsigned>(start);
+
+    struct read_fc_t {
+        std::uint8_t function_code;
+        unsigned     max;
+    };
+    constexpr std::array<read_fc_t, 4> READ_FCS {{
+            {MODBUS_FC_READ_COILS, MODBUS_MAX_READ_BITS},
+            {MODBUS_FC_READ_DISCRETE_INPUTS, MODBUS_MAX_READ_BITS},
+            {MODBUS_FC_READ_HOLDING_REGISTERS, MODBUS_MAX_READ_REGISTERS},
+            {MODBUS_FC_READ_INPUT_REGISTERS, MODBUS_MAX_READ_REGISTERS},
+    }};
+
+    for (const auto &[fc, max] : READ_FCS) {
+        const auto name = "FC " + std::to_string(fc);
+
+        // valid: odd offsets and counts, complete table end
+        for (const unsigned nb : {1U, 7U, 8U, 9U, 17U, 64U, 125U})
+            for (const unsigned offset : {0U, 3U, 13U, NB_REGS - nb})
+                compare(name + " read " + std::to_string(nb) + " at " + std::to_string(offset),
+                        Request(fc).u16(address + offset).u16(nb).get(),
+                        start);
+
+        compare(name + " count 0", Request(fc).u16(address).u16(0).get(), start);
+        compare(name + " count > max", Request(fc).u16(address).u16(max + 1).get(), start);
+        compare(name + " beyond table end", Request(fc).u16(address + NB_REGS - 2).u16(3).get(), start);
+        compare(name + " address behind table", Request(fc).u16(address + NB_REGS).u16(1).get(), start);
+        compare(name + " count > max and invalid address", Request(fc).u16(0xFFFF).u16(max + 1).get(), start);
+        if (start) compare(name + " address below start", Request(fc).u16(address - 1).u16(1).get(), start);
+    }
+}
+
+//! write requests (FC 5, 6, 15, 16, 22, 23)
+void test_write(int start) {
+    const auto address = static_cast<unsigned>(start);
+
+    // FC 5: write single coil
+    constexpr auto FC5 = MODBUS_FC_WRITE_SINGLE_COIL;
+    compare("FC 5 on", Request(FC5).u16(address + 1).u16(0xFF00).get(), start);
+    compare("FC 5 off", Request(FC5).u16(address).u16(0x0000).get(), start);
+    compare("FC 5 last coil", Request(FC5).u16(address + NB_REGS - 1).u16(0xFF00).get(), start);
+    compare("FC 5 invalid value", Request(FC5).u16(address).u16(0x1234).get(), start);
+    compare("FC 5 invalid address", Request(FC5).u16(address + NB_REGS).u16(0xFF00).get(), start);
+    compare("FC 5 invalid address and value", Request(FC5).u16(address + NB_REGS).u16(0x0001).get(), start);
+
+    // FC 6: write single register
+    constexpr auto FC6 = MODBUS_FC_WRITE_SINGLE_REGISTER;
+    compare("FC 6", Request(FC6).u16(address + 5).u16(0xBEEF).get(), start);
+    compare("FC 6 last register", Request(FC6).u16(address + NB_REGS - 1).u16(0x0102).get(), start);
+    compare("FC 6 invalid address", Request(FC6).u16(address + NB_REGS).u16(0x0102).get(), start);
+
+    // FC 15: write multiple coils
+    constexpr auto FC15 = MODBUS_FC_WRITE_MULTIPLE_COILS;
+    for (const unsigned nb : {1U, 7U, 8U, 9U, 31U, 100U})
+        for (const unsigned offset : {0U, 5U, NB_REGS - nb}) {
+            const unsigned bytes = (nb + 7) / 8;
+            compare("FC 15 write " + std::to_string(nb) + " at " + std::to_string(offset),
+                    Request(FC15).u16(address + offset).u16(nb).u8(bytes).data(bytes).get(),
+                    start);
+        }
+    compare("FC 15 count 0", Request(FC15).u16(address).u16(0).u8(1).data(1).get(), start);
+    compare("FC 15 count > max",
+            Request(FC15).u16(address).u16(MODBUS_MAX_WRITE_BITS + 1).u8(247).data(247).get(),
+            start);
+    compare("FC 15 byte count too small", Request(FC15).u16(address).u16(17).u8(2).data(2).get(), start);
+    compare("FC 15 beyond table end", Request(FC15).u16(address + NB_REGS - 8).u16(9).u8(2).data(2).get(), start);
+    compare("FC 15 invalid address and count", Request(FC15).u16(0xFFFF).u16(0).u8(1).data(1).get(), start);
+
+    // FC 16: write multiple registers
+    constexpr auto FC16 = MODBUS_FC_WRITE_MULTIPLE_REGISTERS;
+    for (const unsigned nb : {1U, 3U, 17U, 123U})
+        for (const unsigned offset : {0U, 7U, NB_REGS - nb})
+            compare("FC 16 write " + std::to_string(nb) + " at " + std::to_string(offset),
+                    Request(FC16).u16(address + offset).u16(nb).u8(2 * nb).data(2 * nb).get(),
+                    start);
+    compare("FC 16 count 0", Request(FC16).u16(address).u16(0).u8(0).get(), start);
+    compare("FC 16 count > max", Request(FC16).u16(address).u16(124).u8(248).data(246).get(), start);
+    compare("FC 16 byte count mismatch", Request(FC16).u16(address).u16(2).u8(6).data(6).get(), start);
+    compare("FC 16 beyond table end", Request(FC16).u16(address + NB_REGS - 1).u16(2).u8(4).data(4).get(), start);
+
+    // FC 22: mask write register
+    constexpr auto FC22 = MODBUS_FC_MASK_WRITE_REGISTER;
+    compare("FC 22", Request(FC22).u16(address + 2).u16(0xF0F0).u16(0x0A0A).get(), start);
+    compare("FC 22 invalid address", Request(FC22).u16(address + NB_REGS).u16(0xF0F0).u16(0x0A0A).get(), start);
+
+    // FC 23: write and read registers
+    constexpr auto FC23 = MODBUS_FC_WRITE_AND_READ_REGISTERS;
+
+    const auto fc23 = [address](unsigned read, unsigned nb_read, unsigned write, unsigned nb_write, unsigned bytes) {
+        Request request(FC23);
+        request.u16(address + read).u16(nb_read).u16(address + write).u16(nb_write).u8(bytes);
+        return request.data(std::min(bytes, MAX_FC23_DATA)).get();
+    };
+    compare("FC 23", fc23(0, 10, 5, 3, 6), start);
+    compare("FC 23 overlapping", fc23(4, 4, 5, 2, 4), start);
+    compare("FC 23 maximum", fc23(0, 125, NB_REGS - 121, 121, 242), start);
+    compare("FC 23 read count 0", fc23(0, 0, 5, 1, 2), start);
+    compare("FC 23 write count 0", fc23(0, 1, 5, 0, 0), start);
+    compare("FC 23 read count > max", fc23(0, 126, 5, 1, 2), start);
+    compare("FC 23 write count > max", fc23(0, 1, 0, 122, 244), start);
+    compare("FC 23 byte count mismatch", fc23(0, 1, 5, 2, 2), start);
+    compare("FC 23 invalid read address", fc23(NB_REGS, 1, 5, 1, 2), start);
+    compare("FC 23 invalid write address", fc23(0, 1, NB_REGS - 1, 2, 4), start);
+}
+
+//! other supported function codes
+void test_other(int start) {
+    compare("FC 17", Request(MODBUS_FC_REPORT_SLAVE_ID).get(), start);
+}
+
+//! requests that are too short for their function code
+void test_truncated() {
+    check_truncated("FC 1 truncated", Request(MODBUS_FC_READ_COILS).u16(0).get());
+    check_truncated("FC 3 truncated", Request(MODBUS_FC_READ_HOLDING_REGISTERS).u16(0).u8(1).get());
+    check_truncated("FC 5 truncated", Request(MODBUS_FC_WRITE_SINGLE_COIL).u16(0).u8(0xFF).get());
+    check_truncated("FC 6 truncated", Request(MODBUS_FC_WRITE_SINGLE_REGISTER).u16(0).get());
+    check_truncated("FC 15 truncated header", Request(MODBUS_FC_WRITE_MULTIPLE_COILS).u16(0).u16(9).get());
+    check_truncated("FC 15 truncated data",
+                    Request(MODBUS_FC_WRITE_MULTIPLE_COILS).u16(0).u16(9).u8(2).data(1).get());
+    check_truncated("FC 16 truncated data",
+                    Request(MODBUS_FC_WRITE_MULTIPLE_REGISTERS).u16(0).u16(2).u8(4).data(3).get());
+    check_truncated("FC 22 truncated", Request(MODBUS_FC_MASK_WRITE_REGISTER).u16(0).u16(0xFFFF).get());
+    check_truncated("FC 23 truncated header",
+                    Request(MODBUS_FC_WRITE_AND_READ_REGISTERS).u16(0).u16(1).u16(0).u16(1).get());
+    check_truncated("FC 23 truncated data",
+                    Request(MODBUS_FC_WRITE_AND_READ_REGISTERS).u16(0).u16(1).u16(0).u16(1).u8(2).data(1).get());
+}
+
+}  // namespace
+
+int main() {
+    for (const int start : {0, 1000}) {
+        test_read(start);
+        test_write(start);
+        test_other(start);
+    }
+    test_truncated();
+
+    return Test::result();
+}